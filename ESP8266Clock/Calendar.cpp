@@ -0,0 +1,64 @@
+#include "Calendar.h"
+
+// ************************************************************
+// Put a two digit value into a pair of display digits
+// ************************************************************
+static void setDigitPair(byte *digits, byte pos, byte value) {
+  digits[pos] = value / 10;
+  digits[pos + 1] = value % 10;
+}
+
+// ************************************************************
+// Break the time down and precompute the display digits, only
+// if the time has changed since the last snapshot
+// ************************************************************
+boolean updateCalendar(calendar_t *cal, time_t t) {
+  if (t == cal->time) {
+    return false;
+  }
+
+  tmElements_t tm;
+  breakTime(t, tm);
+
+  cal->time = t;
+  cal->second = tm.Second;
+  cal->minute = tm.Minute;
+  cal->hour = tm.Hour;
+  cal->day = tm.Day;
+  cal->month = tm.Month;
+  cal->weekday = tm.Wday;
+  cal->year = tmYearToCalendar(tm.Year);
+  cal->weekend = (tm.Wday == 1) || (tm.Wday == 7);
+
+  if (tm.Hour == 0) {
+    cal->hour12 = 12;
+  } else if (tm.Hour > 12) {
+    cal->hour12 = tm.Hour - 12;
+  } else {
+    cal->hour12 = tm.Hour;
+  }
+
+  // Time digits HHMMSS in both hour modes
+  for (byte mode = CALENDAR_HOURS_24 ; mode <= CALENDAR_HOURS_12 ; mode++) {
+    byte *digits = cal->timeDigits[mode];
+    setDigitPair(digits, 0, (mode == CALENDAR_HOURS_12) ? cal->hour12 : cal->hour);
+    setDigitPair(digits, 2, cal->minute);
+    setDigitPair(digits, 4, cal->second);
+  }
+
+  // Date digits, numberArray[0] is the leftmost digit
+  byte yy = cal->year % 100;
+  setDigitPair(cal->dateDigits[DATE_FORMAT_YYMMDD], 0, yy);
+  setDigitPair(cal->dateDigits[DATE_FORMAT_YYMMDD], 2, cal->month);
+  setDigitPair(cal->dateDigits[DATE_FORMAT_YYMMDD], 4, cal->day);
+
+  setDigitPair(cal->dateDigits[DATE_FORMAT_MMDDYY], 0, cal->month);
+  setDigitPair(cal->dateDigits[DATE_FORMAT_MMDDYY], 2, cal->day);
+  setDigitPair(cal->dateDigits[DATE_FORMAT_MMDDYY], 4, yy);
+
+  setDigitPair(cal->dateDigits[DATE_FORMAT_DDMMYY], 0, cal->day);
+  setDigitPair(cal->dateDigits[DATE_FORMAT_DDMMYY], 2, cal->month);
+  setDigitPair(cal->dateDigits[DATE_FORMAT_DDMMYY], 4, yy);
+
+  return true;
+}
@@ -0,0 +1,40 @@
+#ifndef calendar_h
+#define calendar_h
+
+#include "Arduino.h"
+#include <TimeLib.h>
+#include "ClockDefs.h"
+
+// ************************************************************
+// Snapshot of the calendar, taken once per second tick. Every
+// TimeLib accessor (second(), hour(), weekday() ...) breaks the
+// time down again whenever it has moved on, so instead we break
+// it down once here and hand the snapshot round.
+//
+// The display digits for the time and the date are worked out
+// at the same moment, for each of the hour modes and date
+// formats, so loading them is just a copy.
+// ************************************************************
+
+#define CALENDAR_HOURS_24               0
+#define CALENDAR_HOURS_12               1
+
+typedef struct {
+  time_t time;
+  byte second;
+  byte minute;
+  byte hour;
+  byte hour12;
+  byte day;
+  byte month;
+  byte weekday;      // 1 = Sunday, as TimeLib
+  int year;
+  boolean weekend;
+  byte timeDigits[2][DIGIT_COUNT];
+  byte dateDigits[DATE_FORMAT_MAX + 1][DIGIT_COUNT];
+} calendar_t;
+
+// Bring the snapshot up to date, returns true if the time has moved on
+boolean updateCalendar(calendar_t *cal, time_t t);
+
+#endif
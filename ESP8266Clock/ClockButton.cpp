@@ -1,6 +1,29 @@
 #include "Arduino.h"
 #include "ClockButton.h"
 
+static const char* const BUTTON_EVENT_NAMES[BUTTON_EVENT_COUNT] = {
+  "none",
+  "press",
+  "click",
+  "double click",
+  "repeat",
+  "1S hold",
+  "2S hold",
+  "8S hold",
+  "1S press",
+  "2S press",
+  "8S press"
+};
+
+const char* getButtonEventName(byte type) {
+  if (type >= BUTTON_EVENT_COUNT) {
+    return "?";
+  }
+  return BUTTON_EVENT_NAMES[type];
+}
+
+ClockButton *ClockButton::_instance = NULL;
+
 ClockButton::ClockButton(int inputPin, boolean activeLow)
 {
   // NOTE: Grounding the input pin causes it to actuate
@@ -10,180 +33,216 @@ ClockButton::ClockButton(int inputPin, boolean activeLow)
 }
 
 // ************************************************************
-// MAIN BUTTON CHECK ENTRY POINT - should be called periodically
-// See if the button was pressed and debounce. We perform a
-// sort of preview here, then confirm by releasing. We track
-// 3 lengths of button press: momentarily, 1S and 2S.
+// A button held down at start up counts as pressed straight
+// away (used for the factory reset)
 // ************************************************************
-void ClockButton::checkButton(unsigned long nowMillis)
+void ClockButton::begin(unsigned long nowMillis)
 {
-  checkButtonInternal(nowMillis);
+  reset();
+  _pressed = readButton();
+  _candidate = _pressed;
+  _candidateMillis = nowMillis;
+  _sampledLevel = _pressed;
+  _pressStartMillis = nowMillis;
+
+  _instance = this;
+  attachInterrupt(digitalPinToInterrupt(_inputPin), edgeISR, CHANGE);
 }
 
 // ************************************************************
-// Reset everything
+// Edge interrupt: just the time and the level
 // ************************************************************
-void ClockButton::reset()
-{
-  resetInternal();
+ICACHE_RAM_ATTR void ClockButton::edgeISR() {
+  ClockButton *button = _instance;
+  button->pushEdge(millis(), (digitalRead(button->_inputPin) == LOW) == button->_activeLow);
 }
 
-// ************************************************************
-// Check if button is pressed right now (just debounce)
-// ************************************************************
-boolean ClockButton::isButtonPressedNow() {
-  return button1PressedCount == debounceCounter;
+ICACHE_RAM_ATTR void ClockButton::pushEdge(unsigned long edgeMillis, boolean level) {
+  byte head = _edgeHead;
+  byte next = (head + 1) & (BUTTON_EDGE_RING_SIZE - 1);
+  if (next == _edgeTail) {
+    _droppedEdges++;
+    return;
+  }
+  _edges[head].millis = edgeMillis;
+  _edges[head].level = level;
+  _edgeHead = next;
 }
 
-// ************************************************************
-// Check if button is pressed momentarily
-// ************************************************************
-boolean ClockButton::isButtonPressed() {
-  return buttonPress;
+void ClockButton::checkButton(unsigned long nowMillis, boolean pressed)
+{
+  if (pressed != _sampledLevel) {
+    _sampledLevel = pressed;
+    pushEdge(nowMillis, pressed);
+  }
+  update(nowMillis);
 }
 
 // ************************************************************
-// Check if button is pressed for a long time (> 1S)
+// Take the edges in order. A pending level that was held long
+// enough before the next edge came is taken first, so a whole
+// press that happened while we were busy is not lost.
 // ************************************************************
-boolean ClockButton::isButtonPressed1S() {
-  return buttonPress1S;
+void ClockButton::update(unsigned long nowMillis, void (*edgeCallback)(unsigned long edgeMillis, boolean pressed))
+{
+  while (_edgeTail != _edgeHead) {
+    unsigned long edgeMillis = _edges[_edgeTail].millis;
+    boolean level = _edges[_edgeTail].level;
+    _edgeTail = (_edgeTail + 1) & (BUTTON_EDGE_RING_SIZE - 1);
+
+    if (edgeCallback != NULL) {
+      edgeCallback(edgeMillis, level);
+    }
+
+    if ((_candidate != _pressed) && ((long) (edgeMillis - _candidateMillis) >= BUTTON_DEBOUNCE_MS)) {
+      setPressed(_candidate, _candidateMillis);
+    }
+    if (level != _candidate) {
+      _candidate = level;
+      _candidateMillis = edgeMillis;
+    }
+  }
+
+  // (the edge can be a little newer than nowMillis)
+  if ((_candidate != _pressed) && ((long) (nowMillis - _candidateMillis) >= BUTTON_DEBOUNCE_MS)) {
+    setPressed(_candidate, _candidateMillis);
+  }
+
+  // (not while a release is being debounced)
+  if (_pressed && _candidate) {
+    checkHold(nowMillis);
+  }
 }
 
 // ************************************************************
-// Check if button is pressed for a moderately long time (> 2S)
+// A debounced change of level
 // ************************************************************
-boolean ClockButton::isButtonPressed2S() {
-  return buttonPress2S;
+void ClockButton::setPressed(boolean pressed, unsigned long atMillis) {
+  _pressed = pressed;
+
+  if (_ignorePress) {
+    _ignorePress = pressed;
+    return;
+  }
+
+  if (pressed) {
+    _pressStartMillis = atMillis;
+    _holdLevel = 0;
+    _repeats = 0;
+    _repeatPress = _lastClickValid && ((atMillis - _lastClickMillis) <= BUTTON_DOUBLE_CLICK_MS);
+    pushEvent(BUTTON_EVENT_PRESS, atMillis);
+    return;
+  }
+
+  unsigned long heldMillis = atMillis - _pressStartMillis;
+
+  if (_repeatPress) {
+    // The second click of a double click, unless it repeated
+    if (_repeats == 0) {
+      pushEvent(BUTTON_EVENT_CLICK, atMillis);
+      pushEvent(BUTTON_EVENT_DOUBLE_CLICK, atMillis);
+    }
+    _lastClickValid = false;
+  } else if (heldMillis > BUTTON_HOLD_8S_MS) {
+    pushEvent(BUTTON_EVENT_RELEASE_8S, atMillis);
+    _lastClickValid = false;
+  } else if (heldMillis > BUTTON_HOLD_2S_MS) {
+    pushEvent(BUTTON_EVENT_RELEASE_2S, atMillis);
+    _lastClickValid = false;
+  } else if (heldMillis > BUTTON_HOLD_1S_MS) {
+    pushEvent(BUTTON_EVENT_RELEASE_1S, atMillis);
+    _lastClickValid = false;
+  } else {
+    pushEvent(BUTTON_EVENT_CLICK, atMillis);
+    _lastClickMillis = atMillis;
+    _lastClickValid = true;
+  }
 }
 
 // ************************************************************
-// Check if button is pressed for a very long time (> 8S)
+// While held: repeats, or the hold levels for the previews
 // ************************************************************
-boolean ClockButton::isButtonPressed8S() {
-  return buttonPress8S;
+void ClockButton::checkHold(unsigned long nowMillis) {
+  if (_ignorePress) {
+    return;
+  }
+
+  unsigned long heldMillis = nowMillis - _pressStartMillis;
+
+  if (_repeatPress) {
+    if ((heldMillis >= BUTTON_REPEAT_DELAY_MS) &&
+        ((_repeats == 0) || ((nowMillis - _lastRepeatMillis) >= BUTTON_REPEAT_MS))) {
+      _repeats++;
+      _lastRepeatMillis = nowMillis;
+      pushEvent(BUTTON_EVENT_REPEAT, nowMillis);
+    }
+    return;
+  }
+
+  if ((_holdLevel < 1) && (heldMillis > BUTTON_HOLD_1S_MS)) {
+    _holdLevel = 1;
+    pushEvent(BUTTON_EVENT_HOLD_1S, nowMillis);
+  }
+  if ((_holdLevel < 2) && (heldMillis > BUTTON_HOLD_2S_MS)) {
+    _holdLevel = 2;
+    pushEvent(BUTTON_EVENT_HOLD_2S, nowMillis);
+  }
+  if ((_holdLevel < 3) && (heldMillis > BUTTON_HOLD_8S_MS)) {
+    _holdLevel = 3;
+    pushEvent(BUTTON_EVENT_HOLD_8S, nowMillis);
+  }
 }
 
-// ************************************************************
-// Check if button is pressed for a short time (> 200mS) and released
-// ************************************************************
-boolean ClockButton::isButtonPressedAndReleased() {
-  if (buttonPressRelease) {
-    buttonPressRelease = false;
-    return true;
-  } else {
+void ClockButton::pushEvent(byte type, unsigned long atMillis) {
+  byte next = (_eventHead + 1) & (BUTTON_EVENT_QUEUE_SIZE - 1);
+  if (next == _eventTail) {
+    _droppedEvents++;
+    return;
+  }
+  _events[_eventHead].type = type;
+  _events[_eventHead].millis = atMillis;
+  _eventHead = next;
+}
+
+boolean ClockButton::getEvent(button_event_t *event) {
+  if (_eventTail == _eventHead) {
     return false;
   }
+  *event = _events[_eventTail];
+  _eventTail = (_eventTail + 1) & (BUTTON_EVENT_QUEUE_SIZE - 1);
+  return true;
 }
 
 // ************************************************************
-// Check if button is pressed for a long time (> 2) and released
+// Raw (not debounced) button level, true = pressed
 // ************************************************************
-boolean ClockButton::isButtonPressedReleased1S() {
-  if (buttonPressRelease1S) {
-    buttonPressRelease1S = false;
-    return true;
-  } else {
-    return false;
-  }
+boolean ClockButton::readButton() {
+  return (digitalRead(_inputPin) == LOW) == _activeLow;
 }
 
 // ************************************************************
-// Check if button is pressed for a very moderately time (> 2) and released
+// Forget any gestures waiting and any press in progress. A
+// button still held down has to be released first.
 // ************************************************************
-boolean ClockButton::isButtonPressedReleased2S() {
-  if (buttonPressRelease2S) {
-    buttonPressRelease2S = false;
-    return true;
-  } else {
-    return false;
-  }
+void ClockButton::reset()
+{
+  _eventTail = _eventHead;
+  _lastClickValid = false;
+  _repeatPress = false;
+  _ignorePress = _pressed;
 }
 
 // ************************************************************
-// Check if button is pressed for a very long time (> 8) and released
+// Check if button is pressed right now (just debounce)
 // ************************************************************
-boolean ClockButton::isButtonPressedReleased8S() {
-  if (buttonPressRelease8S) {
-    buttonPressRelease8S = false;
-    return true;
-  } else {
-    return false;
-  }
+boolean ClockButton::isButtonPressedNow() {
+  return _pressed;
 }
 
-void ClockButton::checkButtonInternal(unsigned long nowMillis) {
-  if (digitalRead(_inputPin) == 0) {
-    buttonWasReleased = false;
-
-    // We need consecutive pressed counts to treat this is pressed
-    if (button1PressedCount < debounceCounter) {
-      button1PressedCount += 1;
-      // If we reach the debounce point, mark the start time
-      if (button1PressedCount == debounceCounter) {
-        button1PressStartMillis = nowMillis;
-      }
-    } else {
-      // We are pressed and held, maintain the press states
-      if ((nowMillis - button1PressStartMillis) > 8000) {
-        buttonPress8S = true;
-        buttonPress2S = true;
-        buttonPress1S = true;
-        buttonPress = true;
-      } else if ((nowMillis - button1PressStartMillis) > 2000) {
-        buttonPress8S = false;
-        buttonPress2S = true;
-        buttonPress1S = true;
-        buttonPress = true;
-      } else if ((nowMillis - button1PressStartMillis) > 1000) {
-        buttonPress8S = false;
-        buttonPress2S = false;
-        buttonPress1S = true;
-        buttonPress = true;
-      } else {
-        buttonPress8S = false;
-        buttonPress2S = false;
-        buttonPress1S = false;
-        buttonPress = true;
-      }
-    }
-  } else {
-    // mark this as a press and release if we were pressed for less than a long press
-    if (button1PressedCount == debounceCounter) {
-      buttonWasReleased = true;
-
-      buttonPressRelease8S = false;
-      buttonPressRelease2S = false;
-      buttonPressRelease1S = false;
-      buttonPressRelease = false;
-
-      if (buttonPress8S) {
-        buttonPressRelease8S = true;
-      } else if (buttonPress2S) {
-        buttonPressRelease2S = true;
-      } else if (buttonPress1S) {
-        buttonPressRelease1S = true;
-      } else if (buttonPress) {
-        buttonPressRelease = true;
-      }
-    }
+unsigned long ClockButton::getDroppedEdges() {
+  return _droppedEdges;
+}
 
-    // Reset the switch flags debounce counter
-    buttonPress8S = false;
-    buttonPress2S = false;
-    buttonPress1S = false;
-    buttonPress = false;
-    button1PressedCount = 0;
-  }
-}
-
-void ClockButton::resetInternal() {
-  buttonPressRelease8S = false;
-  buttonPressRelease2S = false;
-  buttonPressRelease1S = false;
-  buttonPressRelease = false;
-  buttonPress8S = false;
-  buttonPress2S = false;
-  buttonPress1S = false;
-  buttonPress = false;
-  button1PressedCount = 0;
+unsigned long ClockButton::getDroppedEvents() {
+  return _droppedEvents;
 }
@@ -9,38 +9,130 @@
 // ************************** Pin Allocations *************************
 #define inputPin1   0     // D3
 
+// ************************************************************
+// The button is read by an edge interrupt, which puts the time
+// and level of each edge into a small ring. update() takes the
+// edges in order, debounces them (a level has to be held for
+// BUTTON_DEBOUNCE_MS) and turns them into gesture events, timed
+// from the edges themselves. Nothing depends on how often
+// update() is called, and a press during a slow web request is
+// still seen when the loop gets back to us.
+//
+// Gestures:
+//   PRESS          the button went down
+//   CLICK          released before 1S
+//   HOLD_1S/2S/8S  still held after 1S, 2S, 8S (to preview)
+//   RELEASE_1S/... released after 1S, 2S, 8S
+//   DOUBLE_CLICK   a second click within BUTTON_DOUBLE_CLICK_MS
+//                  of the first (after its own CLICK)
+//   REPEAT         click, then press again and hold: repeats
+//                  every BUTTON_REPEAT_MS after BUTTON_REPEAT_DELAY_MS,
+//                  for stepping values quickly. This press does
+//                  not give HOLD or RELEASE events.
+// ************************************************************
+
+#define BUTTON_DEBOUNCE_MS              30
+#define BUTTON_DOUBLE_CLICK_MS          300
+#define BUTTON_REPEAT_DELAY_MS          400
+#define BUTTON_REPEAT_MS                100
+#define BUTTON_HOLD_1S_MS               1000
+#define BUTTON_HOLD_2S_MS               2000
+#define BUTTON_HOLD_8S_MS               8000
+#define BUTTON_EDGE_RING_SIZE           16      // power of 2
+// update() can turn a full edge ring into events before any are
+// taken: 8 presses, each a PRESS and a CLICK, and every second one
+// a DOUBLE_CLICK as well, plus a hold or repeat, fit in 31
+#define BUTTON_EVENT_QUEUE_SIZE         32      // power of 2
+
+#define BUTTON_EVENT_NONE               0
+#define BUTTON_EVENT_PRESS              1
+#define BUTTON_EVENT_CLICK              2
+#define BUTTON_EVENT_DOUBLE_CLICK       3
+#define BUTTON_EVENT_REPEAT             4
+#define BUTTON_EVENT_HOLD_1S            5
+#define BUTTON_EVENT_HOLD_2S            6
+#define BUTTON_EVENT_HOLD_8S            7
+#define BUTTON_EVENT_RELEASE_1S         8
+#define BUTTON_EVENT_RELEASE_2S         9
+#define BUTTON_EVENT_RELEASE_8S         10
+#define BUTTON_EVENT_COUNT              11
+
+typedef struct {
+  byte type;
+  unsigned long millis;
+} button_event_t;
+
+typedef struct {
+  unsigned long millis;
+  byte level;
+} button_edge_t;
+
 class ClockButton
 {
   public:
     ClockButton(int inputPin, boolean activeLow);
-    void checkButton(unsigned long nowMillis);
+
+    // Take the current level and start the edge interrupt
+    void begin(unsigned long nowMillis);
+
+    // Process the edges so far, calls back with the time and
+    // level of each raw edge (for the input recorder)
+    void update(unsigned long nowMillis, void (*edgeCallback)(unsigned long edgeMillis, boolean pressed) = NULL);
+
+    // Sampled level instead of the interrupt, e.g. replayed from
+    // a recording
+    void checkButton(unsigned long nowMillis, boolean pressed);
+
+    boolean readButton();
     void reset();
+
+    // Debounced level
     boolean isButtonPressedNow();
-    boolean isButtonPressed();
-    boolean isButtonPressed1S();
-    boolean isButtonPressed2S();
-    boolean isButtonPressed8S();
-    boolean isButtonPressedAndReleased();
-    boolean isButtonPressedReleased1S();
-    boolean isButtonPressedReleased2S();
-    boolean isButtonPressedReleased8S();
+
+    // Next gesture, false if there is none
+    boolean getEvent(button_event_t *event);
+
+    unsigned long getDroppedEdges();
+    unsigned long getDroppedEvents();
+
   private:
+    static void edgeISR();
+
+    static ClockButton *_instance;
+
     int _inputPin;
     boolean _activeLow;
-    void checkButtonInternal(unsigned long nowMillis);
-    void resetInternal();
-    int  button1PressedCount = 0;
-    unsigned long button1PressStartMillis = 0;
-    const byte debounceCounter = 5; // Number of successive reads before we say the switch is down
-    boolean buttonWasReleased = false;
-    boolean buttonPress8S = false;
-    boolean buttonPress2S = false;
-    boolean buttonPress1S = false;
-    boolean buttonPress = false;
-    boolean buttonPressRelease8S = false;
-    boolean buttonPressRelease2S = false;
-    boolean buttonPressRelease1S = false;
-    boolean buttonPressRelease = false;
+
+    volatile button_edge_t _edges[BUTTON_EDGE_RING_SIZE];
+    volatile byte _edgeHead = 0;                // written by the interrupt only
+    volatile byte _edgeTail = 0;                // written by update() only
+    volatile unsigned long _droppedEdges = 0;
+    boolean _sampledLevel = false;
+
+    boolean _candidate = false;
+    unsigned long _candidateMillis = 0;
+    boolean _pressed = false;
+
+    unsigned long _pressStartMillis = 0;
+    unsigned long _lastClickMillis = 0;
+    boolean _lastClickValid = false;
+    boolean _repeatPress = false;
+    unsigned long _lastRepeatMillis = 0;
+    unsigned int _repeats = 0;
+    byte _holdLevel = 0;
+    boolean _ignorePress = false;
+
+    button_event_t _events[BUTTON_EVENT_QUEUE_SIZE];
+    byte _eventHead = 0;
+    byte _eventTail = 0;
+    unsigned long _droppedEvents = 0;
+
+    void pushEdge(unsigned long edgeMillis, boolean level);
+    void setPressed(boolean pressed, unsigned long atMillis);
+    void checkHold(unsigned long nowMillis);
+    void pushEvent(byte type, unsigned long atMillis);
 };
 
+const char* getButtonEventName(byte type);
+
 #endif
@@ -32,6 +32,18 @@
 #define SENSOR_SMOOTH_READINGS_MAX     255
 #define SENSOR_SMOOTH_READINGS_DEFAULT 100  // Speed at which the brighness adapts to changes
 
+#define LDR_HYSTERESIS_MIN             0    // LDR counts past a step boundary before the brightness changes
+#define LDR_HYSTERESIS_MAX             100
+#define LDR_HYSTERESIS_DEFAULT         20
+
+#define LDR_SLEW_MS_MIN                0    // Minimum time between brightness steps, 0 = jump straight there
+#define LDR_SLEW_MS_MAX                5000
+#define LDR_SLEW_MS_DEFAULT            500
+
+// -------------------------------------------------------------------------------
+#define LED_EFFECT_DEFAULT             0
+#define LED_PALETTE_DEFAULT            0
+
 // -------------------------------------------------------------------------------
 #define SECS_MAX  60
 #define MINS_MAX  60
@@ -149,9 +161,18 @@
 #define PIR_TIMEOUT_MIN                 60    // 1 minute in seconds
 #define PIR_TIMEOUT_MAX                 3600  // 1 hour in seconds
 #define PIR_TIMEOUT_DEFAULT             300   // 5 minutes in seconds
+#define PIR_EMPTY_TIMEOUT_DIVIDER       4     // Shorter timeout in hours that are normally empty
+#define USE_OCCUPANCY_DEFAULT           true
+#define OCCUPANCY_SAVE_HOURS            6     // How often the learnt occupancy is saved
 
 // -------------------------------------------------------------------------------
 #define USE_LDR_DEFAULT                 true
+#define LDR_AUTO_CALIBRATE_DEFAULT      true
+#define LDR_CAL_SAVE_HOURS              6     // How often the learnt light levels are saved
+
+// -------------------------------------------------------------------------------
+#define CLOCK_FREQ_SAVE_HOURS           6       // How often the learnt crystal frequency is saved
+#define CLOCK_HOLDOVER_MAX_US           100000  // Follow the discipline without NTP until it may be this far out
 
 // -------------------------------------------------------------------------------
 #define SLOTS_MODE_MIN                  0
@@ -191,11 +212,18 @@
 #define DIAGS_DELAY_TIME                500
 
 // -------------------------------------------------------------------------------
-#define SYNC_HOURS 3
-#define SYNC_MINS 4
-#define SYNC_SECS 5
-#define SYNC_DAY 2
-#define SYNC_MONTH 1
-#define SYNC_YEAR 0
+// Main loop task periods (LoopScheduler), 0 = every pass
+#define TASK_PERIOD_NETWORK_MS          0
+#define TASK_PERIOD_BUTTON_MS           10    // drains the button edge ring
+#define TASK_PERIOD_FRAME_MS            10    // 100Hz display frames
+#define TASK_PERIOD_LDR_MS              50    // 20Hz
+#define TASK_PERIOD_PIR_MS              50    // drains the PIR edge ring
+#define LED_FRAME_DIVIDER               2     // LEDs on every 2nd frame: 50Hz
+
+// -------------------------------------------------------------------------------
+// Low power (tubes and LEDs blanked)
+#define TASK_PERIOD_FRAME_LOW_POWER_MS  100   // 10Hz, clock and modes only
+#define LOW_POWER_IDLE_SLICE_MS         5
+#define WAKE_WEB_BLANK_SUPPRESS_MS      60000
 
 #endif
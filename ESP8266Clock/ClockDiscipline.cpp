@@ -0,0 +1,224 @@
+#include "ClockDiscipline.h"
+#include <string.h>
+
+ClockDiscipline::ClockDiscipline() {
+  memset(&_freq, 0, sizeof(_freq));
+  _freq.magic = CLOCK_FREQ_MAGIC;
+  _freq.version = CLOCK_FREQ_VERSION;
+  _freq.frequencyErrorPpb = CLOCK_FREQ_ERROR_INITIAL_PPB;
+}
+
+// ************************************************************
+// A new measurement of the offset. Small errors are slewed out
+// from here on, so the time never jumps, a big one (a first
+// sync, a server change, a time set by hand) is stepped. The
+// step is how far out the clock was just before the sync.
+// ************************************************************
+void ClockDiscipline::addSync(int64_t localUs, int64_t offsetUs, int64_t jitterUs) {
+  if (_set) {
+    int64_t currentOffsetUs = getUtcUs(localUs) - localUs;
+    _lastStepUs = offsetUs - currentOffsetUs;
+    if ((_lastStepUs > CLOCK_STEP_US) || (_lastStepUs < -CLOCK_STEP_US)) {
+      _offsetUs = offsetUs;
+      _slewUs = 0;
+      _lastStepSlewed = false;
+      _freqBaseSet = false;
+      _steps++;
+    } else {
+      _offsetUs = currentOffsetUs;
+      _slewUs = _lastStepUs;
+      _lastStepSlewed = true;
+    }
+  } else {
+    _lastStepUs = 0;
+    _lastStepSlewed = false;
+    _offsetUs = offsetUs;
+    _slewUs = 0;
+  }
+
+  _syncLocalUs = localUs;
+  _jitterUs = jitterUs;
+  _set = true;
+  _syncs++;
+  _maxPhaseErrorUs = 0;
+
+  measureFrequency(localUs, offsetUs);
+}
+
+// ************************************************************
+// Frequency locked loop: the drift of the measured offsets over
+// the time between them is the frequency error of the local
+// clock. Our own corrections do not come into it.
+// ************************************************************
+void ClockDiscipline::measureFrequency(int64_t localUs, int64_t offsetUs) {
+  if (!_freqBaseSet) {
+    _freqBaseLocalUs = localUs;
+    _freqBaseOffsetUs = offsetUs;
+    _freqBaseSet = true;
+    return;
+  }
+
+  int64_t intervalUs = localUs - _freqBaseLocalUs;
+  if (intervalUs < CLOCK_FREQ_MIN_INTERVAL_US) {
+    return;
+  }
+
+  int64_t samplePpb = (offsetUs - _freqBaseOffsetUs) * 1000000000LL / intervalUs;
+  _freqBaseLocalUs = localUs;
+  _freqBaseOffsetUs = offsetUs;
+  if ((samplePpb > CLOCK_FREQ_MAX_PPB) || (samplePpb < -CLOCK_FREQ_MAX_PPB)) {
+    return;
+  }
+
+  int64_t errorPpb;
+  if (_freq.measurements == 0) {
+    // The first one is only as good as the two offsets it came from
+    _freq.frequencyPpb = (int32_t) samplePpb;
+    errorPpb = 2 * _jitterUs * 1000000000LL / intervalUs;
+  } else {
+    int64_t diffPpb = samplePpb - _freq.frequencyPpb;
+    _freq.frequencyPpb += (int32_t) (diffPpb / CLOCK_FREQ_SMOOTH);
+    if (diffPpb < 0) {
+      diffPpb = -diffPpb;
+    }
+    errorPpb = (int64_t) _freq.frequencyErrorPpb + (diffPpb - (int64_t) _freq.frequencyErrorPpb) / CLOCK_FREQ_SMOOTH;
+  }
+
+  if (errorPpb < CLOCK_FREQ_ERROR_MIN_PPB) {
+    errorPpb = CLOCK_FREQ_ERROR_MIN_PPB;
+  } else if (errorPpb > CLOCK_FREQ_ERROR_INITIAL_PPB) {
+    errorPpb = CLOCK_FREQ_ERROR_INITIAL_PPB;
+  }
+  _freq.frequencyErrorPpb = (uint32_t) errorPpb;
+  _freq.measurements++;
+}
+
+void ClockDiscipline::invalidate() {
+  _set = false;
+}
+
+bool ClockDiscipline::isSet() {
+  return _set;
+}
+
+// ************************************************************
+// How much of the phase error has been slewed out by localUs
+// ************************************************************
+int64_t ClockDiscipline::getSlewedUs(int64_t localUs) {
+  int64_t maxUs = (localUs - _syncLocalUs) * CLOCK_SLEW_MAX_PPB / 1000000000LL;
+  if (_slewUs > maxUs) {
+    return maxUs;
+  }
+  if (_slewUs < -maxUs) {
+    return -maxUs;
+  }
+  return _slewUs;
+}
+
+int64_t ClockDiscipline::getUtcUs(int64_t localUs) {
+  int64_t elapsedUs = localUs - _syncLocalUs;
+  return localUs + _offsetUs + elapsedUs * _freq.frequencyPpb / 1000000000LL + getSlewedUs(localUs);
+}
+
+int64_t ClockDiscipline::getHoldoverErrorUs(int64_t localUs) {
+  int64_t elapsedUs = localUs - _syncLocalUs;
+  int64_t unslewedUs = _slewUs - getSlewedUs(localUs);
+  if (unslewedUs < 0) {
+    unslewedUs = -unslewedUs;
+  }
+  return _jitterUs + unslewedUs + elapsedUs * (int64_t) _freq.frequencyErrorPpb / 1000000000LL;
+}
+
+void ClockDiscipline::recordPhaseError(int64_t errorUs, bool armed) {
+  if (errorUs > 1000000) {
+    errorUs = 1000000;
+  } else if (errorUs < -1000000) {
+    errorUs = -1000000;
+  }
+
+  _lastPhaseErrorUs = (int32_t) errorUs;
+  int32_t absErrorUs = (_lastPhaseErrorUs < 0) ? -_lastPhaseErrorUs : _lastPhaseErrorUs;
+  _averagePhaseErrorUs += (absErrorUs - _averagePhaseErrorUs) / CLOCK_PHASE_SMOOTH;
+  if (absErrorUs > _maxPhaseErrorUs) {
+    _maxPhaseErrorUs = absErrorUs;
+  }
+
+  if (armed) {
+    _armedFlips++;
+  } else {
+    _lateFlips++;
+  }
+}
+
+int32_t ClockDiscipline::getLastPhaseErrorUs() {
+  return _lastPhaseErrorUs;
+}
+
+int32_t ClockDiscipline::getAveragePhaseErrorUs() {
+  return _averagePhaseErrorUs;
+}
+
+int32_t ClockDiscipline::getMaxPhaseErrorUs() {
+  return _maxPhaseErrorUs;
+}
+
+uint32_t ClockDiscipline::getArmedFlips() {
+  return _armedFlips;
+}
+
+uint32_t ClockDiscipline::getLateFlips() {
+  return _lateFlips;
+}
+
+int64_t ClockDiscipline::getLastStepUs() {
+  return _lastStepUs;
+}
+
+bool ClockDiscipline::wasLastStepSlewed() {
+  return _lastStepSlewed;
+}
+
+uint32_t ClockDiscipline::getSyncs() {
+  return _syncs;
+}
+
+uint32_t ClockDiscipline::getSteps() {
+  return _steps;
+}
+
+int32_t ClockDiscipline::getFrequencyPpb() {
+  return _freq.frequencyPpb;
+}
+
+uint32_t ClockDiscipline::getFrequencyErrorPpb() {
+  return _freq.frequencyErrorPpb;
+}
+
+uint32_t ClockDiscipline::getFrequencyMeasurements() {
+  return _freq.measurements;
+}
+
+const clock_freq_data_t* ClockDiscipline::getData() {
+  return &_freq;
+}
+
+// ************************************************************
+// A saved frequency is where we start from, it is refined by
+// the next measurements
+// ************************************************************
+bool ClockDiscipline::setData(const clock_freq_data_t *data) {
+  if ((data->magic != CLOCK_FREQ_MAGIC) || (data->version != CLOCK_FREQ_VERSION)) {
+    return false;
+  }
+  if ((data->frequencyPpb > CLOCK_FREQ_MAX_PPB) || (data->frequencyPpb < -CLOCK_FREQ_MAX_PPB)) {
+    return false;
+  }
+
+  memcpy(&_freq, data, sizeof(_freq));
+  if (_freq.frequencyErrorPpb < CLOCK_FREQ_ERROR_MIN_PPB) {
+    _freq.frequencyErrorPpb = CLOCK_FREQ_ERROR_MIN_PPB;
+  } else if (_freq.frequencyErrorPpb > CLOCK_FREQ_ERROR_INITIAL_PPB) {
+    _freq.frequencyErrorPpb = CLOCK_FREQ_ERROR_INITIAL_PPB;
+  }
+  return true;
+}
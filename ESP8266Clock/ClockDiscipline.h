@@ -0,0 +1,127 @@
+#ifndef clockdiscipline_h
+#define clockdiscipline_h
+
+#include <stdint.h>
+
+// ************************************************************
+// Keeps UTC to the microsecond between NTP syncs, so that the
+// displayed seconds change on the true second boundaries.
+//
+// Each sync gives the offset of UTC from the local microsecond
+// counter (micros64() on the clock), and from then on
+//   UTC = local + offset + frequency * (local - sync) + slew
+// The frequency error of the local crystal is learnt from
+// successive syncs at least CLOCK_FREQ_MIN_INTERVAL_US apart
+// (a frequency locked loop) and smoothed over CLOCK_FREQ_SMOOTH
+// measurements. Phase errors found at a sync are not stepped
+// but slewed out at up to CLOCK_SLEW_MAX_PPB, unless they are
+// more than CLOCK_STEP_US, then the time is stepped.
+//
+// The holdover error, how far out the time may be by now, grows
+// from the NTP jitter at the last sync with the uncertainty of
+// the learnt frequency.
+//
+// The display looks one frame ahead for the next UTC second
+// boundary and arms the new frame for the display interrupt to
+// put up at that moment. The phase error, how far from the true
+// boundary the digits actually changed, is recorded here.
+//
+// The learnt frequency is a fixed size struct, saved as it is.
+// No Arduino dependencies.
+// ************************************************************
+
+#define CLOCK_PHASE_SMOOTH              16        // samples for the average phase error
+
+#define CLOCK_FREQ_MAGIC                0x4643    // "CF"
+#define CLOCK_FREQ_VERSION              1
+#define CLOCK_FREQ_MIN_INTERVAL_US      60000000  // shorter than this between syncs and the noise swamps the drift
+#define CLOCK_FREQ_SMOOTH               4         // measurements
+#define CLOCK_FREQ_MAX_PPB              500000    // 500 ppm, more than that is not a crystal
+#define CLOCK_FREQ_ERROR_INITIAL_PPB    50000     // what a crystal could be out before we know better
+#define CLOCK_FREQ_ERROR_MIN_PPB        100       // never trust the learnt frequency more than this
+#define CLOCK_STEP_US                   128000    // as ntpd, step the time if it is out by more
+#define CLOCK_SLEW_MAX_PPB              500000    // 0.5 mS per second
+
+typedef struct {
+  uint16_t magic;
+  uint8_t version;
+  uint8_t reserved;
+  int32_t frequencyPpb;                          // + = the local clock is slow
+  uint32_t frequencyErrorPpb;                    // average size of the measurement errors
+  uint32_t measurements;                         // learnt from in total
+} clock_freq_data_t;
+
+class ClockDiscipline
+{
+  public:
+    ClockDiscipline();
+
+    // A new offset (UTC - local) measured at local time localUs,
+    // with the jitter of the measurement
+    void addSync(int64_t localUs, int64_t offsetUs, int64_t jitterUs);
+
+    // Forget the syncs (not the frequency), e.g. when the time is
+    // set by hand
+    void invalidate();
+
+    bool isSet();
+    int64_t getUtcUs(int64_t localUs);
+
+    // How far out the time may be at localUs
+    int64_t getHoldoverErrorUs(int64_t localUs);
+
+    // How far UTC was from the displayed second boundary when the
+    // digits changed (+ = late), and if the change was armed ahead
+    void recordPhaseError(int64_t errorUs, bool armed);
+
+    int32_t getLastPhaseErrorUs();
+    int32_t getAveragePhaseErrorUs();             // of the size of the error
+    int32_t getMaxPhaseErrorUs();                 // since the last sync
+    uint32_t getArmedFlips();
+    uint32_t getLateFlips();
+
+    int64_t getLastStepUs();                      // correction made by the last sync
+    bool wasLastStepSlewed();
+    uint32_t getSyncs();
+    uint32_t getSteps();
+
+    int32_t getFrequencyPpb();
+    uint32_t getFrequencyErrorPpb();
+    uint32_t getFrequencyMeasurements();
+
+    // For saving and loading
+    const clock_freq_data_t* getData();
+    bool setData(const clock_freq_data_t *data);
+
+  private:
+    bool _set = false;
+    int64_t _syncLocalUs = 0;
+    int64_t _offsetUs = 0;                        // at _syncLocalUs
+    int64_t _slewUs = 0;                          // still to slew out from _syncLocalUs
+    int64_t _jitterUs = 0;
+    int64_t _lastStepUs = 0;
+    bool _lastStepSlewed = false;
+    uint32_t _syncs = 0;
+    uint32_t _steps = 0;
+
+    // Start of the current frequency measurement
+    bool _freqBaseSet = false;
+    int64_t _freqBaseLocalUs = 0;
+    int64_t _freqBaseOffsetUs = 0;
+    clock_freq_data_t _freq;
+
+    int32_t _lastPhaseErrorUs = 0;
+    int32_t _averagePhaseErrorUs = 0;
+    int32_t _maxPhaseErrorUs = 0;
+    uint32_t _armedFlips = 0;
+    uint32_t _lateFlips = 0;
+
+    int64_t getSlewedUs(int64_t localUs);
+    void measureFrequency(int64_t localUs, int64_t offsetUs);
+};
+
+// ----------------- Exported Variables ------------------
+
+static ClockDiscipline clockDiscipline;
+
+#endif
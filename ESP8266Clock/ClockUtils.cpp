@@ -53,16 +53,22 @@ String secsToReadableString (long secsValue) {
   return uptimeString;
 }
 
-void grabInts(String s, int *dest, String sep) {
-  int end = 0;
-  for (int start = 0; end != -1; start = end + 1) {
-    end = s.indexOf(sep, start);
-    if (end > 0) {
-      *dest++ = s.substring(start, end).toInt();
-    } else {
-      *dest++ = s.substring(start).toInt();
-    }
+// ************************************************************
+// Microseconds as mS with 3 decimals, e.g. "-1.234 mS"
+// ************************************************************
+String formatMicros(int64_t micros) {
+  String result = (micros < 0) ? "-" : "";
+  uint64_t absMicros = (micros < 0) ? -micros : micros;
+  unsigned long fraction = absMicros % 1000;
+  result += String((unsigned long) (absMicros / 1000)) + ".";
+  if (fraction < 100) {
+    result += "0";
+  }
+  if (fraction < 10) {
+    result += "0";
   }
+  result += String(fraction) + " mS";
+  return result;
 }
 
 unsigned char hex2bcd (unsigned char x) {
@@ -19,9 +19,9 @@ String getBool(bool value);
 String formatIPAsString(IPAddress ip);
 int getIntValue(String data, char separator, int index);
 String getValue(String data, char separator, int index);
-void grabInts(String s, int *dest, String sep);
 unsigned char hex2bcd (unsigned char x);
 String secsToReadableString(long secsValue);
+String formatMicros(int64_t micros);
 
 // ----------------------------------------------------------------------------------------------------
 // --------------------------------------------- Debugging --------------------------------------------
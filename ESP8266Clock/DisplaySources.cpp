@@ -0,0 +1,97 @@
+#include "DisplaySources.h"
+
+// ************************************************************
+// Version of the digits, moves on each time they change
+// ************************************************************
+uint32_t DisplaySource::getVersion() {
+  return _version;
+}
+
+const byte* DisplaySource::getDigits() {
+  return _digits;
+}
+
+// ************************************************************
+// Take the new digits. Version 0 means "never published", so
+// the first publish always counts as a change.
+// ************************************************************
+void DisplaySource::publish(const byte *digits) {
+  if ((_version > 0) && (memcmp(_digits, digits, DIGIT_COUNT) == 0)) {
+    return;
+  }
+
+  memcpy(_digits, digits, DIGIT_COUNT);
+  _version++;
+  if (_version == 0) {
+    _version = 1;
+  }
+}
+
+// ************************************************************
+// Only look at the calendar when the time or the hour mode has
+// moved on
+// ************************************************************
+void TimeSource::update(const calendar_t &cal, boolean hour12) {
+  if ((getVersion() > 0) && (cal.time == _lastTime) && (hour12 == _lastHour12)) {
+    return;
+  }
+  _lastTime = cal.time;
+  _lastHour12 = hour12;
+
+  publish(cal.timeDigits[hour12 ? CALENDAR_HOURS_12 : CALENDAR_HOURS_24]);
+}
+
+// ************************************************************
+// The date changes once a day, but the snapshot every second
+// ************************************************************
+void DateSource::update(const calendar_t &cal, byte dateFormat) {
+  if ((cal.time == _lastTime) && (dateFormat == _lastFormat)) {
+    return;
+  }
+  _lastTime = cal.time;
+  _lastFormat = dateFormat;
+
+  if (dateFormat <= DATE_FORMAT_MAX) {
+    publish(cal.dateDigits[dateFormat]);
+  }
+}
+
+// ************************************************************
+// Six digit number, numberArray[0] is the leftmost digit
+// ************************************************************
+void NumberSource::update(long value) {
+  byte digits[DIGIT_COUNT];
+  for (int idx = DIGIT_COUNT - 1 ; idx >= 0 ; idx--) {
+    digits[idx] = value % 10;
+    value = value / 10;
+  }
+  publish(digits);
+}
+
+// ************************************************************
+// Reading in the left four digits, number in the right two
+// ************************************************************
+void ReadingSource::update(int reading, byte readingNum) {
+  byte digits[DIGIT_COUNT];
+  digits[0] = (reading / 1000) % 10;
+  digits[1] = (reading / 100) % 10;
+  digits[2] = (reading / 10) % 10;
+  digits[3] = reading % 10;
+  digits[4] = (readingNum / 10) % 10;
+  digits[5] = readingNum % 10;
+  publish(digits);
+}
+
+// ************************************************************
+// Each byte of the address as three digits
+// ************************************************************
+void IPSource::update(byte byte1, byte byte2) {
+  byte digits[DIGIT_COUNT];
+  digits[0] = (byte1 / 100) % 10;
+  digits[1] = (byte1 / 10) % 10;
+  digits[2] = byte1 % 10;
+  digits[3] = (byte2 / 100) % 10;
+  digits[4] = (byte2 / 10) % 10;
+  digits[5] = byte2 % 10;
+  publish(digits);
+}
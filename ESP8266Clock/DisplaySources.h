@@ -0,0 +1,74 @@
+#ifndef displaysources_h
+#define displaysources_h
+
+#include "Arduino.h"
+#include "Calendar.h"
+
+// ************************************************************
+// Display sources: each source holds six display digits and a
+// version number. The version only moves on when the digits
+// actually change, so the display only has to load the digits
+// (and apply the digit formats) when the version it loaded
+// last is out of date.
+// ************************************************************
+
+class DisplaySource
+{
+  public:
+    uint32_t getVersion();
+    const byte* getDigits();
+
+  protected:
+    // Take the new digits, moving the version on if they changed
+    void publish(const byte *digits);
+
+  private:
+    byte _digits[DIGIT_COUNT];
+    uint32_t _version = 0;
+};
+
+// Time of day HHMMSS, from the calendar snapshot
+class TimeSource : public DisplaySource
+{
+  public:
+    void update(const calendar_t &cal, boolean hour12);
+
+  private:
+    time_t _lastTime = 0;
+    boolean _lastHour12 = false;
+};
+
+// Date in the configured format, from the calendar snapshot
+class DateSource : public DisplaySource
+{
+  public:
+    void update(const calendar_t &cal, byte dateFormat);
+
+  private:
+    time_t _lastTime = 0;
+    byte _lastFormat = 0xff;
+};
+
+// A six digit number, e.g. the value sent from the web page
+class NumberSource : public DisplaySource
+{
+  public:
+    void update(long value);
+};
+
+// A four digit reading followed by a two digit number, e.g. a
+// sensor reading or the software version
+class ReadingSource : public DisplaySource
+{
+  public:
+    void update(int reading, byte readingNum);
+};
+
+// Two bytes of an IP address
+class IPSource : public DisplaySource
+{
+  public:
+    void update(byte byte1, byte byte2);
+};
+
+#endif
@@ -40,6 +40,7 @@
 // Other parts of the code, broken out for clarity
 #include "Globals.h"
 #include "ClockButton.h"
+#include "ClockDiscipline.h"
 #include "DA2000-Transition.h"
 #include "DebugManager.h"
 #include "DisplayDefs.h"
@@ -47,9 +48,15 @@
 #include "ClockDefs.h"
 #include "ESP_DS1307.h"
 #include "HtmlServer.h"
+#include "LDRCalibration.h"
+#include "LDRManager.h"
 #include "LEDManager.h"
+#include "LoopScheduler.h"
 #include "NtpAsync.h"
+#include "OccupancyManager.h"
 #include "OutputManagerMicrochip6.h"
+#include "PIRMonitor.h"
+#include "PowerManager.h"
 #include "SPIFFS.h"
 
 // Feature configuration (append "_OFF" to switch off)
@@ -60,6 +67,17 @@
 #define FEATURE_PIR
 #define FEATURE_EXT_LEDS_OFF
 #define FEATURE_LED_MODES
+#define FEATURE_PROFILER_OFF
+
+// Loop stage profiling, compiles to nothing without FEATURE_PROFILER
+#ifdef FEATURE_PROFILER
+#include "LoopProfiler.h"
+#define PROFILE_START(stage)  uint32_t profileStart_##stage = ESP.getCycleCount()
+#define PROFILE_END(stage)    profiler.addSample(stage, ESP.getCycleCount() - profileStart_##stage)
+#else
+#define PROFILE_START(stage)
+#define PROFILE_END(stage)
+#endif
 
 //**********************************************************************************
 //**********************************************************************************
@@ -75,6 +93,13 @@ volatile byte phaseStep = 0;
 volatile uint32_t valueBufferCurr1[COUNTS_PER_DIGIT], valueBufferCurr2[COUNTS_PER_DIGIT];
 volatile uint32_t lastOut1, lastOut2;
 
+// A frame held back until its second starts (see OutputManager::armNextCommit)
+volatile uint32_t valueBufferNext1[COUNTS_PER_DIGIT], valueBufferNext2[COUNTS_PER_DIGIT];
+volatile boolean frameArmed = false;
+volatile uint32_t frameArmedMicros = 0;
+volatile boolean frameFlipped = false;
+volatile uint32_t frameFlipMicros = 0;
+
 // ************************************************************
 // Interrupt routine for scheduled interrupts
 //  - performs the programmed action and then schedules the next
@@ -85,6 +110,17 @@ volatile uint32_t lastOut1, lastOut2;
 //     3 - turn the digit off
 // ************************************************************
 ICACHE_RAM_ATTR void displayUpdate() {
+  // Put up the frame for the new second once it has started
+  if (frameArmed && ((long) (micros() - frameArmedMicros) >= 0)) {
+    for (int idx = 0 ; idx < COUNTS_PER_DIGIT ; idx++) {
+      valueBufferCurr1[idx] = valueBufferNext1[idx];
+      valueBufferCurr2[idx] = valueBufferNext2[idx];
+    }
+    frameArmed = false;
+    frameFlipMicros = micros();
+    frameFlipped = true;
+  }
+
   phaseStep++;
   if (phaseStep >= COUNTS_PER_DIGIT) {
     phaseStep = 0;
@@ -137,7 +173,7 @@ void setup()
   
   // Show Start message on tubes
   OutputManager::Instance().loadNumberArrayPOSTMessage(DIAGS_START);
-  OutputManager::Instance().outputDisplay();
+  OutputManager::Instance().outputDisplayDiags();
 
   WiFiManager wifiManager;
 
@@ -204,19 +240,19 @@ void setup()
   
   setDiagnosticLED(DIAGS_START, STATUS_GREEN);
   OutputManager::Instance().loadNumberArrayPOSTMessage(DIAGS_START);
-  OutputManager::Instance().outputDisplay();
+  OutputManager::Instance().outputDisplayDiags();
 
   // Start I2C now so that the update from NTP can be sent to the RTC immediately
   Wire.begin(4, 5); // SDA = D2 = pin 4, SCL = D1 = pin 5
   debugManager.debugMsg("I2C master started");
 
-  button1.reset();
+  // Takes the button level now, so a button held at start up
+  // counts as pressed straight away
+  button1.begin(millis());
 
   setDiagnosticLED(DIAGS_SPIFFS, STATUS_YELLOW);
   OutputManager::Instance().loadNumberArrayPOSTMessage(DIAGS_SPIFFS);
-  OutputManager::Instance().outputDisplay();
-
-  for (int i = 0; i < 25 ; i++) button1.checkButton(millis());
+  OutputManager::Instance().outputDisplayDiags();
 
   if (button1.isButtonPressedNow()) {
     setDiagnosticLED(DIAGS_SPIFFS, STATUS_BLUE);
@@ -248,6 +284,8 @@ void setup()
     ledManager.recalculateVariables();
   }
 
+  loadCustomLedEffect();
+
   // **********************************************************************
 
   // Clear down any spurious button action
@@ -309,8 +347,10 @@ void setup()
 
       setLeds();
 
+      commitFrame();
+
       // debugManager.debugMsg("Checing test mode exit condition");
-      button1.checkButton(nowMillis);
+      button1.update(nowMillis);
       if (button1.isButtonPressedNow() && (secCount == 8)) {
         inLoop = false;
         current_config.testMode = false;
@@ -335,7 +375,7 @@ void setup()
 
   setDiagnosticLED(DIAGS_WIFI, STATUS_YELLOW);
   OutputManager::Instance().loadNumberArrayPOSTMessage(DIAGS_WIFI);
-  OutputManager::Instance().outputDisplay();
+  OutputManager::Instance().outputDisplayDiags();
 
   boolean connected = false;
   connected = wifiManager.autoConnect(WiFi.hostname().c_str(), "SetMeUp!");
@@ -360,12 +400,15 @@ void setup()
   ntpAsync.getTimeFromNTP();
   setDiagnosticLED(DIAGS_NTP, STATUS_YELLOW);
   OutputManager::Instance().loadNumberArrayPOSTMessage(DIAGS_NTP);
-  OutputManager::Instance().outputDisplay();
+  OutputManager::Instance().outputDisplayDiags();
 
   long startSeachMs = millis();
   bool needUpdate = true;
   while (((millis() - startSeachMs) < 10000) && needUpdate) {
-    delay(1000);
+    delay(100);
+    ntpAsync.loop(millis());
+
+    // Starts the next burst when the last one gave nothing
     ntpAsync.getTimeFromNTP();
     if (ntpAsync.ntpTimeValid(millis()) > 0) {
       debugManager.debugMsg("Got update from NTP, exiting loop");
@@ -392,15 +435,16 @@ void setup()
   }
 
   setPIRPullup(current_config.usePIRPullup);
+  pirMonitor.begin(pirPin, millis());
 
   // initialise the internal time (in case we don't find the time provider)
   nowMillis = millis();
 
   OutputManager::Instance().loadNumberArrayPOSTMessage(DIAGS_RTC);
-  OutputManager::Instance().outputDisplay();
+  OutputManager::Instance().outputDisplayDiags();
   testRTCTimeProvider();
   if (useRTC) {
-    getRTCTime(true);
+    setTimeFromRTC();
     setDiagnosticLED(DIAGS_RTC, STATUS_GREEN);
   } else {
     setDiagnosticLED(DIAGS_RTC, STATUS_RED);
@@ -410,7 +454,8 @@ void setup()
   onceHadAnRTC = useRTC;
   
   // Set the time and set to  show the version
-  OutputManager::Instance().loadNumberArrayTime();
+  updateCalendar(&calendar, now());
+  OutputManager::Instance().loadNumberArrayTime(calendar);
   tempDisplayMode = TEMP_MODE_VERSION;
   tempDisplayModeDuration = TEMP_DISPLAY_MODE_DUR_MS;
 
@@ -419,7 +464,7 @@ void setup()
   setTubesAndLEDSblankMode();
 
   OutputManager::Instance().loadNumberArrayPOSTMessage(DIAGS_DEBUG);
-  OutputManager::Instance().outputDisplay();
+  OutputManager::Instance().outputDisplayDiags();
   
   if (debugManager.getDebug()) {
     setDiagnosticLED(DIAGS_DEBUG, STATUS_BLUE);
@@ -429,7 +474,12 @@ void setup()
 
   debugManager.debugMsg("Exit startup");
   spiffs.getStatsFromSpiffs(&current_stats);
-  ledManager.setDayOfWeek(weekday());
+  loadLdrCalibration();
+  loadOccupancy();
+  loadClockFrequency();
+  ledManager.setDayOfWeek(calendar.weekday);
+
+  setUpScheduler();
 }
 
 //**********************************************************************************
@@ -439,25 +489,165 @@ void setup()
 //**********************************************************************************
 void loop()
 {
+  nowMillis = millis();
+  scheduler.run();
+}
+
+// ************************************************************
+// Register the main loop tasks with the scheduler
+// ************************************************************
+void setUpScheduler() {
+  networkTaskId = scheduler.addTask("Network", networkTask, TASK_PERIOD_NETWORK_MS);
+  buttonTaskId = scheduler.addTask("Button", buttonTask, TASK_PERIOD_BUTTON_MS);
+  frameTaskId = scheduler.addTask("Frame", frameTask, TASK_PERIOD_FRAME_MS);
+  ldrTaskId = scheduler.addTask("LDR", ldrTask, TASK_PERIOD_LDR_MS);
+  pirTaskId = scheduler.addTask("PIR", pirTask, TASK_PERIOD_PIR_MS);
+}
+
+// ************************************************************
+// Task: web server and mDNS, as often as we can
+// ************************************************************
+void networkTask(unsigned long nowMillis) {
+  PROFILE_START(PROFILE_HTTP);
   server.handleClient();
+  PROFILE_END(PROFILE_HTTP);
+
+  if (getWebRequestCount() != lastWebRequestCount) {
+    lastWebRequestCount = getWebRequestCount();
+    inputRecorder.recordHttp(nowMillis, getLastWebRequestUri().c_str());
+    if (powerManager.isLowPower()) {
+      wakeFromLowPower(WAKE_WEB);
+    }
+  }
+
+  PROFILE_START(PROFILE_MDNS);
   mdns.update();
+  PROFILE_END(PROFILE_MDNS);
 
-  nowMillis = millis();
+  ntpAsync.loop(nowMillis);
+}
 
-  // shows us how fast the inner loop is running
-  impressionsPerSec++;
+// ************************************************************
+// Task: take the button gestures and act on the mode changes.
+// Clicks, double clicks and repeats are counted for the mode
+// processing, which takes one of each type per frame.
+// ************************************************************
+void buttonTask(unsigned long nowMillis) {
+  PROFILE_START(PROFILE_BUTTON);
+  button1.update(nowMillis, recordButtonEdge);
+
+  button_event_t event;
+  while (button1.getEvent(&event)) {
+    switch (event.type) {
+      case BUTTON_EVENT_PRESS:
+        // Wake up, but leave the click itself for the mode
+        // processing (e.g. blanking suppression)
+        if (powerManager.isLowPower()) {
+          exitLowPower(WAKE_BUTTON);
+        }
+        break;
+
+      // ******* Preview the next display mode *******
+      // What is previewed here will get actioned when
+      // the button is released
+      case BUTTON_EVENT_HOLD_1S:
+        nextMode = currentMode + 1;
+
+        if (nextMode > MODE_MAX) {
+          nextMode = MODE_MIN;
+        }
+        break;
+      case BUTTON_EVENT_HOLD_2S:
+        // Just jump back to the start
+        nextMode = MODE_MIN;
+        break;
+
+      // ******* Set the display mode *******
+      case BUTTON_EVENT_RELEASE_1S:
+        currentMode++;
+
+        if (currentMode > MODE_MAX) {
+          currentMode = MODE_MIN;
+
+          // Store the latest config if we exit the config mode
+          spiffs.saveConfigToSpiffs(&current_config);
+
+          // Preset the display
+          OutputManager::Instance().allNormal(DO_NOT_APPLY_LEAD_0_BLANK);
+        }
+
+        nextMode = currentMode;
+        break;
+      case BUTTON_EVENT_RELEASE_2S:
+        currentMode = MODE_MIN;
+
+        // Store the latest config if we exit the config mode
+        spiffs.saveConfigToSpiffs(&current_config);
+
+        // Preset the display
+        OutputManager::Instance().allNormal(DO_NOT_APPLY_LEAD_0_BLANK);
+
+        nextMode = currentMode;
+        break;
+
+      case BUTTON_EVENT_CLICK:
+      case BUTTON_EVENT_DOUBLE_CLICK:
+      case BUTTON_EVENT_REPEAT:
+        if (modeButtonEvents[event.type] < 255) {
+          modeButtonEvents[event.type]++;
+        }
+        break;
+    }
+  }
+  PROFILE_END(PROFILE_BUTTON);
+}
 
-  // -------------------------------------------------------------------------------
+void recordButtonEdge(unsigned long edgeMillis, boolean pressed) {
+  inputRecorder.recordButton(edgeMillis, pressed);
+}
+
+// ************************************************************
+// Take a click (or double click, or repeat) for the mode
+// processing, false if there wasn't one. Any more of the same
+// type wait for the next frame.
+// ************************************************************
+boolean takeButtonEvent(byte eventType) {
+  modeButtonPolled |= (1 << eventType);
+  if (modeButtonEvents[eventType] > 0) {
+    modeButtonEvents[eventType]--;
+    return true;
+  }
+  return false;
+}
+
+// ************************************************************
+// Click or repeat, for the modes that step a value. One step
+// per frame, so a burst of clicks is applied in full.
+// ************************************************************
+boolean takeButtonStep() {
+  modeButtonPolled |= (1 << BUTTON_EVENT_REPEAT);
+  return takeButtonEvent(BUTTON_EVENT_CLICK) || takeButtonEvent(BUTTON_EVENT_REPEAT);
+}
+
+// ************************************************************
+// Task: one display frame. Run the clock and the current mode,
+// prepare the tube frame (and the LEDs every LED_FRAME_DIVIDER
+// frames) and commit them together
+// ************************************************************
+void frameTask(unsigned long nowMillis) {
+  // shows us how fast the display is running
+  impressionsPerSec++;
 
-  if (lastSecond != second()) {
-    lastSecond = second();
+  if (updateCalendar(&calendar, getDisplayTime())) {
+    recordLateFlip();
+    inputRecorder.recordTime(nowMillis, calendar.time);
     lastSecMillis = nowMillis;
     secondsChanged = true;
     performOncePerSecondProcessing();
 
-    if ((second() == 0) && (!triggeredThisSec)) {
-      if ((minute() == 0)) {
-        if (hour() == 0) {
+    if ((calendar.second == 0) && (!triggeredThisSec)) {
+      if ((calendar.minute == 0)) {
+        if (calendar.hour == 0) {
           performOncePerDayProcessing();
         }
         performOncePerHourProcessing();
@@ -468,74 +658,257 @@ void loop()
     // Make sure we don't call multiple times
     triggeredThisSec = true;
 
-    if ((second() > 0) && triggeredThisSec) {
+    if ((calendar.second > 0) && triggeredThisSec) {
       triggeredThisSec = false;
     }
   }
 
-  // Check button, we evaluate below
-  button1.checkButton(nowMillis);
+  // Only publishes when the digits change
+  timeSource.update(calendar, current_config.hourMode);
+  dateSource.update(calendar, current_config.dateFormat);
 
-  // ******* Preview the next display mode *******
-  // What is previewed here will get actioned when
-  // the button is released
-  if (button1.isButtonPressed2S()) {
-    // Just jump back to the start
-    nextMode = MODE_MIN;
-  } else if (button1.isButtonPressed1S()) {
-    nextMode = currentMode + 1;
+  // ************* Process the modes *************
+  PROFILE_START(PROFILE_MODES);
+  if (nextMode != currentMode) {
+    setNextMode(nextMode);
+  } else {
+    processCurrentMode(currentMode);
+  }
 
-    if (nextMode > MODE_MAX) {
-      nextMode = MODE_MIN;
+  // Gestures the mode had no use for don't wait for the next one
+  for (byte i = 0; i < BUTTON_EVENT_COUNT; i++) {
+    if ((modeButtonPolled & (1 << i)) == 0) {
+      modeButtonEvents[i] = 0;
     }
   }
+  modeButtonPolled = 0;
+  PROFILE_END(PROFILE_MODES);
 
-  // ******* Set the display mode *******
-  if (button1.isButtonPressedReleased2S()) {
-    currentMode = MODE_MIN;
+  // Nothing to show in low power, the display interrupt is
+  // stopped and the LEDs are dark
+  if (powerManager.isLowPower()) {
+    flipArmPending = false;
+    return;
+  }
 
-    // Store the latest config if we exit the config mode
-    spiffs.saveConfigToSpiffs(&current_config);
+  PROFILE_START(PROFILE_DISPLAY);
+  OutputManager::Instance().outputDisplay();
+  PROFILE_END(PROFILE_DISPLAY);
 
-    // Preset the display
-    OutputManager::Instance().allNormal(DO_NOT_APPLY_LEAD_0_BLANK);
+  if (flipArmPending) {
+    OutputManager::Instance().armNextCommit(flipAtMicros);
+    flipArmPending = false;
+  }
+
+  ledFrameCount++;
+  if (ledFrameCount >= LED_FRAME_DIVIDER) {
+    ledFrameCount = 0;
+    PROFILE_START(PROFILE_LEDS);
+    setLeds();
+    PROFILE_END(PROFILE_LEDS);
+  }
 
-    nextMode = currentMode;
-  } else if (button1.isButtonPressedReleased1S()) {
-    currentMode++;
+  PROFILE_START(PROFILE_COMMIT);
+  commitFrame();
+  PROFILE_END(PROFILE_COMMIT);
+}
 
-    if (currentMode > MODE_MAX) {
-      currentMode = MODE_MIN;
+// ************************************************************
+// The time to show in this frame. While we follow NTP, the time
+// comes from the clock discipline to the microsecond: when the
+// next UTC second starts before the next frame is due, that
+// second is shown already, and the frame is armed for the display
+// interrupt to put up right on the boundary. TimeLib is kept in
+// step for everybody else. Without NTP it is just TimeLib.
+// ************************************************************
+time_t getDisplayTime() {
+  recordArmedFlip();
 
-      // Store the latest config if we exit the config mode
-      spiffs.saveConfigToSpiffs(&current_config);
+  if (clockDiscipline.isSet() && (clockDiscipline.getHoldoverErrorUs(micros64()) > CLOCK_HOLDOVER_MAX_US)) {
+    // Too long without NTP, back to TimeLib and the RTC
+    debugManager.debugMsg("Clock holdover ran out, back to the RTC");
+    clockDiscipline.invalidate();
+  }
 
-      // Preset the display
-      OutputManager::Instance().allNormal(DO_NOT_APPLY_LEAD_0_BLANK);
-    }
+  if (!clockDiscipline.isSet()) {
+    return now();
+  }
 
-    nextMode = currentMode;
+  displayUtcUs = clockDiscipline.getUtcUs(micros64());
+  time_t utcSecs = displayUtcUs / 1000000;
+  int64_t untilNextUs = (int64_t) (utcSecs + 1) * 1000000 - displayUtcUs;
+
+  if (untilNextUs < (TASK_PERIOD_FRAME_MS * 1000L)) {
+    utcSecs++;
+    flipArmPending = true;
+    flipAtMicros = micros() + (uint32_t) untilNextUs;
+    flipBoundaryUtcUs = (int64_t) utcSecs * 1000000;
   }
 
-  // ************* Process the modes *************
-  if (nextMode != currentMode) {
-    setNextMode(nextMode);
+  time_t localTime = utcToLocal(utcSecs);
+  if (now() != localTime) {
+    setTime(localTime);
+  }
+  return localTime;
+}
+
+// ************************************************************
+// Local time (as TimeLib holds it) for a UTC time, with the TZ
+// rules. Only worked out again when the second changes.
+// ************************************************************
+time_t utcToLocal(time_t utc) {
+  if (utc != lastUtcToLocal) {
+    struct tm tmLocal;
+    localtime_r(&utc, &tmLocal);
+
+    tmElements_t tm;
+    tm.Second = tmLocal.tm_sec;
+    tm.Minute = tmLocal.tm_min;
+    tm.Hour = tmLocal.tm_hour;
+    tm.Day = tmLocal.tm_mday;
+    tm.Month = tmLocal.tm_mon + 1;
+    tm.Year = CalendarYrToTm(tmLocal.tm_year + 1900);
+
+    lastUtcToLocal = utc;
+    lastLocalFromUtc = makeTime(tm);
+  }
+  return lastLocalFromUtc;
+}
+
+// ************************************************************
+// Phase error of the last armed flip, timed by the interrupt
+// ************************************************************
+void recordArmedFlip() {
+  if (!frameFlipped) {
+    return;
+  }
+  frameFlipped = false;
+
+  if (clockDiscipline.isSet()) {
+    int64_t flipLocalUs = (int64_t) micros64() - (uint32_t) (micros() - frameFlipMicros);
+    clockDiscipline.recordPhaseError(clockDiscipline.getUtcUs(flipLocalUs) - flipBoundaryUtcUs, true);
+  }
+}
+
+// ************************************************************
+// The second changed without a flip armed ahead (e.g. the loop
+// was held up): the digits change with this frame
+// ************************************************************
+void recordLateFlip() {
+  if (clockDiscipline.isSet() && !flipArmPending) {
+    clockDiscipline.recordPhaseError(displayUtcUs % 1000000, false);
+  }
+}
+
+// ************************************************************
+// Task: sample the LDR at a fixed rate and pass on the dimming
+// level when it steps. Everybody else uses the published ldrValue.
+// ************************************************************
+void ldrTask(unsigned long nowMillis) {
+  PROFILE_START(PROFILE_LDR);
+  if (current_config.ldrAutoCalibrate && ldrCalibration.isCalibrated()) {
+    ldrManager.setConfig(current_config.useLDR,
+                         ldrCalibration.getThreshold(current_config.minDim, COUNTS_PER_DIGIT),
+                         ldrCalibration.getSensitivity(current_config.minDim, COUNTS_PER_DIGIT),
+                         current_config.sensorSmoothCountLDR, current_config.minDim, COUNTS_PER_DIGIT);
   } else {
-    processCurrentMode(currentMode);
+    ldrManager.setConfig(current_config.useLDR, current_config.thresholdBright, current_config.sensitivityLDR,
+                         current_config.sensorSmoothCountLDR, current_config.minDim, COUNTS_PER_DIGIT);
+  }
+  ldrManager.setStepLimits(current_config.ldrHysteresis, current_config.ldrSlewMs);
+  if (current_config.useLDR) {
+    int rawLDR = readLDROversampled();
+    inputRecorder.recordLDR(nowMillis, rawLDR);
+    ldrManager.addSample(rawLDR);
+  }
+
+  // Only pass on real steps, each one rebuilds the digit buffers
+  if (ldrManager.updateDimming(nowMillis)) {
+    ldrValue = ldrManager.getDimming();
+    ledManager.setLDRValue(ldrValue);
+    OutputManager::Instance().setLDRValue(ldrValue);
   }
+  PROFILE_END(PROFILE_LDR);
+}
 
-  if (digitalRead(pirPin) == HIGH) {
-    pirConsecutiveCounts++;
+// ************************************************************
+// Task: take the PIR edges from the interrupt, evaluated once
+// per second in checkPIR()
+// ************************************************************
+void pirTask(unsigned long nowMillis) {
+  pirMonitor.process(nowMillis, recordPIREdge);
+
+  // In low power don't wait for the once per second check, or for
+  // the debounce: the first raw high edge wakes us. As in
+  // checkPIR(), a pin that has never gone low is no PIR at all
+  // (the pull up holds it high), and is not motion.
+  boolean rawRise = pirMonitor.takeRawRise();
+  if (powerManager.isLowPower() && pirMonitor.isInstalled() && (rawRise || pirMonitor.isMotion())) {
+    wakeFromLowPower(WAKE_PIR);
   }
+}
 
-  ldrValue = getDimmingFromLDR();
-  ledManager.setLDRValue(ldrValue);
-  OutputManager::Instance().setLDRValue(ldrValue);
-  OutputManager::Instance().outputDisplay();
+void recordPIREdge(unsigned long edgeMillis, boolean level) {
+  inputRecorder.recordPIR(edgeMillis, level);
+}
+
+// ************************************************************
+// Go into low power: final blank latch and stop the display
+// interrupt, push one dark LED frame, then slow everything down
+// ************************************************************
+void enterLowPower() {
+  if (!powerManager.enterLowPower(nowMillis)) {
+    return;
+  }
+  debugManager.debugMsg("Entering low power");
 
-  setLeds();
+  timer1_disable();
+  shiftOut32x2(0, 0);
+  lastOut1 = 0;
+  lastOut2 = 0;
 
-  delay(10);
+  ledManager.processLedStatus(nowMillis);
+  ledManager.commitLEDs();
+
+  scheduler.setPeriod(frameTaskId, TASK_PERIOD_FRAME_LOW_POWER_MS);
+  scheduler.suspend(ldrTaskId);
+  scheduler.setIdleSlice(LOW_POWER_IDLE_SLICE_MS);
+}
+
+// ************************************************************
+// Back to normal running, with the next frame straight away.
+// Does not change the blanking by itself.
+// ************************************************************
+void exitLowPower(byte wakeReason) {
+  if (!powerManager.isLowPower()) {
+    return;
+  }
+  powerManager.exitLowPower(nowMillis, wakeReason);
+  debugManager.debugMsg("Leaving low power: " + String(powerManager.getWakeReasonName(wakeReason)));
+
+  timer1_enable(TIM_DIV16, TIM_EDGE, TIM_SINGLE);
+  timer1_write(INT_MUX_COUNTS);
+
+  scheduler.setIdleSlice(SCHEDULER_IDLE_SLICE_MS);
+  scheduler.resume(ldrTaskId);
+  scheduler.setPeriod(frameTaskId, TASK_PERIOD_FRAME_MS);
+  scheduler.trigger(frameTaskId);
+}
+
+// ************************************************************
+// Activity while in low power: wake up and show the display
+// ************************************************************
+void wakeFromLowPower(byte wakeReason) {
+  exitLowPower(wakeReason);
+
+  if (wakeReason == WAKE_PIR) {
+    pirLastSeen = nowMillis;
+  } else if ((wakeReason == WAKE_WEB) && (blankSuppressedMillis < WAKE_WEB_BLANK_SUPPRESS_MS)) {
+    blankSuppressedMillis = WAKE_WEB_BLANK_SUPPRESS_MS;
+  }
+
+  blanked = false;
+  setTubesAndLEDSblankMode();
 }
 
 // ************************************************************
@@ -545,6 +918,10 @@ void performOncePerSecondProcessing() {
   // Store the current value and reset
   lastImpressionsPerSec = impressionsPerSec;
   impressionsPerSec = 0;
+  ledManager.updateFrameStats();
+  scheduler.updateStats();
+  powerManager.updateStats(scheduler.getLastBusyPercent());
+  flushInputRecorder(false);
 
   // If we are in temp display mode, decrement the count
   if (tempDisplayModeDuration > 0) {
@@ -598,9 +975,6 @@ void performOncePerSecondProcessing() {
     OutputManager::Instance().decValueDisplayTime();
   }
 
-  // Reset PIR debounce
-  pirConsecutiveCounts = 0;
-
   if (ntpAsync.getNextUpdate(nowMillis) < 0) {
     ntpAsync.getTimeFromNTP();
   }
@@ -624,8 +998,11 @@ void performOncePerMinuteProcessing() {
   debugManager.debugMsg("nu: " + String(ntpAsync.getNextUpdate(nowMillis)));
 
   // Set the internal time to the time from the RTC even if we are still in
-  // NTP valid time. This is more accurate than using the internal time source
-  getRTCTime(true);
+  // NTP valid time. This is more accurate than using the internal time source,
+  // but not than the clock discipline, which would lose the sub second phase
+  if (!clockDiscipline.isSet()) {
+    setTimeFromRTC();
+  }
 
   // Usage stats
   current_stats.uptimeMins++;
@@ -634,6 +1011,17 @@ void performOncePerMinuteProcessing() {
     current_stats.tubeOnTimeMins++;
   }
 
+  // Learn when the room is normally occupied
+  if (pirInstalled) {
+    occupancyManager.addMinute((nowMillis - pirMonitor.getLastMotionMillis(nowMillis)) < 60000, calendar.weekday, calendar.hour);
+  }
+
+  // Learn the light levels at this site. Not in low power: the
+  // LDR task is suspended, and the reading is stale.
+  if (current_config.useLDR && (ldrManager.getSampleCount() > 0) && !powerManager.isLowPower()) {
+    ldrCalibration.addMinute(ldrManager.getReading(), calendar.hour);
+  }
+
   // RTC - light up only if we have lost our RTC
   if (onceHadAnRTC && !useRTC) {
     // debugManager.debugMsg("lost access to RTC");
@@ -654,6 +1042,23 @@ void performOncePerMinuteProcessing() {
 void performOncePerHourProcessing() {
   debugManager.debugMsg("---> OncePerHourProcessing");
   reconnectDroppedConnection();
+
+  if (current_config.useLDR && ((calendar.hour % LDR_CAL_SAVE_HOURS) == 0)) {
+    saveLdrCalibration();
+  }
+
+  if (pirInstalled && ((calendar.hour % OCCUPANCY_SAVE_HOURS) == 0)) {
+    saveOccupancy();
+  }
+
+  if (clockDiscipline.isSet()) {
+    // Keep the RTC in step, it is what we fall back to
+    setRTCTime();
+
+    if ((clockDiscipline.getFrequencyMeasurements() > 0) && ((calendar.hour % CLOCK_FREQ_SAVE_HOURS) == 0)) {
+      saveClockFrequency();
+    }
+  }
 }
 
 // ************************************************************
@@ -662,7 +1067,7 @@ void performOncePerHourProcessing() {
 void performOncePerDayProcessing() {
   debugManager.debugMsg("---> OncePerDayProcessing");
   spiffs.saveStatsToSpiffs(&current_stats);
-  ledManager.setDayOfWeek(weekday());
+  ledManager.setDayOfWeek(calendar.weekday);
 }
 
 // ************************************************************
@@ -759,7 +1164,39 @@ void setLeds()
 
   // output the backlight/underlight LEDs
   ledManager.setPulseValue(secsDelta);  
-  ledManager.processLedStatus();
+  ledManager.processLedStatus(nowMillis);
+}
+
+// ************************************************************
+// The single commit point for each frame: the tube frame and the
+// LED colours prepared in this pass go out together
+// ************************************************************
+void commitFrame() {
+  OutputManager::Instance().commitDisplayBuffers();
+  ledManager.commitLEDs();
+}
+
+// ************************************************************
+// Write the recorded input events out to the log, when there
+// are enough of them or they have been waiting a while
+// ************************************************************
+void flushInputRecorder(boolean force) {
+  if (inputRecorder.getPendingLength() == 0) {
+    return;
+  }
+
+  if (!force && !inputRecorder.needsFlush() && ((nowMillis - lastRecorderFlushMillis) < RECORDER_FLUSH_INTERVAL_MS)) {
+    return;
+  }
+
+  size_t logSize = spiffs.appendRecorderLog(inputRecorder.getPending(), inputRecorder.getPendingLength());
+  inputRecorder.clearPending();
+  lastRecorderFlushMillis = nowMillis;
+
+  if (logSize >= RECORDER_MAX_LOG_BYTES) {
+    inputRecorder.stop();
+    debugManager.debugMsg("Input recorder log full, recording stopped");
+  }
 }
 
 // ************************************************************
@@ -770,17 +1207,34 @@ void setLeds()
 // the sensor over configured blanking.
 // Returns true if PIR sensor is installed and we are blanked
 //
-// To deal with noise, we use a counter to detect a number of
-// consecutive counts before counting the PIR as "detected"
+// The noise is dealt with by the debounce in the PIR monitor,
+// the motion times come from the edge interrupt
 // ************************************************************
 boolean checkPIR(unsigned long nowMillis) {
-  if (pirConsecutiveCounts > (lastImpressionsPerSec / 2)) {
-    pirLastSeen = nowMillis;
+  if (!pirMonitor.isInstalled()) {
     return false;
   } else {
     if (!pirInstalled) debugManager.debugMsg("Marking PIR as installed");
     pirInstalled = true;
-    if (nowMillis > (pirLastSeen + (current_config.pirTimeout * 1000))) {
+
+    unsigned long lastMotionMillis = pirMonitor.getLastMotionMillis(nowMillis);
+    if ((long) (lastMotionMillis - pirLastSeen) > 0) {
+      pirLastSeen = lastMotionMillis;
+    }
+
+    // Someone normally turns up soon: have the display ready
+    if (current_config.useOccupancy && occupancyManager.isPreWake(calendar.weekday, calendar.hour, calendar.minute)) {
+      pirStatus = true;
+      return false;
+    }
+
+    // Nobody is normally here now: don't wait so long
+    unsigned long pirTimeoutMillis = current_config.pirTimeout * 1000UL;
+    if (current_config.useOccupancy && occupancyManager.isPredictedEmpty(calendar.weekday, calendar.hour)) {
+      pirTimeoutMillis = max(PIR_TIMEOUT_MIN, current_config.pirTimeout / PIR_EMPTY_TIMEOUT_DIVIDER) * 1000UL;
+    }
+
+    if ((long) (nowMillis - pirLastSeen) > (long) pirTimeoutMillis) {
       pirStatus = false;
       return true;
     } else {
@@ -808,7 +1262,7 @@ void setNextMode(int displayMode) {
 
   switch (displayMode) {
     case MODE_TIME: {
-        OutputManager::Instance().loadNumberArrayTime();
+        OutputManager::Instance().loadNumberArrayTime(calendar);
         OutputManager::Instance().allNormal(APPLY_LEAD_0_BLANK);
         break;
       }
@@ -817,32 +1271,32 @@ void setNextMode(int displayMode) {
           // skip past the time and date settings
           setNewNextMode(MODE_12_24);
         }
-        OutputManager::Instance().loadNumberArrayTime();
+        OutputManager::Instance().loadNumberArrayTime(calendar);
         OutputManager::Instance().highlight0and1();
         break;
       }
     case MODE_MINS_SET: {
-        OutputManager::Instance().loadNumberArrayTime();
+        OutputManager::Instance().loadNumberArrayTime(calendar);
         OutputManager::Instance().highlight2and3();
         break;
       }
     case MODE_SECS_SET: {
-        OutputManager::Instance().loadNumberArrayTime();
+        OutputManager::Instance().loadNumberArrayTime(calendar);
         OutputManager::Instance().highlight4and5();
         break;
       }
     case MODE_DAYS_SET: {
-        OutputManager::Instance().loadNumberArrayDate();
+        OutputManager::Instance().loadNumberArrayDate(calendar);
         OutputManager::Instance().highlightDaysDateFormat();
         break;
       }
     case MODE_MONTHS_SET: {
-        OutputManager::Instance().loadNumberArrayDate();
+        OutputManager::Instance().loadNumberArrayDate(calendar);
         OutputManager::Instance().highlightMonthsDateFormat();
         break;
       }
     case MODE_YEARS_SET: {
-        OutputManager::Instance().loadNumberArrayDate();
+        OutputManager::Instance().loadNumberArrayDate(calendar);
         OutputManager::Instance().highlightYearsDateFormat();
         break;
       }
@@ -915,7 +1369,7 @@ void setNextMode(int displayMode) {
         break;
       }
     case MODE_RED_CNL: {
-        if ((current_config.backlightMode == BACKLIGHT_CYCLE) || (current_config.backlightMode == BACKLIGHT_COLOUR_TIME) || (current_config.backlightMode == BACKLIGHT_DAY_OF_WEEK)) {
+        if (current_config.backlightMode != BACKLIGHT_FIXED) {
           setNewNextMode(MODE_CYCLE_SPEED);
         }
         OutputManager::Instance().loadNumberArrayConfInt(current_config.redCnl, displayMode);
@@ -933,8 +1387,8 @@ void setNextMode(int displayMode) {
         break;
       }
     case MODE_CYCLE_SPEED: {
-        if (current_config.backlightMode != BACKLIGHT_CYCLE) {
-          // Show only if we are in cycle mode
+        if ((current_config.backlightMode != BACKLIGHT_CYCLE) && (current_config.backlightMode != BACKLIGHT_EFFECT) && (current_config.backlightMode != BACKLIGHT_CUSTOM)) {
+          // Show only if we are in cycle or effect mode
           setNewNextMode(MODE_MIN_DIM_UP);
         }
         OutputManager::Instance().loadNumberArrayConfInt(current_config.cycleSpeed, displayMode);
@@ -958,7 +1412,7 @@ void setNextMode(int displayMode) {
         break;
       }
     case MODE_TUBE_TEST: {
-        OutputManager::Instance().loadNumberArrayTestDigits();
+        OutputManager::Instance().loadNumberArrayTestDigits(calendar);
         OutputManager::Instance().allNormal(DO_NOT_APPLY_LEAD_0_BLANK);
         break;
       }
@@ -973,7 +1427,11 @@ void processCurrentMode(int displayMode) {
 
   switch (displayMode) {
     case MODE_TIME: {
-        if (button1.isButtonPressedAndReleased()) {
+        if (takeButtonEvent(BUTTON_EVENT_DOUBLE_CLICK) && !blanked && (nowMillis >= blankSuppressedSelectionTimoutMillis)) {
+          // Straight to the IP address
+          tempDisplayMode = TEMP_IP_ADDR12;
+          tempDisplayModeDuration = TEMP_DISPLAY_MODE_DUR_MS;
+        } else if (takeButtonEvent(BUTTON_EVENT_CLICK)) {
           // Deal with blanking first
           if ((nowMillis < blankSuppressedSelectionTimoutMillis) || blanked) {
             if (blankSuppressedSelectionTimoutMillis == 0) {
@@ -1015,22 +1473,28 @@ void processCurrentMode(int displayMode) {
         if (tempDisplayModeDuration > 0) {
           blanked = false;
           setTubesAndLEDSblankMode();
+
+          // Only reload the digits (and formats) when they change
+          boolean loaded = false;
           if (tempDisplayMode == TEMP_MODE_DATE) {
-            OutputManager::Instance().loadNumberArrayDate();
+            loaded = OutputManager::Instance().loadFromSource(&dateSource);
           }
 
           if (tempDisplayMode == TEMP_MODE_LDR) {
-            OutputManager::Instance().loadNumberArrayLDR();
+            ldrSource.update(1023 - ldrValue, 0);
+            loaded = OutputManager::Instance().loadFromSource(&ldrSource);
           }
 
           if (tempDisplayMode == TEMP_MODE_VERSION) {
-            OutputManager::Instance().loadNumberArrayConfInt(SOFTWARE_VERSION, 0);
+            versionSource.update(SOFTWARE_VERSION, 0);
+            loaded = OutputManager::Instance().loadFromSource(&versionSource);
           }
 
           if (tempDisplayMode == TEMP_IP_ADDR12) {
             if (getIsConnected()) {
               IPAddress myIP = WiFi.localIP();
-              OutputManager::Instance().loadNumberArrayIP(myIP[0], myIP[1]);
+              ipSource.update(myIP[0], myIP[1]);
+              loaded = OutputManager::Instance().loadFromSource(&ipSource);
             } else {
               // we can't show the IP address if we have the RTC, just skip
               tempDisplayMode++;
@@ -1040,7 +1504,8 @@ void processCurrentMode(int displayMode) {
           if (tempDisplayMode == TEMP_IP_ADDR34) {
             if (getIsConnected()) {
               IPAddress myIP = WiFi.localIP();
-              OutputManager::Instance().loadNumberArrayIP(myIP[2], myIP[3]);
+              ipSource.update(myIP[2], myIP[3]);
+              loaded = OutputManager::Instance().loadFromSource(&ipSource);
             } else {
               // we can't show the IP address if we have the RTC, just skip
               tempDisplayMode++;
@@ -1053,6 +1518,7 @@ void processCurrentMode(int displayMode) {
               shortHostName.toLowerCase();
               //debugManager.debugMsg("ESPID: " + shortHostName);
               OutputManager::Instance().loadNumberArrayESPID(shortHostName);
+              loaded = true;
             } else {
               // we can't show the IP address if we have the RTC, just skip
               tempDisplayMode++;
@@ -1060,10 +1526,13 @@ void processCurrentMode(int displayMode) {
           }
 
           if (tempDisplayMode == TEMP_IMPR) {
-            OutputManager::Instance().loadNumberArrayConfInt(lastImpressionsPerSec, 0);
+            impressionsSource.update(lastImpressionsPerSec, 0);
+            loaded = OutputManager::Instance().loadFromSource(&impressionsSource);
           }
 
-          OutputManager::Instance().allNormal(DO_NOT_APPLY_LEAD_0_BLANK);
+          if (loaded) {
+            OutputManager::Instance().allNormal(DO_NOT_APPLY_LEAD_0_BLANK);
+          }
 
         } else {
           if (current_config.slotsMode > SLOTS_MODE_MIN) {
@@ -1086,91 +1555,95 @@ void processCurrentMode(int displayMode) {
             }
 
             // Initialise the slots transition values and start it
-            if (second() == 50 && !msgDisplaying) {
+            if (calendar.second == 50 && !msgDisplaying) {
               activeTransition->start(nowMillis);
             }
 
             // Continue slots transition
             msgDisplaying = activeTransition->runEffect(nowMillis, current_config.blankLeading);
             if (msgDisplaying) {
-              activeTransition->updateRegularDisplaySeconds(second());
+              activeTransition->updateRegularDisplaySeconds(calendar.second);
             }
             else {
               // no slots mode, check if we are in valueDisplayMode
             if (OutputManager::Instance().getValueDisplayTime() > 0) {
-                OutputManager::Instance().loadNumberArrayValueToShow();
-                OutputManager::Instance().loadDisplaySetValueType();
+                if (OutputManager::Instance().loadNumberArrayValueToShow()) {
+                  OutputManager::Instance().loadDisplaySetValueType();
+                }
               } else {
                 // Do normal time thing when we are not in slots
-                OutputManager::Instance().loadNumberArrayTime();
-                OutputManager::Instance().allNormal(APPLY_LEAD_0_BLANK);
+                if (OutputManager::Instance().loadFromSource(&timeSource)) {
+                  OutputManager::Instance().allNormal(APPLY_LEAD_0_BLANK);
+                }
               }
             }
           }
           else {
             // no slots mode, check if we are in valueDisplayMode
             if (OutputManager::Instance().getValueDisplayTime() > 0) {
-              OutputManager::Instance().loadNumberArrayValueToShow();
-              OutputManager::Instance().loadDisplaySetValueType();
+              if (OutputManager::Instance().loadNumberArrayValueToShow()) {
+                OutputManager::Instance().loadDisplaySetValueType();
+              }
             } else {
               // no slots mode, just do normal time thing
-              OutputManager::Instance().loadNumberArrayTime();
-              OutputManager::Instance().allNormal(APPLY_LEAD_0_BLANK);
+              if (OutputManager::Instance().loadFromSource(&timeSource)) {
+                OutputManager::Instance().allNormal(APPLY_LEAD_0_BLANK);
+              }
             }
           }
         }
         break;
       }
     case MODE_MINS_SET: {
-        if (button1.isButtonPressedAndReleased()) {
+        if (takeButtonStep()) {
           incMins();
         }
-        OutputManager::Instance().loadNumberArrayTime();
+        OutputManager::Instance().loadNumberArrayTime(calendar);
         OutputManager::Instance().highlight2and3();
         break;
       }
     case MODE_HOURS_SET: {
-        if (button1.isButtonPressedAndReleased()) {
+        if (takeButtonStep()) {
           incHours();
         }
-        OutputManager::Instance().loadNumberArrayTime();
+        OutputManager::Instance().loadNumberArrayTime(calendar);
         OutputManager::Instance().highlight0and1();
         break;
       }
     case MODE_SECS_SET: {
-        if (button1.isButtonPressedAndReleased()) {
+        if (takeButtonEvent(BUTTON_EVENT_CLICK)) {
           resetSecond();
         }
-        OutputManager::Instance().loadNumberArrayTime();
+        OutputManager::Instance().loadNumberArrayTime(calendar);
         OutputManager::Instance().highlight4and5();
         break;
       }
     case MODE_DAYS_SET: {
-        if (button1.isButtonPressedAndReleased()) {
+        if (takeButtonStep()) {
           incDays();
         }
-        OutputManager::Instance().loadNumberArrayDate();
+        OutputManager::Instance().loadNumberArrayDate(calendar);
         OutputManager::Instance().highlightDaysDateFormat();
         break;
       }
     case MODE_MONTHS_SET: {
-        if (button1.isButtonPressedAndReleased()) {
+        if (takeButtonStep()) {
           incMonths();
         }
-        OutputManager::Instance().loadNumberArrayDate();
+        OutputManager::Instance().loadNumberArrayDate(calendar);
         OutputManager::Instance().highlightMonthsDateFormat();
         break;
       }
     case MODE_YEARS_SET: {
-        if (button1.isButtonPressedAndReleased()) {
+        if (takeButtonStep()) {
           incYears();
         }
-        OutputManager::Instance().loadNumberArrayDate();
+        OutputManager::Instance().loadNumberArrayDate(calendar);
         OutputManager::Instance().highlightYearsDateFormat();
         break;
       }
     case MODE_12_24: {
-        if (button1.isButtonPressedAndReleased()) {
+        if (takeButtonEvent(BUTTON_EVENT_CLICK)) {
           current_config.hourMode = ! current_config.hourMode;
         }
         OutputManager::Instance().loadNumberArrayConfBool(current_config.hourMode, displayMode);
@@ -1178,7 +1651,7 @@ void processCurrentMode(int displayMode) {
         break;
       }
     case MODE_LEAD_BLANK: {
-        if (button1.isButtonPressedAndReleased()) {
+        if (takeButtonEvent(BUTTON_EVENT_CLICK)) {
           current_config.blankLeading = !current_config.blankLeading;
         }
         OutputManager::Instance().loadNumberArrayConfBool(current_config.blankLeading, displayMode);
@@ -1186,7 +1659,7 @@ void processCurrentMode(int displayMode) {
         break;
       }
     case MODE_DATE_FORMAT: {
-        if (button1.isButtonPressedAndReleased()) {
+        if (takeButtonEvent(BUTTON_EVENT_CLICK)) {
           current_config.dateFormat++;
           if (current_config.dateFormat > DATE_FORMAT_MAX) {
             current_config.dateFormat = DATE_FORMAT_MIN;
@@ -1197,7 +1670,7 @@ void processCurrentMode(int displayMode) {
         break;
       }
     case MODE_DAY_BLANKING: {
-        if (button1.isButtonPressedAndReleased()) {
+        if (takeButtonEvent(BUTTON_EVENT_CLICK)) {
           current_config.dayBlanking++;
           if (current_config.dayBlanking > DAY_BLANKING_MAX) {
             current_config.dayBlanking = DAY_BLANKING_MIN;
@@ -1208,7 +1681,7 @@ void processCurrentMode(int displayMode) {
         break;
       }
     case MODE_HR_BLNK_START: {
-        if (button1.isButtonPressedAndReleased()) {
+        if (takeButtonStep()) {
           current_config.blankHourStart++;
           if (current_config.blankHourStart > HOURS_MAX) {
             current_config.blankHourStart = 0;
@@ -1219,7 +1692,7 @@ void processCurrentMode(int displayMode) {
         break;
       }
     case MODE_HR_BLNK_END: {
-        if (button1.isButtonPressedAndReleased()) {
+        if (takeButtonStep()) {
           current_config.blankHourEnd++;
           if (current_config.blankHourEnd > HOURS_MAX) {
             current_config.blankHourEnd = 0;
@@ -1230,7 +1703,7 @@ void processCurrentMode(int displayMode) {
         break;
       }
     case MODE_BLANK_MODE: {
-        if (button1.isButtonPressedAndReleased()) {
+        if (takeButtonEvent(BUTTON_EVENT_CLICK)) {
           current_config.blankMode++;
           if (current_config.blankMode > BLANK_MODE_MAX) {
             current_config.blankMode = BLANK_MODE_MIN;
@@ -1241,7 +1714,7 @@ void processCurrentMode(int displayMode) {
         break;
       }
     case MODE_USE_LDR: {
-        if (button1.isButtonPressedAndReleased()) {
+        if (takeButtonEvent(BUTTON_EVENT_CLICK)) {
           current_config.useLDR = !current_config.useLDR;
         }
         OutputManager::Instance().loadNumberArrayConfBool(current_config.useLDR, displayMode);
@@ -1249,7 +1722,7 @@ void processCurrentMode(int displayMode) {
         break;
       }
     case MODE_SLOTS_MODE: {
-        if (button1.isButtonPressedAndReleased()) {
+        if (takeButtonEvent(BUTTON_EVENT_CLICK)) {
           current_config.slotsMode++;
           if (current_config.slotsMode > SLOTS_MODE_MAX) {
             current_config.slotsMode = SLOTS_MODE_MIN;
@@ -1260,7 +1733,7 @@ void processCurrentMode(int displayMode) {
         break;
       }
     case MODE_LED_BLINK: {
-        if (button1.isButtonPressedAndReleased()) {
+        if (takeButtonEvent(BUTTON_EVENT_CLICK)) {
           current_config.ledMode++;
           if (current_config.ledMode > LED_MODE_MAX) {
             current_config.ledMode = LED_MODE_MIN;
@@ -1271,7 +1744,7 @@ void processCurrentMode(int displayMode) {
         break;
       }
     case MODE_PIR_TIMEOUT_UP: {
-        if (button1.isButtonPressedAndReleased()) {
+        if (takeButtonStep()) {
           current_config.pirTimeout += 10;
           if (current_config.pirTimeout > PIR_TIMEOUT_MAX) {
             current_config.pirTimeout = PIR_TIMEOUT_MIN;
@@ -1282,7 +1755,7 @@ void processCurrentMode(int displayMode) {
         break;
       }
     case MODE_PIR_TIMEOUT_DOWN: {
-        if (button1.isButtonPressedAndReleased()) {
+        if (takeButtonStep()) {
           current_config.pirTimeout -= 10;
           if (current_config.pirTimeout < PIR_TIMEOUT_MIN) {
             current_config.pirTimeout = PIR_TIMEOUT_MAX;
@@ -1293,7 +1766,7 @@ void processCurrentMode(int displayMode) {
         break;
       }
     case MODE_BACKLIGHT_MODE: {
-        if (button1.isButtonPressedAndReleased()) {
+        if (takeButtonEvent(BUTTON_EVENT_CLICK)) {
           current_config.backlightMode++;
           if (current_config.backlightMode > BACKLIGHT_MAX) {
             current_config.backlightMode = BACKLIGHT_MIN;
@@ -1304,7 +1777,7 @@ void processCurrentMode(int displayMode) {
         break;
       }
     case MODE_RED_CNL: {
-        if (button1.isButtonPressedAndReleased()) {
+        if (takeButtonStep()) {
           current_config.redCnl++;
           if (current_config.redCnl > COLOUR_CNL_MAX) {
             current_config.redCnl = COLOUR_CNL_MIN;
@@ -1315,7 +1788,7 @@ void processCurrentMode(int displayMode) {
         break;
       }
     case MODE_GRN_CNL: {
-        if (button1.isButtonPressedAndReleased()) {
+        if (takeButtonStep()) {
           current_config.grnCnl++;
           if (current_config.grnCnl > COLOUR_CNL_MAX) {
             current_config.grnCnl = COLOUR_CNL_MIN;
@@ -1326,7 +1799,7 @@ void processCurrentMode(int displayMode) {
         break;
       }
     case MODE_BLU_CNL: {
-        if (button1.isButtonPressedAndReleased()) {
+        if (takeButtonStep()) {
           current_config.bluCnl++;
           if (current_config.bluCnl > COLOUR_CNL_MAX) {
             current_config.bluCnl = COLOUR_CNL_MIN;
@@ -1337,7 +1810,7 @@ void processCurrentMode(int displayMode) {
         break;
       }
     case MODE_CYCLE_SPEED: {
-        if (button1.isButtonPressedAndReleased()) {
+        if (takeButtonStep()) {
           current_config.cycleSpeed = current_config.cycleSpeed + 2;
           if (current_config.cycleSpeed > CYCLE_SPEED_MAX) {
             current_config.cycleSpeed = CYCLE_SPEED_MIN;
@@ -1348,7 +1821,7 @@ void processCurrentMode(int displayMode) {
         break;
       }
     case MODE_MIN_DIM_UP: {
-        if (button1.isButtonPressedAndReleased()) {
+        if (takeButtonStep()) {
           current_config.minDim += 10;
           if (current_config.minDim > MIN_DIM_MAX) {
             current_config.minDim = MIN_DIM_MAX;
@@ -1359,7 +1832,7 @@ void processCurrentMode(int displayMode) {
         break;
       }
     case MODE_MIN_DIM_DOWN: {
-        if (button1.isButtonPressedAndReleased()) {
+        if (takeButtonStep()) {
           current_config.minDim -= 10;
           if (current_config.minDim < MIN_DIM_MIN) {
             current_config.minDim = MIN_DIM_MIN;
@@ -1370,7 +1843,7 @@ void processCurrentMode(int displayMode) {
         break;
       }
     case MODE_USE_PIR_PULLUP: {
-        if (button1.isButtonPressedAndReleased()) {
+        if (takeButtonEvent(BUTTON_EVENT_CLICK)) {
           current_config.usePIRPullup = !current_config.usePIRPullup;
         }
         OutputManager::Instance().loadNumberArrayConfBool(current_config.usePIRPullup, displayMode);
@@ -1385,7 +1858,7 @@ void processCurrentMode(int displayMode) {
       }
     case MODE_TUBE_TEST: {
         OutputManager::Instance().allNormal(DO_NOT_APPLY_LEAD_0_BLANK);
-        OutputManager::Instance().loadNumberArrayTestDigits();
+        OutputManager::Instance().loadNumberArrayTestDigits(calendar);
         break;
       }
   }
@@ -1397,13 +1870,22 @@ void processCurrentMode(int displayMode) {
 //**********************************************************************************
 //**********************************************************************************
 
+// ************************************************************
+// Time set from the buttons: stop following NTP (until the next
+// sync) and keep the RTC in step
+// ************************************************************
+void setTimeByHand(int hr, int mins, int secs, int dy, int mnth, int yr) {
+  clockDiscipline.invalidate();
+  setTime(hr, mins, secs, dy, mnth, yr);
+  setRTCTime();
+}
+
 // ************************************************************
 // Reset the seconds to 00
 // ************************************************************
 void resetSecond() {
   byte tmpSecs = 0;
-  setTime(hour(), minute(), tmpSecs, day(), month(), year());
-  setRTCTime();
+  setTimeByHand(hour(), minute(), tmpSecs, day(), month(), year());
 }
 
 // ************************************************************
@@ -1415,8 +1897,7 @@ void incSecond() {
   if (tmpSecs >= SECS_MAX) {
     tmpSecs = 0;
   }
-  setTime(hour(), minute(), tmpSecs, day(), month(), year());
-  setRTCTime();
+  setTimeByHand(hour(), minute(), tmpSecs, day(), month(), year());
 }
 
 // ************************************************************
@@ -1428,8 +1909,7 @@ void incMins() {
   if (tmpMins >= MINS_MAX) {
     tmpMins = 0;
   }
-  setTime(hour(), tmpMins, 0, day(), month(), year());
-  setRTCTime();
+  setTimeByHand(hour(), tmpMins, 0, day(), month(), year());
 }
 
 // ************************************************************
@@ -1442,8 +1922,7 @@ void incHours() {
   if (tmpHours >= HOURS_MAX) {
     tmpHours = 0;
   }
-  setTime(tmpHours, minute(), second(), day(), month(), year());
-  setRTCTime();
+  setTimeByHand(tmpHours, minute(), second(), day(), month(), year());
 }
 
 // ************************************************************
@@ -1479,8 +1958,7 @@ void incDays() {
   if (tmpDays > maxDays) {
     tmpDays = 1;
   }
-  setTime(hour(), minute(), second(), tmpDays, month(), year());
-  setRTCTime();
+  setTimeByHand(hour(), minute(), second(), tmpDays, month(), year());
 }
 
 // ************************************************************
@@ -1493,8 +1971,7 @@ void incMonths() {
   if (tmpMonths > 12) {
     tmpMonths = 1;
   }
-  setTime(hour(), minute(), second(), day(), tmpMonths, year());
-  setRTCTime();
+  setTimeByHand(hour(), minute(), second(), day(), tmpMonths, year());
 }
 
 // ************************************************************
@@ -1507,18 +1984,17 @@ void incYears() {
   if (tmpYears > 50) {
     tmpYears = 15;
   }
-  setTime(hour(), minute(), second(), day(), month(), 2000 + tmpYears);
-  setRTCTime();
+  setTimeByHand(hour(), minute(), second(), day(), month(), 2000 + tmpYears);
 }
 
 // ************************************************************
-// Set the time from the value we get back from the timer server
+// Set the time from the UTC time we get back from the time server
 // ************************************************************
-void setTimeFromServer(String timeString) {
-  int intValues[6];
-  grabInts(timeString, &intValues[0], ",");
-  setTime(intValues[SYNC_HOURS], intValues[SYNC_MINS], intValues[SYNC_SECS], intValues[SYNC_DAY], intValues[SYNC_MONTH], intValues[SYNC_YEAR]);
-  debugManager.debugMsg("Set internal time to NTP time: " + String(year()) + ":" + String(month()) + ":" + String(day()) + " " + String(hour()) + ":" + String(minute()) + ":" + String(second()));
+void setTimeFromServer(time_t utcSecs) {
+  setTime(utcToLocal(utcSecs));
+  if (debugManager.getDebug()) {
+    debugManager.debugMsg("Set internal time to NTP time: " + String(year()) + ":" + String(month()) + ":" + String(day()) + " " + String(hour()) + ":" + String(minute()) + ":" + String(second()));
+  }
 }
 
 // ************************************************************
@@ -1572,17 +2048,17 @@ boolean checkBlanking() {
       case DAY_BLANKING_HOURS:
         return getHoursBlanked();
       case DAY_BLANKING_WEEKEND:
-        return ((weekday() == 1) || (weekday() == 7));
+        return calendar.weekend;
       case DAY_BLANKING_WEEKEND_OR_HOURS:
-        return ((weekday() == 1) || (weekday() == 7)) || getHoursBlanked();
+        return calendar.weekend || getHoursBlanked();
       case DAY_BLANKING_WEEKEND_AND_HOURS:
-        return ((weekday() == 1) || (weekday() == 7)) && getHoursBlanked();
+        return calendar.weekend && getHoursBlanked();
       case DAY_BLANKING_WEEKDAY:
-        return ((weekday() > 1) && (weekday() < 7));
+        return !calendar.weekend;
       case DAY_BLANKING_WEEKDAY_OR_HOURS:
-        return ((weekday() > 1) && (weekday() < 7)) || getHoursBlanked();
+        return !calendar.weekend || getHoursBlanked();
       case DAY_BLANKING_WEEKDAY_AND_HOURS:
-        return ((weekday() > 1) && (weekday() < 7)) && getHoursBlanked();
+        return !calendar.weekend && getHoursBlanked();
       case DAY_BLANKING_ALWAYS:
         return true;
     }
@@ -1608,10 +2084,10 @@ String getPIRStateDisplay() {
 boolean getHoursBlanked() {
   if (current_config.blankHourStart > current_config.blankHourEnd) {
     // blanking before midnight
-    return ((hour() >= current_config.blankHourStart) || (hour() < current_config.blankHourEnd));
+    return ((calendar.hour >= current_config.blankHourStart) || (calendar.hour < current_config.blankHourEnd));
   } else if (current_config.blankHourStart < current_config.blankHourEnd) {
     // dim at or after midnight
-    return ((hour() >= current_config.blankHourStart) && (hour() < current_config.blankHourEnd));
+    return ((calendar.hour >= current_config.blankHourStart) && (calendar.hour < current_config.blankHourEnd));
   } else {
     // no dimming if Start = End
     return false;
@@ -1650,6 +2126,13 @@ void setTubesAndLEDSblankMode() {
   }
 
   ledManager.setBlanked(blankLEDs);
+
+  // Everything dark: go into low power
+  if (blankTubes && blankLEDs) {
+    enterLowPower();
+  } else {
+    exitLowPower(WAKE_SCHEDULE);
+  }
 }
 
 // ************************************************************
@@ -1675,11 +2158,12 @@ void setNewNextMode(int newNextMode) {
 
 // ************************************************************
 // Callback: When the NTP component tells us there is an update
-// go and get it
 // ************************************************************
-void newTimeUpdateReceived() {
-  debugManager.debugMsg("Got a new time update");
-  setTimeFromServer(ntpAsync.getLastTimeFromServer());
+void newTimeUpdateReceived(const ntp_time_t *ntpTime) {
+  int64_t utcUs = (int64_t) ntpTime->utcSecs * 1000000 + ntpTime->utcMicros;
+  clockDiscipline.addSync(ntpTime->localUs, utcUs - ntpTime->localUs, ntpAsync.getJitterUs());
+  ntpAsync.reportCorrection(clockDiscipline.getLastStepUs(), !clockDiscipline.wasLastStepSlewed());
+  setTimeFromServer(ntpTime->utcSecs);
   setRTCTime();
 }
 
@@ -1698,29 +2182,28 @@ void setDiagnosticLED(byte stepNumber, byte state) {
 //**********************************************************************************
 
 // ************************************************************
-// Get the time from the RTC
+// Get the time from the RTC, formatted for display
 // ************************************************************
-String getRTCTime(boolean setInternalTime) {
+String getRTCTime() {
   testRTCTimeProvider();
   if (useRTC) {
     Clock.getTime();
-    int years = Clock.year + 2000;
-    byte months = Clock.month;
-    byte days = Clock.dayOfMonth;
-    byte hours = Clock.hour;
-    byte mins = Clock.minute;
-    byte secs = Clock.second;
-
-    String returnValue = String(years) + ":" + String(months) + ":" + String(days) + " " + String(hours) + ":" + String(mins) + ":" + String(secs);
-    debugManager.debugMsg("Got RTC time: " + returnValue);
-
-    if (setInternalTime) {
-      // Set the internal time provider to the value we got
-      setTime(hours, mins, secs, days, months, years);
-      debugManager.debugMsg("Set Internal time to: " + returnValue);
-    }
+    return String(Clock.year + 2000) + ":" + String(Clock.month) + ":" + String(Clock.dayOfMonth) + " " + String(Clock.hour) + ":" + String(Clock.minute) + ":" + String(Clock.second);
+  }
+  return "";
+}
 
-    return returnValue;
+// ************************************************************
+// Set the internal time from the RTC
+// ************************************************************
+void setTimeFromRTC() {
+  testRTCTimeProvider();
+  if (useRTC) {
+    Clock.getTime();
+    setTime(Clock.hour, Clock.minute, Clock.second, Clock.dayOfMonth, Clock.month, Clock.year + 2000);
+    if (debugManager.getDebug()) {
+      debugManager.debugMsg("Set Internal time to RTC time: " + String(year()) + ":" + String(month()) + ":" + String(day()) + " " + String(hour()) + ":" + String(minute()) + ":" + String(second()));
+    }
   }
 }
 
@@ -1746,7 +2229,9 @@ void setRTCTime() {
     Clock.fillByHMS(hour(), minute(), second());
     Clock.setTime();
 
-    debugManager.debugMsg("Set RTC time to internal time: " + String(year()) + ":" + String(month()) + ":" + String(day()) + " " + String(hour()) + ":" + String(minute()) + ":" + String(second()));
+    if (debugManager.getDebug()) {
+      debugManager.debugMsg("Set RTC time to internal time: " + String(year()) + ":" + String(month()) + ":" + String(day()) + " " + String(hour()) + ":" + String(minute()) + ":" + String(second()));
+    }
   }
 }
 
@@ -1757,41 +2242,70 @@ void setRTCTime() {
 //**********************************************************************************
 
 // ******************************************************************
-// Check the ambient light through the LDR (Light Dependent Resistor)
-// Smooths the reading over a number of reads.
+// Read the LDR (Light Dependent Resistor) for the LDR task.
 //
 // The LDR in bright light gives reading of around 50, the reading in
-// total darkness is around 900.
-//
-// The return value is the dimming count we are using. 999 is full
-// brightness, 100 is very dim.
-//
-// Because the floating point calculation may return more than the
-// maximum value, we have to clamp it as the final step
+// total darkness is around 900. Several conversions are averaged to
+// take out the ADC noise, the filtering and the conversion to the
+// dimming count is done by the LDR manager.
 // ******************************************************************
-int getDimmingFromLDR() {
-  if (current_config.useLDR) {
-    int rawLDR = analogRead(LDRPin);
-    int rawSensorVal = 1023 - rawLDR;
+int readLDROversampled() {
+  int total = 0;
+  for (int i = 0 ; i < LDR_OVERSAMPLE ; i++) {
+    total += analogRead(LDRPin);
+  }
+  return total / LDR_OVERSAMPLE;
+}
+
+// ******************************************************************
+// The learnt light levels survive a restart
+// ******************************************************************
+void loadLdrCalibration() {
+  ldr_cal_data_t calData;
+  if (spiffs.getLearntDataFromSpiffs(LDR_CAL_FILE, (uint8_t*) &calData, sizeof(calData))) {
+    if (!ldrCalibration.setData(&calData)) {
+      debugManager.debugMsg("LDR calibration is from another version, starting again");
+    }
+  }
+}
 
-    double sensorDiff = rawSensorVal - sensorLDRSmoothed;
-    sensorLDRSmoothed += (sensorDiff / (double)current_config.sensorSmoothCountLDR);
+// ******************************************************************
+// The learnt occupancy survives a restart
+// ******************************************************************
+void loadOccupancy() {
+  occupancy_data_t occupancyData;
+  if (spiffs.getLearntDataFromSpiffs(OCCUPANCY_FILE, (uint8_t*) &occupancyData, sizeof(occupancyData))) {
+    if (!occupancyManager.setData(&occupancyData)) {
+      debugManager.debugMsg("Occupancy is from another version, starting again");
+    }
+  }
+}
 
-    // Scaling offset increases the base brightness
-    // factor increases the sensitivity
-    double offset = current_config.thresholdBright;
-    double factor = current_config.sensitivityLDR / 5.0;
+void saveOccupancy() {
+  spiffs.saveLearntDataToSpiffs(OCCUPANCY_FILE, (const uint8_t*) occupancyManager.getData(), sizeof(occupancy_data_t));
+}
 
-    int returnValue = (sensorLDRSmoothed + offset) / factor;
+void saveLdrCalibration() {
+  spiffs.saveLearntDataToSpiffs(LDR_CAL_FILE, (const uint8_t*) ldrCalibration.getData(), sizeof(ldr_cal_data_t));
+}
 
-    if (returnValue < current_config.minDim) returnValue = current_config.minDim;
-    if (returnValue > COUNTS_PER_DIGIT) returnValue = COUNTS_PER_DIGIT;
-    return returnValue;
-  } else {
-    return COUNTS_PER_DIGIT;
+// ******************************************************************
+// The learnt crystal frequency survives a restart, so the clock
+// keeps good time between the first NTP syncs
+// ******************************************************************
+void loadClockFrequency() {
+  clock_freq_data_t freqData;
+  if (spiffs.getLearntDataFromSpiffs(CLOCK_FREQ_FILE, (uint8_t*) &freqData, sizeof(freqData))) {
+    if (!clockDiscipline.setData(&freqData)) {
+      debugManager.debugMsg("Clock frequency is from another version, starting again");
+    }
   }
 }
 
+void saveClockFrequency() {
+  spiffs.saveLearntDataToSpiffs(CLOCK_FREQ_FILE, (const uint8_t*) clockDiscipline.getData(), sizeof(clock_freq_data_t));
+}
+
 // ************************************************************
 // Reset configuration values back to what they once were
 // ************************************************************
@@ -1811,6 +2325,10 @@ void factoryReset() {
   cc->sensorSmoothCountLDR = SENSOR_SMOOTH_READINGS_DEFAULT;
   cc->sensitivityLDR = SENSOR_SENSIT_DEFAULT;
   cc->minDim = MIN_DIM_DEFAULT;
+  cc->ldrHysteresis = LDR_HYSTERESIS_DEFAULT;
+  cc->ldrSlewMs = LDR_SLEW_MS_DEFAULT;
+  cc->ldrAutoCalibrate = LDR_AUTO_CALIBRATE_DEFAULT;
+  cc->useOccupancy = USE_OCCUPANCY_DEFAULT;
 
   cc->dateFormat = DATE_FORMAT_DEFAULT;
   cc->dayBlanking = DAY_BLANKING_DEFAULT;
@@ -1823,6 +2341,8 @@ void factoryReset() {
   cc->blankHourStart = 0;
   cc->blankHourEnd = 7;
   cc->cycleSpeed = CYCLE_SPEED_DEFAULT;
+  cc->ledEffect = LED_EFFECT_DEFAULT;
+  cc->ledPalette = LED_PALETTE_DEFAULT;
   cc->pirTimeout = PIR_TIMEOUT_DEFAULT;
   cc->useLDR = USE_LDR_DEFAULT;
   cc->blankMode = BLANK_MODE_DEFAULT;
@@ -1848,6 +2368,19 @@ void factoryReset() {
   spiffs.saveConfigToSpiffs(cc);
 }
 
+// ************************************************************
+// Load the uploaded back light effect, if there is one
+// ************************************************************
+void loadCustomLedEffect() {
+  String source;
+  if (spiffs.getLedEffectFromSpiffs(source)) {
+    String error;
+    if (!ledManager.loadCustomEffect(source, error)) {
+      debugManager.debugMsg("Could not load LED effect: " + error);
+    }
+  }
+}
+
 // ************************************************************
 // Conditionally trigger the save (don't write if we don't have
 // any changes - that just wears out the flash)
@@ -1887,6 +2420,30 @@ void rootPageHandler() {
     response_message += getTableRow2Col("WLAN MAC", WiFi.macAddress());
     response_message += getTableRow2Col("WLAN SSID", WiFi.SSID());
     response_message += getTableRow2Col("NTP Pool", ntpAsync.getNtpPool());
+    response_message += getTableRow2Col("NTP Servers", ntpAsync.getServerAddresses());
+    response_message += getTableRow2Col("DNS lookups (failed)", String(ntpAsync.getDnsLookups()) + " (" + String(ntpAsync.getDnsFailures()) + ")");
+    response_message += getTableRow2Col("NTP packets (sent / received / rejected / timed out)", String(ntpAsync.getPacketsSent()) + " / " + String(ntpAsync.getPacketsReceived()) + " / " + String(ntpAsync.getPacketsRejected()) + " / " + String(ntpAsync.getPacketsTimedOut()));
+    response_message += getTableRow2Col("NTP bursts (failed / outliers)", String(ntpAsync.getBursts()) + " (" + String(ntpAsync.getFailedBursts()) + " / " + String(ntpAsync.getOutliers()) + ")");
+    if (clockDiscipline.isSet()) {
+      response_message += getTableRow2Col("Second phase error (last / average / max)", formatMicros(clockDiscipline.getLastPhaseErrorUs()) + " / " + formatMicros(clockDiscipline.getAveragePhaseErrorUs()) + " / " + formatMicros(clockDiscipline.getMaxPhaseErrorUs()));
+      response_message += getTableRow2Col("Second flips (on time / late)", String(clockDiscipline.getArmedFlips()) + " / " + String(clockDiscipline.getLateFlips()));
+      response_message += getTableRow2Col("Last NTP correction", formatMicros(clockDiscipline.getLastStepUs()) + (clockDiscipline.wasLastStepSlewed() ? " (slewed)" : " (stepped)"));
+      response_message += getTableRow2Col("Holdover error estimate", formatMicros(clockDiscipline.getHoldoverErrorUs(micros64())));
+    }
+    if (clockDiscipline.getFrequencyMeasurements() > 0) {
+      response_message += getTableRow2Col("Crystal frequency error (uncertainty)", String(clockDiscipline.getFrequencyPpb() / 1000.0, 3) + " ppm (" + String(clockDiscipline.getFrequencyErrorPpb() / 1000.0, 3) + " ppm)");
+    } else {
+      response_message += getTableRow2Col("Crystal frequency error (uncertainty)", "Learning");
+    }
+    response_message += getTableRow2Col("NTP jitter / delay", formatMicros(ntpAsync.getJitterUs()) + " / " + formatMicros(ntpAsync.getDelayUs()));
+    ntp_server_stats_t serverStats;
+    for (byte i = 0 ; ntpAsync.isOffsetValid() && ntpAsync.getServerStats(i, &serverStats) ; i++) {
+      String serverState = serverStats.selected ? "selected" : ((serverStats.distanceUs == 0) ? "no reply" : "rejected");
+      // Each server against the combined offset
+      String serverInfo = "offset " + formatMicros(serverStats.offsetUs - ntpAsync.getOffsetUs()) + ", delay " + formatMicros(serverStats.delayUs);
+      serverInfo += ", jitter " + formatMicros(serverStats.jitterUs) + ", stratum " + String(serverStats.stratum) + ", reach " + String(serverStats.reach, BIN) + ", " + serverState;
+      response_message += getTableRow2Col("NTP server " + IPAddress(serverStats.id).toString(), serverInfo);
+    }
     response_message += getTableRow2Col("TZ", ntpAsync.getTZS());
     response_message += getTableRow2Col("Last NTP time", ntpAsync.getLastTimeFromServer());
     String clockUrl = "http://" + WiFi.hostname() + ".local";
@@ -1913,6 +2470,7 @@ void rootPageHandler() {
     absNextUpdate = -absNextUpdate;
   }
   response_message += getTableRow2Col("Time before next update", secsToReadableString(absNextUpdate) + overdueInd);
+  response_message += getTableRow2Col("Update interval (retries)", secsToReadableString(ntpAsync.getPollInterval()) + " (" + String(ntpAsync.getPollRetries()) + ")");
 
   response_message += getTableRow2Col("Version", SOFTWARE_VERSION);
 
@@ -1930,7 +2488,7 @@ void rootPageHandler() {
   response_message += getTableFoot();
 
   // ******************** Clock Info table ***************************
-  float digitBrightness = getDimmingFromLDR() * 100.0 / (float) COUNTS_PER_DIGIT;
+  float digitBrightness = ldrValue * 100.0 / (float) COUNTS_PER_DIGIT;
   String motionSensorState = checkPIRInstalled() ? getPIRStateDisplay() : "Not installed";
   String rtcState = useRTC ? "Installed" : "Not installed";
   String timeSource;
@@ -1946,20 +2504,45 @@ void rootPageHandler() {
   response_message += getTableHead2Col("Clock information", "Name", "Value");
 
   if (current_config.useLDR) {
-    response_message += getTableRow2Col("LDR Value", sensorLDRSmoothed);
+    response_message += getTableRow2Col("LDR Value", ldrManager.getReading());
   } else {
     response_message += getTableRow2Col("LDR Value", "LDR disabled");
   }
 
   response_message += getTableRow2Col("Digit brightness %", String(digitBrightness, 2));
+  response_message += getTableRow2Col("Brightness changes", String(ldrManager.getDimmingChanges()));
+  if (ldrCalibration.isCalibrated()) {
+    response_message += getTableRow2Col("LDR calibration (dark / bright)", String(ldrCalibration.getDarkReading()) + " / " + String(ldrCalibration.getBrightReading()));
+  } else {
+    response_message += getTableRow2Col("LDR calibration", "Learning, " + String(ldrCalibration.getMinutes() / 60) + " of " + String(LDR_CAL_MIN_MINUTES / 60) + " hours");
+  }
   response_message += getTableRow2Col("Motion Sensor", motionSensorState);
+  if (checkPIRInstalled()) {
+    if (occupancyManager.isLearnt()) {
+      response_message += getTableRow2Col("Occupancy this hour %", occupancyManager.getPercent(calendar.weekday, calendar.hour));
+    } else {
+      response_message += getTableRow2Col("Occupancy", "Learning, " + String(occupancyManager.getHours()) + " of " + String(OCCUPANCY_MIN_HOURS) + " hours");
+    }
+    response_message += getTableRow2Col("Motion events (edges / dropped)", String(pirMonitor.getMotionCount()) + " (" + String(pirMonitor.getEdgeCount()) + " / " + String(pirMonitor.getDroppedEdges()) + ")");
+  }
+  response_message += getTableRow2Col("Button dropped (edges / events)", String(button1.getDroppedEdges()) + " / " + String(button1.getDroppedEvents()));
   response_message += getTableRow2Col("Time Source", timeSource);
   response_message += getTableRow2Col("Display Time", currentTime);
   response_message += getTableRow2Col("Real Time Clock", rtcState);
   if (useRTC) {
-    response_message += getTableRow2Col("RTC Time", getRTCTime(false));
+    response_message += getTableRow2Col("RTC Time", getRTCTime());
   }
   response_message += getTableRow2Col("Impressions/Sec", lastImpressionsPerSec);
+  response_message += getTableRow2Col("LED Frames/Sec", ledManager.getLastFramesPerSec());
+  response_message += getTableRow2Col("Loop busy %", scheduler.getLastBusyPercent());
+  for (byte i = 0 ; i < scheduler.getTaskCount() ; i++) {
+    response_message += getTableRow2Col("Task overruns: " + String(scheduler.getTaskName(i)), String(scheduler.getTaskOverruns(i)));
+  }
+  response_message += getTableRow2Col("Low power", powerManager.isLowPower() ? "Yes" : "No");
+  response_message += getTableRow2Col("Time in low power %", powerManager.getLowPowerTimePercent());
+  response_message += getTableRow2Col("Loop busy % (normal / low power)", String(powerManager.getNormalBusyPercent()) + " / " + String(powerManager.getLowPowerBusyPercent()));
+  response_message += getTableRow2Col("Low power entries", String(powerManager.getEntries()));
+  response_message += getTableRow2Col("Last wake", powerManager.getWakeReasonName(powerManager.getLastWakeReason()));
   response_message += getTableRow2Col("Total Clock On Hrs", secsToReadableString(current_stats.uptimeMins * 60));
   response_message += getTableRow2Col("Total Tube On Hrs", secsToReadableString(current_stats.tubeOnTimeMins * 60));
   response_message += getTableFoot();
@@ -2014,7 +2597,7 @@ void timeServerPageHandler() {
 
   debugManager.debugMsg("ntpPool is: " + ntpAsync.getNtpPool());
   response_message += getTextInputWide("NTP Pool", "ntppool", ntpAsync.getNtpPool(), false);
-  response_message += getNumberInput("Update interval:", "ntpupdate", NTP_UPDATE_INTERVAL_MIN, NTP_UPDATE_INTERVAL_MAX, ntpAsync.getUpdateInterval(), false);
+  response_message += getNumberInput("Max update interval:", "ntpupdate", NTP_UPDATE_INTERVAL_MIN, NTP_UPDATE_INTERVAL_MAX, ntpAsync.getUpdateInterval(), false);
   response_message += getTextInputWide("Time Zone String", "tzs", ntpAsync.getTZS(), false);
 
   response_message += getSubmitButton("Set");
@@ -2080,9 +2663,13 @@ void clockConfigPageHandler() {
   checkServerArgInt("minDim", "minDim", changed, current_config.minDim);
   checkServerArgInt("thresholdBright", "thresholdBright", changed, current_config.thresholdBright);
   checkServerArgInt("sensitivityLDR", "sensitivityLDR", changed, current_config.sensitivityLDR);
+  checkServerArgInt("ldrHysteresis", "ldrHysteresis", changed, current_config.ldrHysteresis);
+  checkServerArgInt("ldrSlewMs", "ldrSlewMs", changed, current_config.ldrSlewMs);
+  checkServerArgBoolean("ldrAutoCalibrate", "LDR auto calibrate", "on", "off", changed, current_config.ldrAutoCalibrate);
   // -----------------------------------------------------------------------------
 #ifdef FEATURE_PIR
   checkServerArgInt("pirTimeout", "pirTimeout", changed, current_config.pirTimeout);
+  checkServerArgBoolean("useOccupancy", "Use occupancy", "on", "off", changed, current_config.useOccupancy);
   checkServerArgBoolean("usePIRPullup", "Use PIR pullup", "on", "off", changed, current_config.usePIRPullup);
 #endif
   checkServerArgByte("dayBlanking", "dayBlanking", changed, current_config.dayBlanking);
@@ -2092,6 +2679,8 @@ void clockConfigPageHandler() {
   // -----------------------------------------------------------------------------
   checkServerArgByte("backlightMode", "backlightMode", changed, current_config.backlightMode);
   checkServerArgByte("cycleSpeed", "cycleSpeed", changed, current_config.cycleSpeed);
+  checkServerArgByte("ledEffect", "ledEffect", changed, current_config.ledEffect);
+  checkServerArgByte("ledPalette", "ledPalette", changed, current_config.ledPalette);
   checkServerArgBoolean("useBLPulse", "Use BL pulse", "on", "off", changed, current_config.useBLPulse);
   checkServerArgBoolean("useBLDim", "Use BL dim", "on", "off", changed, current_config.useBLDim);
   // -----------------------------------------------------------------------------
@@ -2127,6 +2716,8 @@ void clockConfigPageHandler() {
   saveToSpiffsIfChanged(changed);
   
   ledManager.recalculateVariables();
+  // The LDR only publishes brightness steps, pick up a changed backlight dim setting now
+  ledManager.setLDRValue(ldrValue);
 
   // -----------------------------------------------------------------------------
   String response_message = getHTMLHead(getIsConnected());
@@ -2232,6 +2823,24 @@ void clockConfigPageHandler() {
   }
   response_message += getRadioGroupFooter();
 
+  // Learn the threshold and sensitivity
+  response_message += getRadioGroupHeader("Auto calibrate:");
+  if (current_config.ldrAutoCalibrate) {
+    response_message += getRadioButton("ldrAutoCalibrate", "On", "on", true);
+    response_message += getRadioButton("ldrAutoCalibrate", "Off", "off", false);
+  } else {
+    response_message += getRadioButton("ldrAutoCalibrate", "On", "on", false);
+    response_message += getRadioButton("ldrAutoCalibrate", "Off", "off", true);
+  }
+  response_message += getRadioGroupFooter();
+  if (current_config.ldrAutoCalibrate) {
+    if (ldrCalibration.isCalibrated()) {
+      response_message += getExplanationText("Calibrated - the learnt light levels replace the threshold and sensitivity");
+    } else {
+      response_message += getExplanationText("Still learning the light levels - using the threshold and sensitivity");
+    }
+  }
+
   // Min dim
   response_message += getNumberInput("Min Dim:", "minDim", MIN_DIM_MIN, MIN_DIM_MAX, current_config.minDim, false);
 
@@ -2241,6 +2850,10 @@ void clockConfigPageHandler() {
   // LDR Sensitivity
   response_message += getNumberInput("LDR Sensitivity:", "sensitivityLDR", SENSOR_SENSIT_MIN, SENSOR_SENSIT_MAX, current_config.sensitivityLDR, false);
 
+  // Brightness step hysteresis and slew
+  response_message += getNumberInput("LDR Hysteresis:", "ldrHysteresis", LDR_HYSTERESIS_MIN, LDR_HYSTERESIS_MAX, current_config.ldrHysteresis, false);
+  response_message += getNumberInput("Brightness step time (mS):", "ldrSlewMs", LDR_SLEW_MS_MIN, LDR_SLEW_MS_MAX, current_config.ldrSlewMs, false);
+
   response_message += getSubmitButton("Set");
 
   response_message += getFormFoot();
@@ -2268,6 +2881,24 @@ void clockConfigPageHandler() {
     response_message += getRadioButton("usePIRPullup", "Off", "off", true);
   }
   response_message += getRadioGroupFooter();
+
+  // Learnt occupancy
+  response_message += getRadioGroupHeader("Learn when the room is used:");
+  if (current_config.useOccupancy) {
+    response_message += getRadioButton("useOccupancy", "On", "on", true);
+    response_message += getRadioButton("useOccupancy", "Off", "off", false);
+  } else {
+    response_message += getRadioButton("useOccupancy", "On", "on", false);
+    response_message += getRadioButton("useOccupancy", "Off", "off", true);
+  }
+  response_message += getRadioGroupFooter();
+  if (pirInstalled) {
+    if (occupancyManager.isLearnt()) {
+      response_message += getExplanationText("Wakes before the room is normally used, and blanks sooner when it is normally empty");
+    } else {
+      response_message += getExplanationText("Still learning when the room is used");
+    }
+  }
 #endif
 
   // Day blanking
@@ -2311,12 +2942,29 @@ void clockConfigPageHandler() {
   response_message += getDropDownOption("1", "Cycling RGB backlight", (current_config.backlightMode == 1));
   response_message += getDropDownOption("2", "'Colourtime' backlight", (current_config.backlightMode == 2));
   response_message += getDropDownOption("3", "'Day of week' backlight", (current_config.backlightMode == 3));
+  response_message += getDropDownOption("4", "Effect backlight", (current_config.backlightMode == 4));
+  response_message += getDropDownOption("5", "Uploaded effect backlight", (current_config.backlightMode == 5));
   response_message += getDropDownFooter();
 
   // Cycle speed
-  boolean activeCycle = (current_config.backlightMode == 1);
+  boolean activeCycle = (current_config.backlightMode == 1) || (current_config.backlightMode == 4) || (current_config.backlightMode == 5);
   response_message += getNumberInput("Backlight Cycle Speed:", "cycleSpeed", CYCLE_SPEED_MIN, CYCLE_SPEED_MAX, current_config.cycleSpeed, !activeCycle);
 
+  // Effect and palette, from the effect engine registry
+  boolean activeEffect = (current_config.backlightMode == 4);
+  response_message += getDropDownHeader("Effect:", "ledEffect", true, !activeEffect);
+  for (byte i = 0 ; i < LED_EFFECT_COUNT ; i++) {
+    response_message += getDropDownOption(String(i), LED_EFFECTS[i].name, (current_config.ledEffect == i));
+  }
+  response_message += getDropDownFooter();
+
+  boolean activePalette = activeEffect || (current_config.backlightMode == 5);
+  response_message += getDropDownHeader("Palette:", "ledPalette", true, !activePalette);
+  for (byte i = 0 ; i < LED_PALETTE_COUNT ; i++) {
+    response_message += getDropDownOption(String(i), LED_PALETTES[i].name, (current_config.ledPalette == i));
+  }
+  response_message += getDropDownFooter();
+
   // Dim backlights
   response_message += getRadioGroupHeader("Dim backlights:");
   if (current_config.useBLDim) {
@@ -2489,6 +3137,225 @@ void setDisplayValuePageHandler() {
   server.send(200, "text/html", response_message);
 }
 
+// ************************************************************
+// Upload a back light effect, either from the form or as the
+// raw body of a POST (see tools/ledvm)
+// ************************************************************
+void ledEffectPageHandler() {
+  debugManager.debugMsg("LED effect page in");
+
+  String source;
+  boolean uploaded = false;
+  if (server.hasArg("source")) {
+    source = server.arg("source");
+    uploaded = true;
+  } else if (server.hasArg("plain")) {
+    source = server.arg("plain");
+    uploaded = true;
+  }
+
+  String error;
+  boolean loaded = false;
+  if (uploaded) {
+    loaded = ledManager.loadCustomEffect(source, error);
+    if (loaded) {
+      spiffs.saveLedEffectToSpiffs(source);
+    }
+  } else {
+    spiffs.getLedEffectFromSpiffs(source);
+  }
+
+  String response_message = getHTMLHead(getIsConnected());
+  response_message += getNavBar();
+
+  if (uploaded) {
+    response_message += "<div class=\"container\" role=\"main\">";
+    if (loaded) {
+      response_message += "<div class=\"alert alert-success fade in\"><strong>Effect loaded and saved</strong></div>";
+    } else {
+      // The error quotes the uploaded source
+      error.replace("&", "&amp;");
+      error.replace("<", "&lt;");
+      response_message += "<div class=\"alert alert-error fade in\"><strong>Effect not loaded: " + error + "</strong></div>";
+    }
+    response_message += "</div>";
+  }
+
+  LedEffectVM &vm = ledManager.getCustomEffect();
+  response_message += getTableHead2Col("Uploaded Effect", "Name", "Value");
+  response_message += getTableRow2Col("Loaded", vm.isLoaded() ? "Yes" : "No");
+  response_message += getTableRow2Col("Code bytes", vm.getCodeLength());
+  response_message += getTableRow2Col("Instructions last frame", String(vm.getLastFrameInstructions()) + " of " + String(LEDVM_FRAME_BUDGET));
+  response_message += getTableRow2Col("Instructions max frame", String(vm.getMaxFrameInstructions()) + " of " + String(LEDVM_FRAME_BUDGET));
+  response_message += getTableRow2Col("Budget overruns", String(vm.getOverruns()));
+  response_message += getTableRow2Col("Faults", String(vm.getFaults()));
+  response_message += getTableFoot();
+
+  source.replace("&", "&amp;");
+  source.replace("<", "&lt;");
+
+  response_message += "<div class=\"container\" role=\"main\"><h3 class=\"sub-header\">Effect source</h3>";
+  response_message += "<form class=\"form-horizontal\" method=\"post\">";
+  response_message += "<div class=\"form-group\"><div class=\"col-xs-12\"><textarea class=\"form-control\" style=\"height:300px;font-family:monospace\" name=\"source\">";
+  response_message += source;
+  response_message += "</textarea></div></div>";
+  response_message += getSubmitButton("Upload");
+  response_message += getFormFoot();
+
+  response_message += getHTMLFoot();
+  server.send(200, "text/html", response_message);
+
+  debugManager.debugMsg("LED effect page out");
+}
+
+#ifdef FEATURE_PROFILER
+// ************************************************************
+// Loop stage timings over the last PROFILER_WINDOW runs
+// ************************************************************
+void profilePageHandler() {
+  debugManager.debugMsg("Profile page in");
+
+  if (server.hasArg("reset")) {
+    profiler.reset();
+  }
+
+  uint32_t cyclesPerMicro = ESP.getCpuFreqMHz();
+
+  String response_message = getHTMLHead(getIsConnected());
+  response_message += getNavBar();
+
+  response_message += getTableHead2Col("Loop Profile (uS)", "Stage", "min / avg / max / p99 (samples)");
+  for (byte stage = 0 ; stage < PROFILE_STAGE_COUNT ; stage++) {
+    profile_stats_t stats;
+    profiler.getStats(stage, &stats);
+
+    String values = String(stats.min / cyclesPerMicro) + " / ";
+    values += String(stats.avg / cyclesPerMicro) + " / ";
+    values += String(stats.max / cyclesPerMicro) + " / ";
+    values += String(stats.p99 / cyclesPerMicro);
+    values += " (" + String(stats.samples) + " of " + String(profiler.getTotalSamples(stage)) + ")";
+    response_message += getTableRow2Col(profiler.getStageName(stage), values);
+  }
+  response_message += getTableRow2Col("Loop busy %", scheduler.getLastBusyPercent());
+  response_message += getTableFoot();
+
+  response_message += "<div class=\"container\" role=\"main\"><a href=\"/profile?reset\">Reset the samples</a></div>";
+
+  response_message += getHTMLFoot();
+  server.send(200, "text/html", response_message);
+
+  debugManager.debugMsg("Profile page out");
+}
+#endif
+
+// ************************************************************
+// Input recorder control
+// ************************************************************
+void recorderPageHandler() {
+  debugManager.debugMsg("Recorder page in");
+
+  if (server.hasArg("action")) {
+    String action = server.arg("action");
+    if (action == "start") {
+      inputRecorder.start(nowMillis);
+      debugManager.debugMsg("Input recorder started");
+    } else if (action == "stop") {
+      inputRecorder.stop();
+      flushInputRecorder(true);
+      debugManager.debugMsg("Input recorder stopped");
+    } else if (action == "clear") {
+      inputRecorder.clearPending();
+      spiffs.clearRecorderLog();
+      if (inputRecorder.isRecording()) {
+        // Start a fresh log section so it can be replayed on its own
+        inputRecorder.start(nowMillis);
+      }
+    }
+  }
+
+  String response_message = getHTMLHead(getIsConnected());
+  response_message += getNavBar();
+
+  response_message += getTableHead2Col("Input Recorder", "Name", "Value");
+  response_message += getTableRow2Col("Recording", inputRecorder.isRecording() ? "Yes" : "No");
+  response_message += getTableRow2Col("Events recorded", String(inputRecorder.getEventCount()));
+  response_message += getTableRow2Col("Events dropped", String(inputRecorder.getDroppedEvents()));
+  response_message += getTableRow2Col("Bytes waiting", String(inputRecorder.getPendingLength()));
+  response_message += getTableRow2Col("Log size", String(spiffs.getRecorderLogSize()) + " of " + String(RECORDER_MAX_LOG_BYTES));
+  response_message += getTableFoot();
+
+  response_message += "<div class=\"container\" role=\"main\"><ul>";
+  response_message += "<li><a href=\"/recorder?action=start\">Start recording</a></li>";
+  response_message += "<li><a href=\"/recorder?action=stop\">Stop recording</a></li>";
+  response_message += "<li><a href=\"/recorder?action=clear\">Clear the log</a></li>";
+  response_message += "<li><a href=\"/inputs.rec\">Download the log</a> (replay with tools/inputreplay)</li>";
+  response_message += "</ul></div>";
+
+  response_message += getHTMLFoot();
+  server.send(200, "text/html", response_message);
+
+  debugManager.debugMsg("Recorder page out");
+}
+
+// ************************************************************
+// Download the input recorder log
+// ************************************************************
+void recorderLogHandler() {
+  flushInputRecorder(true);
+
+  if (SPIFFS.begin()) {
+    File logFile = SPIFFS.open(RECORDER_LOG_FILE, "r");
+    if (logFile) {
+      server.streamFile(logFile, "application/octet-stream");
+      logFile.close();
+    } else {
+      server.send(404, "text/plain", "No log");
+    }
+  } else {
+    server.send(500, "text/plain", "Failed to mount FS");
+  }
+  SPIFFS.end();
+}
+
+// ************************************************************
+// The learnt LDR light levels as JSON, "reset" starts again
+// ************************************************************
+void ldrCalibrationJsonHandler() {
+  if (server.hasArg("reset")) {
+    ldrCalibration.reset();
+    saveLdrCalibration();
+    debugManager.debugMsg("LDR calibration reset");
+  }
+
+  DynamicJsonBuffer jsonBuffer;
+  JsonObject& json = jsonBuffer.createObject();
+  json["autoCalibrate"] = current_config.ldrAutoCalibrate;
+  json["calibrated"] = ldrCalibration.isCalibrated();
+  json["minutes"] = ldrCalibration.getMinutes();
+  json["reading"] = ldrManager.getReading();
+  if (ldrCalibration.isCalibrated()) {
+    json["dark"] = ldrCalibration.getDarkReading();
+    json["bright"] = ldrCalibration.getBrightReading();
+    json["threshold"] = ldrCalibration.getThreshold(current_config.minDim, COUNTS_PER_DIGIT);
+    json["sensitivity"] = ldrCalibration.getSensitivity(current_config.minDim, COUNTS_PER_DIGIT);
+  }
+
+  JsonArray& histogram = json.createNestedArray("histogram");
+  for (byte i = 0 ; i < LDR_CAL_BINS ; i++) {
+    histogram.add(ldrCalibration.getBin(i));
+  }
+
+  // -1 for hours we have not seen yet
+  JsonArray& hourly = json.createNestedArray("hourly");
+  for (byte i = 0 ; i < LDR_CAL_HOURS ; i++) {
+    hourly.add(ldrCalibration.getHourlyReading(i));
+  }
+
+  String response;
+  json.printTo(response);
+  server.send(200, "application/json", response);
+}
+
 // ************************************************************
 // Access to utility functions
 // ************************************************************
@@ -2508,6 +3375,12 @@ void utilityPageHandler()
   response_message += "<hr><li><a href=\"/reset\">Restart module</a></li>";
   response_message += "<hr><li><a href=\"/update\">Update firmware</a></li>";
   response_message += "<hr><li><a href=\"/ntpupdate\">Force update from NTP now</a></li>";
+  response_message += "<hr><li><a href=\"/ledeffect\">Upload a back light effect</a></li>";
+  response_message += "<hr><li><a href=\"/recorder\">Record the inputs for replay</a></li>";
+  response_message += "<hr><li><a href=\"/ldrcal.json\">Learnt LDR light levels</a> (<a href=\"/ldrcal.json?reset\">start learning again</a>)</li>";
+#ifdef FEATURE_PROFILER
+  response_message += "<hr><li><a href=\"/profile\">Main loop profile</a></li>";
+#endif
   response_message += "<hr><li><a href=\"/factoryreset\">Perform factory reset without resetting Wifi configuration</a></li>";
   response_message += "</ul>";
 
@@ -2630,7 +3503,7 @@ void configModeCallback(WiFiManager *myWiFiManager) {
   debugManager.debugMsg("*** Entered config mode");
   setDiagnosticLED(DIAGS_WIFI, STATUS_BLUE);
   OutputManager::Instance().loadNumberArrayPOSTMessage(AP_MODE);
-  OutputManager::Instance().outputDisplay();
+  OutputManager::Instance().outputDisplayDiags();
 }
 
 // ************************************************************
@@ -2651,6 +3524,8 @@ void reconnectDroppedConnection() {
 // set up the server page handlers
 // ************************************************************
 void setServerPageHandlers() {
+  setUpWebActivityTracking();
+
   server.on("/", rootPageHandler);
 
   server.on("/time", []() {
@@ -2709,6 +3584,43 @@ void setServerPageHandlers() {
     return utilityPageHandler();
   });
 
+  server.on("/ledeffect", []() {
+    if (getWebAuthentication() && (!server.authenticate(getWebUserName().c_str(), getWebPassword().c_str()))) {
+      return server.requestAuthentication();
+    }
+    return ledEffectPageHandler();
+  });
+
+  server.on("/recorder", []() {
+    if (getWebAuthentication() && (!server.authenticate(getWebUserName().c_str(), getWebPassword().c_str()))) {
+      return server.requestAuthentication();
+    }
+    return recorderPageHandler();
+  });
+
+  server.on("/inputs.rec", []() {
+    if (getWebAuthentication() && (!server.authenticate(getWebUserName().c_str(), getWebPassword().c_str()))) {
+      return server.requestAuthentication();
+    }
+    return recorderLogHandler();
+  });
+
+  server.on("/ldrcal.json", []() {
+    if (getWebAuthentication() && (!server.authenticate(getWebUserName().c_str(), getWebPassword().c_str()))) {
+      return server.requestAuthentication();
+    }
+    return ldrCalibrationJsonHandler();
+  });
+
+#ifdef FEATURE_PROFILER
+  server.on("/profile", []() {
+    if (getWebAuthentication() && (!server.authenticate(getWebUserName().c_str(), getWebPassword().c_str()))) {
+      return server.requestAuthentication();
+    }
+    return profilePageHandler();
+  });
+#endif
+
   server.on("/debug", []() {
     if (getWebAuthentication() && (!server.authenticate(getWebUserName().c_str(), getWebPassword().c_str()))) {
       return server.requestAuthentication();
@@ -7,6 +7,9 @@
 #include "DA2000-Transition.h"
 #include "ESP_DS1307.h"
 #include "ClockButton.h"
+#include "Calendar.h"
+#include "DisplaySources.h"
+#include "InputRecorder.h"
 
 // ----------------------- Components ----------------------------
 
@@ -24,11 +27,30 @@ OutputManager outputManager;
 unsigned long nowMillis = 0;
 unsigned long lastCheckMillis = 0;
 unsigned long lastSecMillis = nowMillis;
-unsigned long lastSecond = second();  
+calendar_t calendar;               // snapshot of the current time, updated once per second tick
+
+// ------------------ Display sources ------------------
+
+TimeSource timeSource;
+DateSource dateSource;
+ReadingSource ldrSource;
+ReadingSource versionSource;
+ReadingSource impressionsSource;
+IPSource ipSource;
 boolean secondsChanged = false;
 
+// Seconds aligned to UTC, see getDisplayTime()
+int64_t displayUtcUs = 0;
+boolean flipArmPending = false;
+uint32_t flipAtMicros = 0;
+int64_t flipBoundaryUtcUs = 0;
+time_t lastUtcToLocal = 0;
+time_t lastLocalFromUtc = 0;
+
 byte currentMode = MODE_TIME;   // Initial cold start mode
 byte nextMode = currentMode;
+byte modeButtonEvents[BUTTON_EVENT_COUNT];  // count per button event type, for the mode processing
+unsigned int modeButtonPolled = 0;     // bit per event type the mode looked at this frame
 boolean triggeredThisSec = false;
 
 unsigned int tempDisplayModeDuration;      // time for the end of the temporary display
@@ -43,6 +65,24 @@ uint32_t prevDigit1, prevDigit2;
 int impressionsPerSec = 0;
 int lastImpressionsPerSec = 0;
 
+// ----------------- Main loop scheduler ---------------
+
+int networkTaskId = -1;
+int buttonTaskId = -1;
+int frameTaskId = -1;
+int ldrTaskId = -1;
+int pirTaskId = -1;
+byte ledFrameCount = 0;
+
+// ------------------- Low power -----------------------
+
+unsigned long lastWebRequestCount = 0;
+
+// ------------------ Input recorder -------------------
+
+InputRecorder inputRecorder;
+unsigned long lastRecorderFlushMillis = 0;
+
 // ----------------- Real time clock -------------------
 
 byte useRTC = false;  // true if we detect an RTC
@@ -52,7 +92,6 @@ boolean onceHadAnRTC = false;
 
 unsigned long pirLastSeen = 0;
 boolean pirInstalled = false;
-int pirConsecutiveCounts = 300;  // set with a high value to stop the PIR being falsely detected the first time round the loop
 boolean pirStatus = false;
 
 // --------------------- Blanking ----------------------
@@ -66,9 +105,7 @@ boolean blankLEDs = false;
 
 // --------------- Ambient light dimming ---------------
 
-double sensorLDRSmoothed = 0;
-double sensorFactor = (double)SENSOR_SENSIT_DEFAULT / 100.0;
-int ldrValue = 0;
+int ldrValue = 0;   // Dimming count from the LDR task, read only elsewhere
 
 // ------------------- LED management ------------------
 
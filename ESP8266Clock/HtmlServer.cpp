@@ -10,6 +10,44 @@ boolean webAuthentication = WEB_AUTH_DEFAULT;
 String webUsername = WEB_USERNAME_DEFAULT;
 String webPassword = WEB_PASSWORD_DEFAULT;
 
+// ------------------- Web activity --------------------
+
+unsigned long webRequestCount = 0;
+String lastWebRequestUri;
+
+// ************************************************************
+// Handler which sees every request before the real handlers,
+// counts it and passes it on
+// ************************************************************
+class WebActivityHandler : public RequestHandler {
+  public:
+    bool canHandle(HTTPMethod method, String uri) override {
+      (void) method;
+      webRequestCount++;
+      lastWebRequestUri = uri;
+      return false;
+    }
+};
+
+// ************************************************************
+// Must be called before any other handler is added, so that we
+// are first in the chain
+// ************************************************************
+void setUpWebActivityTracking() {
+  server.addHandler(new WebActivityHandler());
+}
+
+// ************************************************************
+// Number of requests seen, to detect web activity
+// ************************************************************
+unsigned long getWebRequestCount() {
+  return webRequestCount;
+}
+
+String getLastWebRequestUri() {
+  return lastWebRequestUri;
+}
+
 // ************************************************************
 // Check server args for a Boolean value and note if it has changed
 // ************************************************************
@@ -28,6 +28,9 @@ String getWebPassword();
 void setWebPassword(String newValue);
 
 void setServerPageHandlers();
+void setUpWebActivityTracking();
+unsigned long getWebRequestCount();
+String getLastWebRequestUri();
 void checkServerArgBoolean(String argument, String argumentName, String trueLiteral, String falseLiteral, boolean &changed, boolean &value);
 void checkServerArgInt(String argument, String argumentName, boolean &changed, int &value);
 void checkServerArgByte(String argument, String argumentName, boolean &changed, byte &value);
@@ -0,0 +1,256 @@
+#include "InputRecorder.h"
+#include <string.h>
+
+static const char* const REC_EVENT_NAMES[REC_TYPE_COUNT] = {
+  "START",
+  "BUTTON",
+  "PIR",
+  "LDR",
+  "TIME",
+  "HTTP"
+};
+
+const char* getRecEventName(uint8_t type) {
+  if (type >= REC_TYPE_COUNT) {
+    return "?";
+  }
+  return REC_EVENT_NAMES[type];
+}
+
+// ************************************************************
+// Start a new log section. Everything is recorded again from
+// scratch, so that the log can be replayed on its own.
+// ************************************************************
+void InputRecorder::start(uint32_t nowMillis) {
+  _recording = true;
+  _lastEventMillis = nowMillis;
+  _lastButton = 0xff;
+  _lastPIR = 0xff;
+  _lastLDR = 0xffffffff;
+  _lastTime = 0;
+  writeEvent(nowMillis, REC_START, NULL, 0);
+}
+
+void InputRecorder::stop() {
+  _recording = false;
+}
+
+bool InputRecorder::isRecording() {
+  return _recording;
+}
+
+void InputRecorder::recordButton(uint32_t nowMillis, bool pressed) {
+  if (!_recording || (pressed == _lastButton)) {
+    return;
+  }
+  uint8_t payload = pressed ? 1 : 0;
+  if (writeEvent(nowMillis, REC_BUTTON, &payload, 1)) {
+    _lastButton = payload;
+  }
+}
+
+void InputRecorder::recordPIR(uint32_t nowMillis, bool level) {
+  if (!_recording || (level == _lastPIR)) {
+    return;
+  }
+  uint8_t payload = level ? 1 : 0;
+  if (writeEvent(nowMillis, REC_PIR, &payload, 1)) {
+    _lastPIR = payload;
+  }
+}
+
+void InputRecorder::recordLDR(uint32_t nowMillis, uint16_t raw) {
+  if (!_recording || (raw == _lastLDR)) {
+    return;
+  }
+  uint8_t payload[2] = { (uint8_t) (raw & 0xff), (uint8_t) (raw >> 8) };
+  if (writeEvent(nowMillis, REC_LDR, payload, 2)) {
+    _lastLDR = raw;
+  }
+}
+
+// ************************************************************
+// The time normally just ticks on, only record it when it jumps
+// (time set from NTP, the RTC, the web page or the buttons)
+// ************************************************************
+void InputRecorder::recordTime(uint32_t nowMillis, uint32_t t) {
+  if (!_recording || ((_lastTime != 0) && ((t == _lastTime) || (t == _lastTime + 1)))) {
+    _lastTime = t;
+    return;
+  }
+  uint8_t payload[4] = { (uint8_t) t, (uint8_t) (t >> 8), (uint8_t) (t >> 16), (uint8_t) (t >> 24) };
+  if (writeEvent(nowMillis, REC_TIME, payload, 4)) {
+    _lastTime = t;
+  }
+}
+
+void InputRecorder::recordHttp(uint32_t nowMillis, const char *uri) {
+  if (!_recording) {
+    return;
+  }
+  uint8_t payload[RECORDER_MAX_TEXT + 1];
+  uint8_t len = 0;
+  while ((len < RECORDER_MAX_TEXT) && (uri[len] != 0)) {
+    payload[len + 1] = uri[len];
+    len++;
+  }
+  payload[0] = len;
+  writeEvent(nowMillis, REC_HTTP, payload, len + 1);
+}
+
+// ************************************************************
+// Append one event. If there is no room the event is dropped
+// and counted, the caller is expected to flush in time.
+// ************************************************************
+bool InputRecorder::writeEvent(uint32_t nowMillis, uint8_t type, const uint8_t *payload, uint8_t payloadLength) {
+  // Edges are recorded at the time they happened, which can be a
+  // little before an event another task has just written
+  if ((int32_t) (nowMillis - _lastEventMillis) < 0) {
+    nowMillis = _lastEventMillis;
+  }
+  uint32_t delta = nowMillis - _lastEventMillis;
+
+  uint8_t header[6];
+  uint8_t headerLength = 1;
+  if (delta < REC_DELTA_EXTENDED) {
+    header[0] = (type << 5) | delta;
+  } else {
+    header[0] = (type << 5) | REC_DELTA_EXTENDED;
+    while (delta >= 0x80) {
+      header[headerLength++] = (delta & 0x7f) | 0x80;
+      delta >>= 7;
+    }
+    header[headerLength++] = delta;
+  }
+
+  if ((_length + headerLength + payloadLength) > RECORDER_BUFFER_SIZE) {
+    _droppedEvents++;
+    return false;
+  }
+
+  memcpy(&_buffer[_length], header, headerLength);
+  _length += headerLength;
+  if (payloadLength > 0) {
+    memcpy(&_buffer[_length], payload, payloadLength);
+    _length += payloadLength;
+  }
+
+  _lastEventMillis = nowMillis;
+  _eventCount++;
+  return true;
+}
+
+bool InputRecorder::needsFlush() {
+  return _length >= RECORDER_FLUSH_BYTES;
+}
+
+const uint8_t* InputRecorder::getPending() {
+  return _buffer;
+}
+
+uint16_t InputRecorder::getPendingLength() {
+  return _length;
+}
+
+void InputRecorder::clearPending() {
+  _length = 0;
+}
+
+uint32_t InputRecorder::getEventCount() {
+  return _eventCount;
+}
+
+uint32_t InputRecorder::getDroppedEvents() {
+  return _droppedEvents;
+}
+
+// ************************************************************
+// Log reader
+// ************************************************************
+InputLogReader::InputLogReader(const uint8_t *log, uint32_t length) {
+  _log = log;
+  _length = length;
+}
+
+bool InputLogReader::readByte(uint8_t *value) {
+  if (_pos >= _length) {
+    _damaged = true;
+    return false;
+  }
+  *value = _log[_pos++];
+  return true;
+}
+
+bool InputLogReader::isDamaged() {
+  return _damaged;
+}
+
+bool InputLogReader::next(rec_event_t *event) {
+  if (_damaged || (_pos >= _length)) {
+    return false;
+  }
+
+  uint8_t header;
+  readByte(&header);
+  event->type = header >> 5;
+
+  uint32_t delta = header & REC_DELTA_EXTENDED;
+  if (delta == REC_DELTA_EXTENDED) {
+    delta = 0;
+    uint8_t shift = 0;
+    uint8_t b;
+    do {
+      if (!readByte(&b) || (shift > 28)) {
+        _damaged = true;
+        return false;
+      }
+      delta |= (uint32_t) (b & 0x7f) << shift;
+      shift += 7;
+    } while (b & 0x80);
+  }
+
+  event->value = 0;
+  event->text[0] = 0;
+
+  uint8_t b0, b1, b2, b3;
+  switch (event->type) {
+    case REC_START:
+      // Each start begins a new log clock
+      _millis = 0;
+      delta = 0;
+      break;
+    case REC_BUTTON:
+    case REC_PIR:
+      if (!readByte(&b0)) return false;
+      event->value = b0;
+      break;
+    case REC_LDR:
+      if (!readByte(&b0) || !readByte(&b1)) return false;
+      event->value = b0 | (b1 << 8);
+      break;
+    case REC_TIME:
+      if (!readByte(&b0) || !readByte(&b1) || !readByte(&b2) || !readByte(&b3)) return false;
+      event->value = (uint32_t) b0 | ((uint32_t) b1 << 8) | ((uint32_t) b2 << 16) | ((uint32_t) b3 << 24);
+      break;
+    case REC_HTTP: {
+        uint8_t len;
+        if (!readByte(&len) || (len > RECORDER_MAX_TEXT)) {
+          _damaged = true;
+          return false;
+        }
+        for (uint8_t i = 0 ; i < len ; i++) {
+          if (!readByte(&b0)) return false;
+          event->text[i] = b0;
+        }
+        event->text[len] = 0;
+        break;
+      }
+    default:
+      _damaged = true;
+      return false;
+  }
+
+  _millis += delta;
+  event->millis = _millis;
+  return true;
+}
@@ -0,0 +1,108 @@
+#ifndef inputrecorder_h
+#define inputrecorder_h
+
+#include <stdint.h>
+
+// ************************************************************
+// Recorder for the inputs that drive the mode state machine:
+// button level, PIR pin, raw LDR readings, time source updates
+// and web requests. Events are only written when the input
+// changes, into a compact binary log:
+//
+//   header byte: event type (top 3 bits) | time delta (low 5 bits)
+//                delta 0..30 mS is stored directly, 31 means a
+//                varint delta in mS follows
+//   payload:     depends on the type, see below
+//
+// The recorder fills a RAM buffer which the caller flushes to
+// the file system. The reader decodes a log, on the clock or on
+// the host (tools/inputreplay), and has no Arduino dependencies.
+// ************************************************************
+
+#define RECORDER_BUFFER_SIZE            1024
+#define RECORDER_FLUSH_BYTES            512
+#define RECORDER_FLUSH_INTERVAL_MS      60000
+#define RECORDER_MAX_LOG_BYTES          65536
+#define RECORDER_MAX_TEXT               31
+
+// Event types (3 bits)
+#define REC_START                       0   // payload: none, starts the log clock at 0
+#define REC_BUTTON                      1   // payload: 1 byte level (1 = pressed)
+#define REC_PIR                         2   // payload: 1 byte pin level
+#define REC_LDR                         3   // payload: 2 bytes raw reading, little endian
+#define REC_TIME                        4   // payload: 4 bytes time_t, little endian
+#define REC_HTTP                        5   // payload: 1 byte length + the URI
+#define REC_TYPE_COUNT                  6
+
+#define REC_DELTA_EXTENDED              31
+
+typedef struct {
+  uint8_t type;
+  uint32_t millis;                          // since the start of the log
+  uint32_t value;
+  char text[RECORDER_MAX_TEXT + 1];
+} rec_event_t;
+
+class InputRecorder
+{
+  public:
+    void start(uint32_t nowMillis);
+    void stop();
+    bool isRecording();
+
+    // Each of these only writes an event if the value has changed
+    void recordButton(uint32_t nowMillis, bool pressed);
+    void recordPIR(uint32_t nowMillis, bool level);
+    void recordLDR(uint32_t nowMillis, uint16_t raw);
+    void recordTime(uint32_t nowMillis, uint32_t t);
+
+    // Always written
+    void recordHttp(uint32_t nowMillis, const char *uri);
+
+    // The caller writes the pending bytes out, then clears them
+    bool needsFlush();
+    const uint8_t* getPending();
+    uint16_t getPendingLength();
+    void clearPending();
+
+    uint32_t getEventCount();
+    uint32_t getDroppedEvents();
+
+  private:
+    bool _recording = false;
+    uint32_t _lastEventMillis = 0;
+    uint8_t _buffer[RECORDER_BUFFER_SIZE];
+    uint16_t _length = 0;
+    uint32_t _eventCount = 0;
+    uint32_t _droppedEvents = 0;
+
+    uint8_t _lastButton = 0xff;
+    uint8_t _lastPIR = 0xff;
+    uint32_t _lastLDR = 0xffffffff;
+    uint32_t _lastTime = 0;
+
+    bool writeEvent(uint32_t nowMillis, uint8_t type, const uint8_t *payload, uint8_t payloadLength);
+};
+
+class InputLogReader
+{
+  public:
+    InputLogReader(const uint8_t *log, uint32_t length);
+
+    // Decode the next event, false at the end or on a damaged log
+    bool next(rec_event_t *event);
+    bool isDamaged();
+
+  private:
+    const uint8_t *_log;
+    uint32_t _length;
+    uint32_t _pos = 0;
+    uint32_t _millis = 0;
+    bool _damaged = false;
+
+    bool readByte(uint8_t *value);
+};
+
+const char* getRecEventName(uint8_t type);
+
+#endif
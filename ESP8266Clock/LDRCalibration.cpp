@@ -0,0 +1,158 @@
+#include "LDRCalibration.h"
+#include <string.h>
+
+LDRCalibration::LDRCalibration() {
+  reset();
+}
+
+void LDRCalibration::reset() {
+  memset(&_data, 0, sizeof(_data));
+  _data.magic = LDR_CAL_MAGIC;
+  _data.version = LDR_CAL_VERSION;
+  for (uint8_t i = 0 ; i < LDR_CAL_HOURS ; i++) {
+    _data.hourly[i] = LDR_CAL_HOUR_UNSEEN;
+  }
+  _total = 0;
+  updateMapping();
+}
+
+// ************************************************************
+// One minute of learning. Cheap: one bin, one average and a
+// walk over the bins for the new mapping.
+// ************************************************************
+void LDRCalibration::addMinute(uint16_t reading, uint8_t hour) {
+  if (reading >= LDR_CAL_BINS * LDR_CAL_BIN_WIDTH) {
+    reading = LDR_CAL_BINS * LDR_CAL_BIN_WIDTH - 1;
+  }
+
+  _data.minutes++;
+  _data.bins[reading / LDR_CAL_BIN_WIDTH]++;
+  _total++;
+
+  // Age the histogram
+  if (_total >= LDR_CAL_AGE_MINUTES) {
+    _total = 0;
+    for (uint8_t i = 0 ; i < LDR_CAL_BINS ; i++) {
+      _data.bins[i] /= 2;
+      _total += _data.bins[i];
+    }
+  }
+
+  if (hour < LDR_CAL_HOURS) {
+    int32_t readingQ4 = (int32_t) reading << LDR_CAL_HOUR_FRAC_BITS;
+    if (_data.hourly[hour] == LDR_CAL_HOUR_UNSEEN) {
+      _data.hourly[hour] = readingQ4;
+    } else {
+      int32_t average = _data.hourly[hour];
+      average += (readingQ4 - average) / LDR_CAL_HOUR_SMOOTH;
+      _data.hourly[hour] = average;
+    }
+  }
+
+  updateMapping();
+}
+
+// ************************************************************
+// Reading at which the given percentage of the minutes were
+// darker, taken as the middle of the bin
+// ************************************************************
+uint16_t LDRCalibration::getPercentile(uint8_t percent) {
+  uint32_t limit = _total * percent / 100;
+  uint32_t count = 0;
+  for (uint8_t i = 0 ; i < LDR_CAL_BINS ; i++) {
+    count += _data.bins[i];
+    if (count > limit) {
+      return i * LDR_CAL_BIN_WIDTH + LDR_CAL_BIN_WIDTH / 2;
+    }
+  }
+  return LDR_CAL_BINS * LDR_CAL_BIN_WIDTH - LDR_CAL_BIN_WIDTH / 2;
+}
+
+void LDRCalibration::updateMapping() {
+  _calibrated = false;
+  if ((_data.minutes < LDR_CAL_MIN_MINUTES) || (_total == 0)) {
+    return;
+  }
+
+  _dark = getPercentile(LDR_CAL_LOW_PERCENT);
+  _bright = getPercentile(LDR_CAL_HIGH_PERCENT);
+
+  // A site that never changes much, a fixed mapping is better
+  if (_bright < _dark + LDR_CAL_MIN_SPAN) {
+    return;
+  }
+
+  _calibrated = true;
+}
+
+bool LDRCalibration::isCalibrated() {
+  return _calibrated;
+}
+
+uint16_t LDRCalibration::getDarkReading() {
+  return _dark;
+}
+
+uint16_t LDRCalibration::getBrightReading() {
+  return _bright;
+}
+
+// ************************************************************
+// The LDR manager works out dimming = (reading + threshold) * 5
+// / sensitivity. Choose them so that the dark reading gives the
+// minimum dim and the bright reading full brightness.
+// ************************************************************
+uint16_t LDRCalibration::getSensitivity(uint8_t minDim, uint8_t maxDim) {
+  if (maxDim <= minDim) {
+    return 1;
+  }
+  uint32_t sensitivity = (uint32_t) (_bright - _dark) * 5 / (maxDim - minDim);
+  return (sensitivity > 0) ? sensitivity : 1;
+}
+
+int16_t LDRCalibration::getThreshold(uint8_t minDim, uint8_t maxDim) {
+  return (int32_t) minDim * getSensitivity(minDim, maxDim) / 5 - _dark;
+}
+
+uint32_t LDRCalibration::getMinutes() {
+  return _data.minutes;
+}
+
+uint32_t LDRCalibration::getHistogramTotal() {
+  return _total;
+}
+
+uint16_t LDRCalibration::getBin(uint8_t bin) {
+  if (bin >= LDR_CAL_BINS) {
+    return 0;
+  }
+  return _data.bins[bin];
+}
+
+int16_t LDRCalibration::getHourlyReading(uint8_t hour) {
+  if ((hour >= LDR_CAL_HOURS) || (_data.hourly[hour] == LDR_CAL_HOUR_UNSEEN)) {
+    return -1;
+  }
+  return (_data.hourly[hour] + (1 << (LDR_CAL_HOUR_FRAC_BITS - 1))) >> LDR_CAL_HOUR_FRAC_BITS;
+}
+
+const ldr_cal_data_t* LDRCalibration::getData() {
+  return &_data;
+}
+
+// ************************************************************
+// Take saved data, if it is from this version
+// ************************************************************
+bool LDRCalibration::setData(const ldr_cal_data_t *data) {
+  if ((data->magic != LDR_CAL_MAGIC) || (data->version != LDR_CAL_VERSION)) {
+    return false;
+  }
+
+  memcpy(&_data, data, sizeof(_data));
+  _total = 0;
+  for (uint8_t i = 0 ; i < LDR_CAL_BINS ; i++) {
+    _total += _data.bins[i];
+  }
+  updateMapping();
+  return true;
+}
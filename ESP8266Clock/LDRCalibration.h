@@ -0,0 +1,88 @@
+#ifndef ldrcalibration_h
+#define ldrcalibration_h
+
+#include <stdint.h>
+
+// ************************************************************
+// Learns the ambient light at the clock's site so that the LDR
+// threshold and sensitivity do not need tuning by hand.
+//
+// Once a minute the filtered LDR reading goes into a histogram
+// of LDR_CAL_BINS bins and into a per hour of the day average.
+// When the histogram holds LDR_CAL_AGE_MINUTES all the bins are
+// halved, so old sites fade out after a couple of weeks.
+//
+// After LDR_CAL_MIN_MINUTES the low and high percentiles of the
+// histogram give the dark and bright readings, and those are
+// turned into the threshold and sensitivity that map dark to the
+// minimum dim and bright to full brightness.
+//
+// The learnt data is a fixed size struct, saved as it is.
+// No Arduino dependencies.
+// ************************************************************
+
+#define LDR_CAL_MAGIC                   0x4c43   // "CL"
+#define LDR_CAL_VERSION                 1
+#define LDR_CAL_BINS                    32
+#define LDR_CAL_BIN_WIDTH               32       // 1024 readings / 32 bins
+#define LDR_CAL_HOURS                   24
+#define LDR_CAL_HOUR_UNSEEN             0xffff
+#define LDR_CAL_HOUR_FRAC_BITS          4        // hourly averages in Q4
+#define LDR_CAL_HOUR_SMOOTH             64       // minutes, about two days of each hour
+#define LDR_CAL_MIN_MINUTES             4320     // three days
+#define LDR_CAL_AGE_MINUTES             20160    // two weeks
+#define LDR_CAL_LOW_PERCENT             5
+#define LDR_CAL_HIGH_PERCENT            95
+#define LDR_CAL_MIN_SPAN                100      // less than this between dark and bright is not worth using
+
+typedef struct {
+  uint16_t magic;
+  uint8_t version;
+  uint8_t reserved;
+  uint32_t minutes;                              // learnt in total
+  uint16_t bins[LDR_CAL_BINS];
+  uint16_t hourly[LDR_CAL_HOURS];                // Q4 average reading, LDR_CAL_HOUR_UNSEEN if none yet
+} ldr_cal_data_t;
+
+class LDRCalibration
+{
+  public:
+    LDRCalibration();
+
+    // reading: filtered LDR reading, more is brighter
+    void addMinute(uint16_t reading, uint8_t hour);
+    void reset();
+
+    bool isCalibrated();
+    uint16_t getDarkReading();
+    uint16_t getBrightReading();
+
+    // The mapping for the LDR manager
+    int16_t getThreshold(uint8_t minDim, uint8_t maxDim);
+    uint16_t getSensitivity(uint8_t minDim, uint8_t maxDim);
+
+    uint32_t getMinutes();
+    uint32_t getHistogramTotal();
+    uint16_t getBin(uint8_t bin);
+    int16_t getHourlyReading(uint8_t hour);    // -1 if not seen yet
+
+    // For saving and loading
+    const ldr_cal_data_t* getData();
+    bool setData(const ldr_cal_data_t *data);
+
+  private:
+    ldr_cal_data_t _data;
+    uint32_t _total = 0;
+    bool _calibrated = false;
+    uint16_t _dark = 0;
+    uint16_t _bright = 0;
+
+    void updateMapping();
+    uint16_t getPercentile(uint8_t percent);
+};
+
+// ----------------- Exported Variables ------------------
+
+static LDRCalibration ldrCalibration;
+
+#endif
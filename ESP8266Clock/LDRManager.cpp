@@ -0,0 +1,155 @@
+#include "LDRManager.h"
+
+// ************************************************************
+// Take the current settings. Cheap enough to call before each
+// sample, so changes from the web page or the buttons apply at
+// once without resetting the filter.
+// ************************************************************
+void LDRManager::setConfig(bool useLDR, int16_t threshold, uint16_t sensitivity, uint8_t smoothCount, uint8_t minDim, uint8_t maxDim) {
+  _useLDR = useLDR;
+  _threshold = threshold;
+  _sensitivity = (sensitivity > 0) ? sensitivity : 1;
+  _smoothCount = (smoothCount > 0) ? smoothCount : 1;
+  _minDim = minDim;
+  _maxDim = maxDim;
+}
+
+void LDRManager::setStepLimits(uint16_t hysteresis, uint16_t slewMillis) {
+  _hysteresis = hysteresis;
+  _slewMillis = slewMillis;
+}
+
+void LDRManager::addSample(uint16_t raw) {
+  if (raw > LDR_ADC_MAX) {
+    raw = LDR_ADC_MAX;
+  }
+  _lastRaw = raw;
+  _sampleCount++;
+
+  _window[_windowPos] = raw;
+  _windowPos = (_windowPos + 1) % LDR_MEDIAN_WINDOW;
+  if (_windowCount < LDR_MEDIAN_WINDOW) {
+    _windowCount++;
+  }
+
+  // Bright gives a low ADC reading, we work with "more is brighter"
+  int32_t sensorQ8 = (int32_t) (LDR_ADC_MAX - getMedian()) << LDR_FRAC_BITS;
+
+  if (_windowCount == 1) {
+    // Start from the first reading instead of ramping up from dark
+    _filteredQ8 = sensorQ8;
+  } else {
+    _filteredQ8 += (sensorQ8 - _filteredQ8) / _smoothCount;
+  }
+
+  _reading = (_filteredQ8 + (1 << (LDR_FRAC_BITS - 1))) >> LDR_FRAC_BITS;
+}
+
+void LDRManager::reset() {
+  _windowCount = 0;
+  _windowPos = 0;
+  _filteredQ8 = 0;
+  _reading = 0;
+  _dimmingValid = false;
+}
+
+// ************************************************************
+// Median of the samples in the window, insertion sort of a copy
+// ************************************************************
+uint16_t LDRManager::getMedian() {
+  uint16_t sorted[LDR_MEDIAN_WINDOW];
+  for (uint8_t i = 0 ; i < _windowCount ; i++) {
+    uint16_t value = _window[i];
+    uint8_t j = i;
+    while ((j > 0) && (sorted[j - 1] > value)) {
+      sorted[j] = sorted[j - 1];
+      j--;
+    }
+    sorted[j] = value;
+  }
+  return sorted[_windowCount / 2];
+}
+
+// ************************************************************
+// Scaling offset increases the base brightness, the sensitivity
+// sets how far the reading has to move for one step. Clamped
+// because bright light can go past full brightness.
+//
+// Working in units of 1/sensitivity of a step, count n covers
+// n * sensitivity up to (n + 1) * sensitivity. We stay on the
+// current count until the reading is the hysteresis outside that.
+// ************************************************************
+uint8_t LDRManager::getTargetDimming() {
+  if (!_useLDR) {
+    return _maxDim;
+  }
+
+  int32_t offsetReading = (int32_t) _reading + _threshold;
+  uint32_t scaled = (offsetReading > 0) ? offsetReading * 5 : 0;
+  uint32_t band = (uint32_t) _hysteresis * 5;
+  uint32_t dimming = _dimming;
+
+  if (!_dimmingValid ||
+      (scaled >= ((uint32_t) _dimming + 1) * _sensitivity + band) ||
+      (scaled + band < (uint32_t) _dimming * _sensitivity)) {
+    dimming = scaled / _sensitivity;
+  }
+
+  if (dimming < _minDim) dimming = _minDim;
+  if (dimming > _maxDim) dimming = _maxDim;
+  return dimming;
+}
+
+// ************************************************************
+// Step towards the target, at most one count per slew time. The
+// first value goes straight out so that we start at the right
+// brightness.
+// ************************************************************
+bool LDRManager::updateDimming(uint32_t nowMillis) {
+  uint8_t target = getTargetDimming();
+
+  if (!_dimmingValid) {
+    _dimming = target;
+    _dimmingValid = true;
+    _lastStepMillis = nowMillis;
+    _dimmingChanges++;
+    return true;
+  }
+
+  if (target == _dimming) {
+    return false;
+  }
+
+  if (_slewMillis == 0) {
+    _dimming = target;
+  } else {
+    if ((nowMillis - _lastStepMillis) < _slewMillis) {
+      return false;
+    }
+    _dimming += (target > _dimming) ? 1 : -1;
+  }
+
+  _lastStepMillis = nowMillis;
+  _dimmingChanges++;
+  return true;
+}
+
+uint8_t LDRManager::getDimming() {
+  return _dimming;
+}
+
+uint16_t LDRManager::getReading() {
+  return _reading;
+}
+
+uint16_t LDRManager::getLastRaw() {
+  return _lastRaw;
+}
+
+uint32_t LDRManager::getSampleCount() {
+  return _sampleCount;
+}
+
+uint32_t LDRManager::getDimmingChanges() {
+  return _dimmingChanges;
+}
@@ -0,0 +1,82 @@
+#ifndef ldrmanager_h
+#define ldrmanager_h
+
+#include <stdint.h>
+
+// ************************************************************
+// Ambient light acquisition. The LDR task reads the ADC at a
+// fixed rate (TASK_PERIOD_LDR_MS) and hands over the average of
+// LDR_OVERSAMPLE conversions. Each sample then goes through:
+//
+//   median of the last LDR_MEDIAN_WINDOW samples (drops spikes)
+//   integer IIR in Q8 fixed point, divisor sensorSmoothCountLDR
+//
+// and the filtered reading is turned into the dimming count.
+// Everybody else only reads the published values, so the filter
+// response depends on the task rate only.
+//
+// The dimming count only steps when the reading is more than the
+// hysteresis past the step boundary, and then by at most one count
+// per slew time, so that light near a boundary does not make the
+// tubes and backlights flicker between two levels.
+//
+// No Arduino dependencies, so the replay tool can run it too.
+// ************************************************************
+
+#define LDR_OVERSAMPLE                  4
+#define LDR_MEDIAN_WINDOW               5
+#define LDR_ADC_MAX                     1023
+#define LDR_FRAC_BITS                   8
+
+class LDRManager
+{
+  public:
+    void setConfig(bool useLDR, int16_t threshold, uint16_t sensitivity, uint8_t smoothCount, uint8_t minDim, uint8_t maxDim);
+    void setStepLimits(uint16_t hysteresis, uint16_t slewMillis);
+
+    // One oversampled raw ADC reading, 0 = bright, 1023 = dark
+    void addSample(uint16_t raw);
+    void reset();
+
+    // Move the dimming count on, true if it changed
+    bool updateDimming(uint32_t nowMillis);
+
+    // Published values
+    uint8_t getDimming();
+    uint16_t getReading();
+    uint16_t getLastRaw();
+    uint32_t getSampleCount();
+    uint32_t getDimmingChanges();
+
+  private:
+    bool _useLDR = true;
+    int16_t _threshold = 0;     // negative from the calibration for dark sites
+    uint16_t _sensitivity = 1;
+    uint8_t _smoothCount = 1;
+    uint8_t _minDim = 0;
+    uint8_t _maxDim = 0;
+    uint16_t _hysteresis = 0;
+    uint16_t _slewMillis = 0;
+
+    uint16_t _window[LDR_MEDIAN_WINDOW];
+    uint8_t _windowCount = 0;
+    uint8_t _windowPos = 0;
+
+    int32_t _filteredQ8 = 0;
+    uint16_t _lastRaw = 0;
+    uint16_t _reading = 0;
+    uint8_t _dimming = 0;
+    bool _dimmingValid = false;
+    uint32_t _lastStepMillis = 0;
+    uint32_t _sampleCount = 0;
+    uint32_t _dimmingChanges = 0;
+
+    uint16_t getMedian();
+    uint8_t getTargetDimming();
+};
+
+// ----------------- Exported Variables ------------------
+
+static LDRManager ldrManager;
+
+#endif
@@ -0,0 +1,467 @@
+#include "LEDEffectVM.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+typedef struct {
+  const char *mnemonic;
+  uint8_t operandBytes;
+  uint8_t pops;     // values which must be on the stack
+  uint8_t grows;    // how much deeper the stack can get
+} ledvm_op_t;
+
+// In opcode order
+static const ledvm_op_t LEDVM_OPS[LEDVM_OP_COUNT] = {
+  {"END",    0, 0, 0},
+  {"PUSH",   2, 0, 1},
+  {"TIME",   0, 0, 1},
+  {"CYCLE",  0, 0, 1},
+  {"PIXEL",  0, 0, 1},
+  {"DIGIT",  0, 0, 1},
+  {"ZONE",   0, 0, 1},
+  {"OFFSET", 0, 0, 1},
+  {"ADD",    0, 2, 0},
+  {"SUB",    0, 2, 0},
+  {"MUL",    0, 2, 0},
+  {"DIV",    0, 2, 0},
+  {"MOD",    0, 2, 0},
+  {"AND",    0, 2, 0},
+  {"OR",     0, 2, 0},
+  {"XOR",    0, 2, 0},
+  {"SHL",    0, 2, 0},
+  {"SHR",    0, 2, 0},
+  {"MIN",    0, 2, 0},
+  {"MAX",    0, 2, 0},
+  {"LT",     0, 2, 0},
+  {"GT",     0, 2, 0},
+  {"EQ",     0, 2, 0},
+  {"SIN",    0, 1, 0},
+  {"TRI",    0, 1, 0},
+  {"RAND",   0, 1, 0},
+  {"DUP",    0, 1, 1},
+  {"DROP",   0, 1, 0},
+  {"SWAP",   0, 2, 0},
+  {"OVER",   0, 2, 1},
+  {"JMP",    1, 0, 0},
+  {"JZ",     1, 1, 0},
+  {"RGB",    0, 3, 0},
+  {"HSV",    0, 3, 0},
+  {"PAL",    0, 1, 0},
+  {"PALV",   0, 2, 0},
+};
+
+// ************************************************************
+// Clamp a stack value to a colour channel
+// ************************************************************
+static uint8_t clamp8(int32_t value) {
+  if (value < 0) return 0;
+  if (value > 255) return 255;
+  return value;
+}
+
+// ************************************************************
+// Check a bytecode program and, if it is good, load it. We make
+// sure that every opcode is known, that no operand runs off the
+// end and that all jumps land on an instruction, so the
+// interpreter only has to check the stack at run time.
+// ************************************************************
+bool LedEffectVM::load(const uint8_t *code, uint16_t length, char *error, uint16_t errorSize) {
+  if ((length == 0) || (length > LEDVM_MAX_CODE)) {
+    snprintf(error, errorSize, "program length %u is not between 1 and %u", length, LEDVM_MAX_CODE);
+    return false;
+  }
+
+  bool isInstruction[LEDVM_MAX_CODE];
+  memset(isInstruction, 0, sizeof(isInstruction));
+
+  uint16_t pc = 0;
+  uint8_t op = LEDVM_END;
+  while (pc < length) {
+    op = code[pc];
+    if (op >= LEDVM_OP_COUNT) {
+      snprintf(error, errorSize, "unknown opcode %u at %u", op, pc);
+      return false;
+    }
+    if (pc + LEDVM_OPS[op].operandBytes >= length) {
+      snprintf(error, errorSize, "missing operand for %s at %u", LEDVM_OPS[op].mnemonic, pc);
+      return false;
+    }
+    isInstruction[pc] = true;
+    pc += 1 + LEDVM_OPS[op].operandBytes;
+  }
+
+  // Don't let the interpreter run off the end
+  if ((op != LEDVM_END) && (op != LEDVM_JMP)) {
+    snprintf(error, errorSize, "program must finish with END or JMP");
+    return false;
+  }
+
+  for (pc = 0 ; pc < length ; pc += 1 + LEDVM_OPS[code[pc]].operandBytes) {
+    if ((code[pc] == LEDVM_JMP) || (code[pc] == LEDVM_JZ)) {
+      uint8_t target = code[pc + 1];
+      if ((target >= length) || !isInstruction[target]) {
+        snprintf(error, errorSize, "bad jump target %u at %u", target, pc);
+        return false;
+      }
+    }
+  }
+
+  memcpy(_code, code, length);
+  _codeLength = length;
+  _loaded = true;
+  resetStats();
+  return true;
+}
+
+// ************************************************************
+// Find the opcode for a mnemonic, case insensitive
+// ************************************************************
+static int findOpcode(const char *mnemonic) {
+  for (int op = 0 ; op < LEDVM_OP_COUNT ; op++) {
+    const char *a = LEDVM_OPS[op].mnemonic;
+    const char *b = mnemonic;
+    while (*a && (*a == toupper((unsigned char) *b))) {
+      a++;
+      b++;
+    }
+    if ((*a == 0) && (*b == 0)) {
+      return op;
+    }
+  }
+  return -1;
+}
+
+// ************************************************************
+// Parse a whole token as a (possibly negative) number
+// ************************************************************
+static bool parseNumber(const char *token, long &value) {
+  char *end;
+  value = strtol(token, &end, 0);
+  return (end != token) && (*end == 0);
+}
+
+// ************************************************************
+// Two pass assembler: the first pass collects the label
+// addresses, the second emits the code. Each line holds an
+// optional "label:", an optional instruction and an optional
+// operand, with ';' or '#' starting a comment.
+// ************************************************************
+bool LedEffectVM::assemble(const char *source, char *error, uint16_t errorSize) {
+  char labels[LEDVM_MAX_LABELS][LEDVM_MAX_LABEL_LEN + 1];
+  uint16_t labelAddr[LEDVM_MAX_LABELS];
+  uint8_t labelCount = 0;
+
+  uint8_t code[LEDVM_MAX_CODE];
+  uint16_t codeLength = 0;
+  int lastOp = -1;
+
+  for (uint8_t pass = 0 ; pass < 2 ; pass++) {
+    const char *p = source;
+    uint16_t lineNumber = 0;
+    codeLength = 0;
+    lastOp = -1;
+
+    while (*p) {
+      lineNumber++;
+
+      // Cut out the line, without the comment
+      char line[64];
+      uint8_t len = 0;
+      bool comment = false;
+      while (*p && (*p != '\n')) {
+        if ((*p == ';') || (*p == '#')) {
+          comment = true;
+        }
+        if (!comment && (*p != '\r')) {
+          if (len >= sizeof(line) - 1) {
+            snprintf(error, errorSize, "line %u: line too long", lineNumber);
+            return false;
+          }
+          line[len++] = *p;
+        }
+        p++;
+      }
+      if (*p == '\n') {
+        p++;
+      }
+      line[len] = 0;
+
+      // Split into up to three tokens
+      char *tokens[3];
+      uint8_t tokenCount = 0;
+      char *save = NULL;
+      for (char *t = strtok_r(line, " \t", &save) ; t != NULL ; t = strtok_r(NULL, " \t", &save)) {
+        if (tokenCount == 3) {
+          snprintf(error, errorSize, "line %u: too many tokens", lineNumber);
+          return false;
+        }
+        tokens[tokenCount++] = t;
+      }
+
+      uint8_t next = 0;
+
+      // Label
+      if ((tokenCount > 0) && (tokens[0][strlen(tokens[0]) - 1] == ':')) {
+        tokens[0][strlen(tokens[0]) - 1] = 0;
+        if (pass == 0) {
+          if ((labelCount == LEDVM_MAX_LABELS) || (strlen(tokens[0]) > LEDVM_MAX_LABEL_LEN) || (strlen(tokens[0]) == 0)) {
+            snprintf(error, errorSize, "line %u: bad label or too many labels", lineNumber);
+            return false;
+          }
+          strcpy(labels[labelCount], tokens[0]);
+          labelAddr[labelCount++] = codeLength;
+        }
+        next++;
+      }
+
+      if (next == tokenCount) {
+        continue;
+      }
+
+      // A bare number is a PUSH
+      long value;
+      int op;
+      const char *operand = NULL;
+      if (parseNumber(tokens[next], value)) {
+        op = LEDVM_PUSH;
+        operand = tokens[next];
+        if (next + 1 < tokenCount) {
+          snprintf(error, errorSize, "line %u: too many tokens", lineNumber);
+          return false;
+        }
+      } else {
+        op = findOpcode(tokens[next]);
+        if (op < 0) {
+          snprintf(error, errorSize, "line %u: unknown instruction '%s'", lineNumber, tokens[next]);
+          return false;
+        }
+        if (next + 1 < tokenCount) {
+          operand = tokens[next + 1];
+        }
+        if (next + 2 < tokenCount) {
+          snprintf(error, errorSize, "line %u: too many tokens", lineNumber);
+          return false;
+        }
+      }
+
+      if ((LEDVM_OPS[op].operandBytes > 0) && (operand == NULL)) {
+        snprintf(error, errorSize, "line %u: %s needs an operand", lineNumber, LEDVM_OPS[op].mnemonic);
+        return false;
+      }
+      if ((LEDVM_OPS[op].operandBytes == 0) && (operand != NULL)) {
+        snprintf(error, errorSize, "line %u: %s takes no operand", lineNumber, LEDVM_OPS[op].mnemonic);
+        return false;
+      }
+      if (codeLength + 1 + LEDVM_OPS[op].operandBytes > LEDVM_MAX_CODE) {
+        snprintf(error, errorSize, "line %u: program too long", lineNumber);
+        return false;
+      }
+
+      code[codeLength++] = op;
+      lastOp = op;
+
+      if (op == LEDVM_PUSH) {
+        if (!parseNumber(operand, value) || (value < -32768) || (value > 32767)) {
+          snprintf(error, errorSize, "line %u: bad number '%s'", lineNumber, operand);
+          return false;
+        }
+        code[codeLength++] = value & 0xff;
+        code[codeLength++] = (value >> 8) & 0xff;
+      } else if (LEDVM_OPS[op].operandBytes == 1) {
+        // Jump: resolve the label in the second pass
+        uint16_t target = 0;
+        if (pass == 1) {
+          bool found = false;
+          for (uint8_t i = 0 ; i < labelCount ; i++) {
+            if (strcmp(labels[i], operand) == 0) {
+              target = labelAddr[i];
+              found = true;
+            }
+          }
+          if (!found) {
+            snprintf(error, errorSize, "line %u: unknown label '%s'", lineNumber, operand);
+            return false;
+          }
+        }
+        code[codeLength++] = target;
+      }
+    }
+  }
+
+  // Make sure that the program always ends
+  if ((lastOp != LEDVM_END) && (lastOp != LEDVM_JMP)) {
+    if (codeLength == LEDVM_MAX_CODE) {
+      snprintf(error, errorSize, "program too long");
+      return false;
+    }
+    code[codeLength++] = LEDVM_END;
+  }
+
+  return load(code, codeLength, error, errorSize);
+}
+
+bool LedEffectVM::isLoaded() {
+  return _loaded;
+}
+
+const uint8_t* LedEffectVM::getCode() {
+  return _code;
+}
+
+uint16_t LedEffectVM::getCodeLength() {
+  return _codeLength;
+}
+
+// ************************************************************
+// Run the program once for each pixel, sharing out the frame
+// budget evenly so that one slow pixel can't starve the rest
+// ************************************************************
+void LedEffectVM::render(uint8_t phase, uint32_t cycle, const led_palette_t *palette, rgb_t *pixels) {
+  uint16_t frameInstructions = 0;
+  for (uint8_t i = 0 ; i < EFFECT_PIXEL_COUNT ; i++) {
+    pixels[i].r = pixels[i].g = pixels[i].b = 0;
+    if (_loaded) {
+      frameInstructions += runPixel(i, phase, cycle, palette, &pixels[i]);
+    }
+  }
+
+  _lastFrameInstructions = frameInstructions;
+  if (frameInstructions > _maxFrameInstructions) {
+    _maxFrameInstructions = frameInstructions;
+  }
+}
+
+// ************************************************************
+// Interpret the program for one pixel, returns the number of
+// instructions executed. On an overrun or a fault the pixel is
+// left dark.
+// ************************************************************
+uint16_t LedEffectVM::runPixel(uint8_t pixel, uint8_t phase, uint32_t cycle, const led_palette_t *palette, rgb_t *rgb) {
+  uint16_t pc = 0;
+  uint8_t sp = 0;
+  uint16_t executed = 0;
+  rgb_t result = {0, 0, 0};
+
+  while (true) {
+    if (executed == LEDVM_PIXEL_BUDGET) {
+      _overruns++;
+      return executed;
+    }
+    executed++;
+
+    uint8_t op = _code[pc++];
+
+    if ((sp < LEDVM_OPS[op].pops) || (sp + LEDVM_OPS[op].grows > LEDVM_STACK_SIZE)) {
+      _faults++;
+      return executed;
+    }
+
+    int32_t a, b;
+    switch (op) {
+      case LEDVM_END:
+        *rgb = result;
+        return executed;
+      case LEDVM_PUSH:
+        _stack[sp++] = (int16_t) (_code[pc] | (_code[pc + 1] << 8));
+        pc += 2;
+        break;
+      case LEDVM_TIME:   _stack[sp++] = phase; break;
+      case LEDVM_CYCLE:  _stack[sp++] = cycle & 0xffff; break;
+      case LEDVM_PIXEL:  _stack[sp++] = pixel; break;
+      case LEDVM_DIGIT:  _stack[sp++] = pixel % EFFECT_DIGIT_COUNT; break;
+      case LEDVM_ZONE:   _stack[sp++] = pixel / EFFECT_DIGIT_COUNT; break;
+      case LEDVM_OFFSET: _stack[sp++] = pixelPhaseOffset(pixel); break;
+      case LEDVM_SIN:    _stack[sp - 1] = sin8(_stack[sp - 1]); break;
+      case LEDVM_TRI:    _stack[sp - 1] = triangle8(_stack[sp - 1]); break;
+      case LEDVM_RAND:   _stack[sp - 1] = hash8(_stack[sp - 1]); break;
+      case LEDVM_DUP:    _stack[sp] = _stack[sp - 1]; sp++; break;
+      case LEDVM_DROP:   sp--; break;
+      case LEDVM_OVER:   _stack[sp] = _stack[sp - 2]; sp++; break;
+      case LEDVM_SWAP:
+        a = _stack[sp - 1];
+        _stack[sp - 1] = _stack[sp - 2];
+        _stack[sp - 2] = a;
+        break;
+      case LEDVM_JMP:
+        pc = _code[pc];
+        break;
+      case LEDVM_JZ:
+        pc = (_stack[--sp] == 0) ? _code[pc] : pc + 1;
+        break;
+      case LEDVM_RGB:
+        result.b = clamp8(_stack[--sp]);
+        result.g = clamp8(_stack[--sp]);
+        result.r = clamp8(_stack[--sp]);
+        break;
+      case LEDVM_HSV: {
+          hsv_t hsv;
+          hsv.v = clamp8(_stack[--sp]);
+          hsv.s = clamp8(_stack[--sp]);
+          hsv.h = _stack[--sp] & 0xff;
+          hsvToRgb(hsv, &result);
+          break;
+        }
+      case LEDVM_PAL:
+        hsvToRgb(paletteColour(palette, _stack[--sp] & 0xff), &result);
+        break;
+      case LEDVM_PALV: {
+          uint8_t level = clamp8(_stack[--sp]);
+          hsv_t hsv = paletteColour(palette, _stack[--sp] & 0xff);
+          hsv.v = scale8(hsv.v, level);
+          hsvToRgb(hsv, &result);
+          break;
+        }
+      default:
+        // Binary operators: a b -> result
+        b = _stack[--sp];
+        a = _stack[sp - 1];
+        // The code is uploaded, so nothing it does may be undefined:
+        // the arithmetic wraps (done unsigned), x / 0 and x % 0 are
+        // 0, and x / -1 is negated so INT32_MIN / -1 can't trap
+        switch (op) {
+          case LEDVM_ADD: a = (int32_t) ((uint32_t) a + (uint32_t) b); break;
+          case LEDVM_SUB: a = (int32_t) ((uint32_t) a - (uint32_t) b); break;
+          case LEDVM_MUL: a = (int32_t) ((uint32_t) a * (uint32_t) b); break;
+          case LEDVM_DIV: a = (b == 0) ? 0 : ((b == -1) ? (int32_t) (0u - (uint32_t) a) : a / b); break;
+          case LEDVM_MOD: a = ((b == 0) || (b == -1)) ? 0 : a % b; break;
+          case LEDVM_AND: a = a & b; break;
+          case LEDVM_OR:  a = a | b; break;
+          case LEDVM_XOR: a = a ^ b; break;
+          case LEDVM_SHL: a = (int32_t) ((uint32_t) a << (b & 31)); break;
+          case LEDVM_SHR: a = a >> (b & 31); break;
+          case LEDVM_MIN: a = (a < b) ? a : b; break;
+          case LEDVM_MAX: a = (a > b) ? a : b; break;
+          case LEDVM_LT:  a = (a < b); break;
+          case LEDVM_GT:  a = (a > b); break;
+          case LEDVM_EQ:  a = (a == b); break;
+        }
+        _stack[sp - 1] = a;
+        break;
+    }
+  }
+}
+
+uint16_t LedEffectVM::getLastFrameInstructions() {
+  return _lastFrameInstructions;
+}
+
+uint16_t LedEffectVM::getMaxFrameInstructions() {
+  return _maxFrameInstructions;
+}
+
+uint32_t LedEffectVM::getOverruns() {
+  return _overruns;
+}
+
+uint32_t LedEffectVM::getFaults() {
+  return _faults;
+}
+
+void LedEffectVM::resetStats() {
+  _lastFrameInstructions = 0;
+  _maxFrameInstructions = 0;
+  _overruns = 0;
+  _faults = 0;
+}
@@ -0,0 +1,125 @@
+#ifndef ledeffectvm_h
+#define ledeffectvm_h
+
+// ************************************************************
+// A tiny stack based bytecode interpreter for user supplied LED
+// effects. Like LEDEffects this has no Arduino dependencies, so
+// the same code runs in the host side assembler/simulator.
+//
+// The program is run once per pixel per frame. It reads the
+// frame inputs (TIME, PIXEL, ...), computes on a small stack of
+// 32 bit integers and sets the pixel colour with RGB, HSV, PAL
+// or PALV. Each frame has a fixed instruction budget, so a bad
+// effect can never hold up the main loop: a pixel which runs
+// out of budget (or faults) is left dark and counted.
+//
+// Assembler syntax, one instruction per line:
+//
+//   ; comment              label:
+//   PUSH -12               (or just the number)
+//   JMP label              JZ label      (jump if popped value is 0)
+//
+// Inputs:   TIME (phase in period 0..255), CYCLE (whole periods,
+//           low 16 bits), PIXEL (0..11), DIGIT (0..5),
+//           ZONE (0 = back light, 1 = under light), OFFSET (the
+//           standard phase offset of this pixel)
+// Maths:    ADD SUB MUL DIV MOD AND OR XOR SHL SHR MIN MAX
+//           LT GT EQ (a b -> result), SIN TRI RAND (x -> 0..255)
+//           32 bit, wrapping, and x / 0 = x % 0 = 0
+// Stack:    DUP DROP SWAP OVER
+// Output:   RGB (r g b), HSV (h s v), PAL (pos), PALV (pos v)
+//           END finishes the pixel
+// ************************************************************
+
+#include <stdint.h>
+#include "LEDEffects.h"
+
+#define LEDVM_MAX_CODE                  256   // jump targets are one byte
+#define LEDVM_STACK_SIZE                16
+#define LEDVM_FRAME_BUDGET              1536  // instructions per frame
+#define LEDVM_PIXEL_BUDGET              (LEDVM_FRAME_BUDGET / EFFECT_PIXEL_COUNT)
+
+#define LEDVM_MAX_LABELS                16
+#define LEDVM_MAX_LABEL_LEN             15
+
+// Opcodes, in the same order as the op table in LEDEffectVM.cpp
+enum {
+  LEDVM_END = 0,
+  LEDVM_PUSH,
+  LEDVM_TIME,
+  LEDVM_CYCLE,
+  LEDVM_PIXEL,
+  LEDVM_DIGIT,
+  LEDVM_ZONE,
+  LEDVM_OFFSET,
+  LEDVM_ADD,
+  LEDVM_SUB,
+  LEDVM_MUL,
+  LEDVM_DIV,
+  LEDVM_MOD,
+  LEDVM_AND,
+  LEDVM_OR,
+  LEDVM_XOR,
+  LEDVM_SHL,
+  LEDVM_SHR,
+  LEDVM_MIN,
+  LEDVM_MAX,
+  LEDVM_LT,
+  LEDVM_GT,
+  LEDVM_EQ,
+  LEDVM_SIN,
+  LEDVM_TRI,
+  LEDVM_RAND,
+  LEDVM_DUP,
+  LEDVM_DROP,
+  LEDVM_SWAP,
+  LEDVM_OVER,
+  LEDVM_JMP,
+  LEDVM_JZ,
+  LEDVM_RGB,
+  LEDVM_HSV,
+  LEDVM_PAL,
+  LEDVM_PALV,
+  LEDVM_OP_COUNT
+};
+
+class LedEffectVM
+{
+  public:
+    // Assemble source text and load the result. On failure the
+    // previously loaded program is kept and error is filled in.
+    bool assemble(const char *source, char *error, uint16_t errorSize);
+
+    // Check and load a bytecode program
+    bool load(const uint8_t *code, uint16_t length, char *error, uint16_t errorSize);
+
+    bool isLoaded();
+    const uint8_t* getCode();
+    uint16_t getCodeLength();
+
+    // Run the program for each pixel of one frame
+    void render(uint8_t phase, uint32_t cycle, const led_palette_t *palette, rgb_t *pixels);
+
+    // Statistics
+    uint16_t getLastFrameInstructions();
+    uint16_t getMaxFrameInstructions();
+    uint32_t getOverruns();
+    uint32_t getFaults();
+    void resetStats();
+
+  private:
+    uint8_t _code[LEDVM_MAX_CODE];
+    uint16_t _codeLength = 0;
+    bool _loaded = false;
+
+    int32_t _stack[LEDVM_STACK_SIZE];
+
+    uint16_t _lastFrameInstructions = 0;
+    uint16_t _maxFrameInstructions = 0;
+    uint32_t _overruns = 0;
+    uint32_t _faults = 0;
+
+    uint16_t runPixel(uint8_t pixel, uint8_t phase, uint32_t cycle, const led_palette_t *palette, rgb_t *rgb);
+};
+
+#endif
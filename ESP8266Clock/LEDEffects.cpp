@@ -0,0 +1,243 @@
+#include "LEDEffects.h"
+
+// ************************************************************
+// Palettes: add new palettes to the end of the list, the index
+// is stored in the config
+// ************************************************************
+const led_palette_t LED_PALETTES[] = {
+  {"Rainbow", {{  0, 255, 255}, { 64, 255, 255}, {128, 255, 255}, {192, 255, 255}}},
+  {"Nixie",   {{ 10, 255, 255}, { 20, 240, 200}, {  4, 255, 160}, { 28, 200, 255}}},
+  {"Ocean",   {{128, 255, 255}, {150, 255, 200}, {170, 230, 255}, {110, 200, 180}}},
+  {"Forest",  {{ 70, 255, 200}, { 96, 255, 255}, { 50, 220, 180}, {110, 180, 220}}},
+  {"Sunset",  {{240, 255, 255}, {  8, 255, 255}, { 30, 255, 220}, {210, 200, 200}}},
+  {"Ice",     {{140,  40, 255}, {150, 120, 220}, {160,  60, 255}, {170, 160, 200}}},
+};
+
+const uint8_t LED_PALETTE_COUNT = sizeof(LED_PALETTES) / sizeof(LED_PALETTES[0]);
+
+// ************************************************************
+// Integer HSV -> RGB conversion, the colour wheel is split into
+// 6 regions of 43 hue steps
+// ************************************************************
+void hsvToRgb(hsv_t hsv, rgb_t *rgb) {
+  if (hsv.s == 0) {
+    rgb->r = rgb->g = rgb->b = hsv.v;
+    return;
+  }
+
+  uint8_t region = hsv.h / 43;
+  uint8_t remainder = (hsv.h - (region * 43)) * 6;
+
+  uint8_t p = (hsv.v * (255 - hsv.s)) >> 8;
+  uint8_t q = (hsv.v * (255 - ((hsv.s * remainder) >> 8))) >> 8;
+  uint8_t t = (hsv.v * (255 - ((hsv.s * (255 - remainder)) >> 8))) >> 8;
+
+  switch (region) {
+    case 0:  rgb->r = hsv.v; rgb->g = t;     rgb->b = p;     break;
+    case 1:  rgb->r = q;     rgb->g = hsv.v; rgb->b = p;     break;
+    case 2:  rgb->r = p;     rgb->g = hsv.v; rgb->b = t;     break;
+    case 3:  rgb->r = p;     rgb->g = q;     rgb->b = hsv.v; break;
+    case 4:  rgb->r = t;     rgb->g = p;     rgb->b = hsv.v; break;
+    default: rgb->r = hsv.v; rgb->g = p;     rgb->b = q;     break;
+  }
+}
+
+// ************************************************************
+// Get the palette colour at a position 0..255. We interpolate
+// in HSV between the two neighbouring stops, taking the short
+// way round the colour wheel for the hue.
+// ************************************************************
+hsv_t paletteColour(const led_palette_t *palette, uint8_t position) {
+  uint8_t segment = position >> 6;
+  int16_t frac = (position & 0x3f) << 2;
+
+  const hsv_t &from = palette->stops[segment];
+  const hsv_t &to = palette->stops[(segment + 1) % PALETTE_STOP_COUNT];
+
+  int16_t dh = (int8_t) (to.h - from.h);
+
+  hsv_t result;
+  result.h = from.h + (dh * frac) / 256;
+  result.s = from.s + ((to.s - from.s) * frac) / 256;
+  result.v = from.v + ((to.v - from.v) * frac) / 256;
+  return result;
+}
+
+// ************************************************************
+// Phase offset of each pixel: the back lights spread about one
+// turn across the digits, the under lights run half a turn
+// behind the back lights above them
+// ************************************************************
+uint8_t pixelPhaseOffset(uint8_t pixel) {
+  uint8_t digit = pixel % EFFECT_DIGIT_COUNT;
+  uint8_t offset = digit * (256 / EFFECT_DIGIT_COUNT);
+  if (pixel >= EFFECT_DIGIT_COUNT) {
+    offset += 128;
+  }
+  return offset;
+}
+
+// ************************************************************
+// Scale a colour channel by a brightness 0..255
+// ************************************************************
+uint8_t scale8(uint8_t value, uint8_t scale) {
+  return (value * (scale + 1)) >> 8;
+}
+
+// ************************************************************
+// Triangle wave 0..255..0 over one phase cycle
+// ************************************************************
+uint8_t triangle8(uint8_t phase) {
+  return (phase < 128) ? (phase << 1) : ((255 - phase) << 1);
+}
+
+// ************************************************************
+// Sine wave 0..255 over one phase cycle, centred on 128. The
+// table holds the first quarter wave.
+// ************************************************************
+static const uint8_t SIN_QUARTER[] = {
+    0,   3,   6,   9,  12,  16,  19,  22,  25,  28,  31,  34,  37,  40,  43,  46,
+   49,  51,  54,  57,  60,  63,  65,  68,  71,  73,  76,  78,  81,  83,  85,  88,
+   90,  92,  94,  96,  98, 100, 102, 104, 106, 107, 109, 111, 112, 113, 115, 116,
+  117, 118, 120, 121, 122, 122, 123, 124, 125, 125, 126, 126, 126, 127, 127, 127,
+  127,
+};
+
+uint8_t sin8(uint8_t phase) {
+  uint8_t idx = phase & 0x3f;
+  if (phase & 0x40) {
+    idx = 64 - idx;
+  }
+  return (phase & 0x80) ? 128 - SIN_QUARTER[idx] : 128 + SIN_QUARTER[idx];
+}
+
+// ************************************************************
+// Small integer hash, used to give repeatable "random" values
+// ************************************************************
+uint8_t hash8(uint32_t value) {
+  value ^= value >> 16;
+  value *= 0x7feb352d;
+  value ^= value >> 15;
+  value *= 0x846ca68b;
+  value ^= value >> 16;
+  return value & 0xff;
+}
+
+// ************************************************************
+// Effect: the palette runs across the digits
+// ************************************************************
+static void effectPaletteSweep(uint8_t phase, uint32_t cycle, const led_palette_t *palette, rgb_t *pixels) {
+  (void) cycle;
+  for (uint8_t i = 0 ; i < EFFECT_PIXEL_COUNT ; i++) {
+    hsvToRgb(paletteColour(palette, phase + pixelPhaseOffset(i)), &pixels[i]);
+  }
+}
+
+// ************************************************************
+// Effect: all digits the same colour, drifting through the
+// palette and slowly breathing
+// ************************************************************
+static void effectBreathe(uint8_t phase, uint32_t cycle, const led_palette_t *palette, rgb_t *pixels) {
+  (void) cycle;
+  hsv_t colour = paletteColour(palette, phase);
+
+  // Breathe twice per period, never going fully dark
+  uint8_t level = 64 + scale8(triangle8(phase << 1), 191);
+  colour.v = scale8(colour.v, level);
+
+  for (uint8_t i = 0 ; i < EFFECT_PIXEL_COUNT ; i++) {
+    hsvToRgb(colour, &pixels[i]);
+  }
+}
+
+// ************************************************************
+// Effect: a bright spot with a fading tail runs across the
+// digits, the under lights run the other way
+// ************************************************************
+static void effectChase(uint8_t phase, uint32_t cycle, const led_palette_t *palette, rgb_t *pixels) {
+  (void) cycle;
+  const uint16_t track = EFFECT_DIGIT_COUNT * 256;
+  uint16_t head = phase * EFFECT_DIGIT_COUNT;
+  hsv_t colour = paletteColour(palette, phase);
+
+  for (uint8_t i = 0 ; i < EFFECT_PIXEL_COUNT ; i++) {
+    uint8_t digit = i % EFFECT_DIGIT_COUNT;
+    if (i >= EFFECT_DIGIT_COUNT) {
+      digit = EFFECT_DIGIT_COUNT - 1 - digit;
+    }
+
+    // How far behind the head this digit is
+    uint16_t distance = (head + track - digit * 256) % track;
+    uint8_t level = (distance < 765) ? 255 - distance / 3 : 0;
+
+    hsv_t pixel = colour;
+    pixel.v = scale8(pixel.v, level);
+    hsvToRgb(pixel, &pixels[i]);
+  }
+}
+
+// ************************************************************
+// Effect: a dim palette background, each pixel flashes once per
+// period at a position which changes every period
+// ************************************************************
+static void effectTwinkle(uint8_t phase, uint32_t cycle, const led_palette_t *palette, rgb_t *pixels) {
+  for (uint8_t i = 0 ; i < EFFECT_PIXEL_COUNT ; i++) {
+    uint8_t flashAt = hash8((cycle << 4) | i);
+    uint8_t distance = phase - flashAt;
+
+    // flash lasts 1/8 of the period: fast rise, slower decay
+    uint8_t level = 32;
+    if (distance < 8) {
+      level = 32 + distance * 28;
+    } else if (distance < 32) {
+      level = 255 - (distance - 8) * 9;
+    }
+
+    hsv_t pixel = paletteColour(palette, flashAt);
+    pixel.v = scale8(pixel.v, level);
+    hsvToRgb(pixel, &pixels[i]);
+  }
+}
+
+// ************************************************************
+// Effects: add new effects to the end of the list, the index
+// is stored in the config
+// ************************************************************
+const led_effect_t LED_EFFECTS[] = {
+  {"Palette sweep", effectPaletteSweep},
+  {"Breathe",       effectBreathe},
+  {"Chase",         effectChase},
+  {"Twinkle",       effectTwinkle},
+};
+
+const uint8_t LED_EFFECT_COUNT = sizeof(LED_EFFECTS) / sizeof(LED_EFFECTS[0]);
+
+// ************************************************************
+// Where we are in the current period
+// ************************************************************
+void effectPhase(uint32_t nowMillis, uint32_t periodMillis, uint8_t &phase, uint32_t &cycle) {
+  if (periodMillis == 0) {
+    periodMillis = 1;
+  }
+
+  phase = ((nowMillis % periodMillis) << 8) / periodMillis;
+  cycle = nowMillis / periodMillis;
+}
+
+// ************************************************************
+// Work out where we are in the period and render the frame
+// ************************************************************
+void renderLedEffect(uint8_t effect, uint8_t palette, uint32_t nowMillis, uint32_t periodMillis, rgb_t *pixels) {
+  if (effect >= LED_EFFECT_COUNT) {
+    effect = 0;
+  }
+  if (palette >= LED_PALETTE_COUNT) {
+    palette = 0;
+  }
+
+  uint8_t phase;
+  uint32_t cycle;
+  effectPhase(nowMillis, periodMillis, phase, cycle);
+
+  LED_EFFECTS[effect].render(phase, cycle, &LED_PALETTES[palette], pixels);
+}
@@ -0,0 +1,74 @@
+#ifndef ledeffects_h
+#define ledeffects_h
+
+// ************************************************************
+// Time based LED effects. Deliberately free of any Arduino
+// dependencies so that the effects can be compiled and
+// benchmarked on the host as well as on the clock.
+//
+// An effect is a pure function of the time, the period and the
+// palette: it fills one frame of EFFECT_PIXEL_COUNT pixels and
+// keeps no state of its own, so the cost per frame is bounded
+// and the same time always gives the same frame.
+// ************************************************************
+
+#include <stdint.h>
+
+// 6 back lights followed by 6 under lights, both in digit order
+#define EFFECT_DIGIT_COUNT              6
+#define EFFECT_PIXEL_COUNT              (EFFECT_DIGIT_COUNT * 2)
+
+// Number of colour stops in a palette, spread evenly around the
+// palette position 0..255, which wraps back to the first stop
+#define PALETTE_STOP_COUNT              4
+
+typedef struct {
+  uint8_t h;    // 0..255 is one full turn of the colour wheel
+  uint8_t s;
+  uint8_t v;
+} hsv_t;
+
+typedef struct {
+  uint8_t r;
+  uint8_t g;
+  uint8_t b;
+} rgb_t;
+
+typedef struct {
+  const char *name;
+  hsv_t stops[PALETTE_STOP_COUNT];
+} led_palette_t;
+
+// Render one frame. phase is the position in the current period
+// (0..255), cycle is the number of whole periods so far.
+typedef void (*LedEffectRenderFn)(uint8_t phase, uint32_t cycle, const led_palette_t *palette, rgb_t *pixels);
+
+typedef struct {
+  const char *name;
+  LedEffectRenderFn render;
+} led_effect_t;
+
+// The compile time registries
+extern const led_effect_t LED_EFFECTS[];
+extern const uint8_t LED_EFFECT_COUNT;
+extern const led_palette_t LED_PALETTES[];
+extern const uint8_t LED_PALETTE_COUNT;
+
+// Render a frame of the given effect and palette for the time
+// nowMillis. Out of range indexes fall back to the first entry.
+void renderLedEffect(uint8_t effect, uint8_t palette, uint32_t nowMillis, uint32_t periodMillis, rgb_t *pixels);
+
+// Work out the phase (0..255) within the period and the number
+// of whole periods for the time nowMillis
+void effectPhase(uint32_t nowMillis, uint32_t periodMillis, uint8_t &phase, uint32_t &cycle);
+
+// Helpers, also used by the effects themselves
+void hsvToRgb(hsv_t hsv, rgb_t *rgb);
+hsv_t paletteColour(const led_palette_t *palette, uint8_t position);
+uint8_t pixelPhaseOffset(uint8_t pixel);
+uint8_t scale8(uint8_t value, uint8_t scale);
+uint8_t triangle8(uint8_t phase);
+uint8_t sin8(uint8_t phase);
+uint8_t hash8(uint32_t value);
+
+#endif
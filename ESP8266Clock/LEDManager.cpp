@@ -7,6 +7,9 @@ void LEDManager::setUp()
 {
   // Set up the LED output
   leds.Begin();
+
+  // Make sure that the first frame gets sent, whatever it contains
+  _outputPending = true;
 }
 
 // ************************************************************
@@ -15,6 +18,9 @@ void LEDManager::setUp()
 void LEDManager::recalculateVariables() {
   _backlightDim = (float) cc->backlightDimFactor / (float) 100;
   _underlightDim = (float) cc->extDimFactor / (float) 100;
+
+  // The useBLDim/useBLPulse flags may also have changed
+  _scaleTablesDirty = true;
 }
 
 // ************************************************************
@@ -24,7 +30,11 @@ void LEDManager::setLDRValue(unsigned int ldrValue)
 {
   if (cc->useBLDim) {
     // calculate the PWM factor, goes between current_config.minDim% and 100%
-    _ldrDimFactor = (float) ldrValue / _ldrRange;
+    float newFactor = (float) ldrValue / _ldrRange;
+    if (newFactor != _ldrDimFactor) {
+      _ldrDimFactor = newFactor;
+      _scaleTablesDirty = true;
+    }
   }
 }
 
@@ -34,6 +44,7 @@ void LEDManager::setLDRValue(unsigned int ldrValue)
 void LEDManager::setLDRRange(unsigned int ldrRange)
 {
     _ldrRange = (float) ldrRange;
+    _scaleTablesDirty = true;
 }
 
 // ************************************************************
@@ -43,7 +54,11 @@ void LEDManager::setPulseValue(unsigned int secsDelta)
 {
   if (cc->useBLPulse) {
     // Calculate the brightness factor based on the "pulse"
-    _pwmFactor = (float) secsDelta / (float) 1000.0;
+    float newFactor = (float) secsDelta / (float) 1000.0;
+    if (newFactor != _pwmFactor) {
+      _pwmFactor = newFactor;
+      _scaleTablesDirty = true;
+    }
   }
 }
 
@@ -58,7 +73,7 @@ void LEDManager::setBlanked(boolean blanked)
 // ************************************************************
 // Set back light LEDs to the same colour
 // ************************************************************
-void LEDManager::setBacklightLEDs(byte red, byte green, byte blue) {
+void LEDManager::setBacklightLEDs(uint16_t red, uint16_t green, uint16_t blue) {
   for (int i = 0 ; i < DIGIT_COUNT ; i++) {
     ledRb[i] = red;
     ledGb[i] = green;
@@ -69,7 +84,7 @@ void LEDManager::setBacklightLEDs(byte red, byte green, byte blue) {
 // ************************************************************
 // Set under light LEDs to the same colour
 // ************************************************************
-void LEDManager::setUnderlightLEDs(byte red, byte green, byte blue) {
+void LEDManager::setUnderlightLEDs(uint16_t red, uint16_t green, uint16_t blue) {
   for (int i = 0 ; i < DIGIT_COUNT ; i++) {
     ledRu[i] = red;
     ledGu[i] = green;
@@ -85,24 +100,78 @@ void LEDManager::setDayOfWeek(byte dow) {
 }
 
 // ************************************************************
-// Put the led buffers out
+// Put the led buffers out. Only pixels which have changed since
+// the last frame are written, and we only call Show() if there
+// is something to send. If the DMA is still busy with the last
+// frame we leave the output pending and try again next time
+// round rather than blocking.
 // ************************************************************
 void LEDManager::outputLEDBuffer() {
   for (int i = 0 ; i < DIGIT_COUNT ; i++) {
-    RgbColor color(ledRb[i], ledGb[i], ledBb[i]);
-    leds.SetPixelColor(i, color);
+    RgbColor color(ditherChannel(i, 0, ledRb[i]),
+                   ditherChannel(i, 1, ledGb[i]),
+                   ditherChannel(i, 2, ledBb[i]));
+    if (color != _lastSent[i]) {
+      _lastSent[i] = color;
+      leds.SetPixelColor(i, color);
+      _outputPending = true;
+    }
   }
   for (int i = 0 ; i < DIGIT_COUNT ; i++) {
-    RgbColor color(ledRu[DIGIT_COUNT - 1 - i], ledGu[DIGIT_COUNT - 1 - i], ledBu[DIGIT_COUNT - 1 - i]);
-    leds.SetPixelColor(i + DIGIT_COUNT, color);
+    RgbColor color(ditherChannel(i + DIGIT_COUNT, 0, ledRu[DIGIT_COUNT - 1 - i]),
+                   ditherChannel(i + DIGIT_COUNT, 1, ledGu[DIGIT_COUNT - 1 - i]),
+                   ditherChannel(i + DIGIT_COUNT, 2, ledBu[DIGIT_COUNT - 1 - i]));
+    if (color != _lastSent[i + DIGIT_COUNT]) {
+      _lastSent[i + DIGIT_COUNT] = color;
+      leds.SetPixelColor(i + DIGIT_COUNT, color);
+      _outputPending = true;
+    }
   }
-  leds.Show();
+
+  if (_outputPending && leds.CanShow()) {
+    leds.Show();
+    _outputPending = false;
+    _framesSent++;
+  }
+}
+
+// ************************************************************
+// Temporal dithering: reduce an 8.8 fixed point channel value to
+// 8 bits, carrying the fraction we dropped over to the next frame
+// for the same channel. Over a few frames the average output is
+// the full precision value, so low levels no longer collapse to
+// a handful of steps (or to 0).
+// ************************************************************
+byte LEDManager::ditherChannel(byte pixel, byte channel, uint16_t value) {
+  unsigned int sum = value + _ditherError[pixel][channel];
+  _ditherError[pixel][channel] = sum & 0xff;
+  return sum >> 8;
+}
+
+// ************************************************************
+// Store the number of frames sent in the last second and reset
+// ************************************************************
+void LEDManager::updateFrameStats() {
+  _lastFramesPerSec = _framesSent;
+  _framesSent = 0;
+}
+
+// ************************************************************
+// Get the number of frames we sent in the last second
+// ************************************************************
+int LEDManager::getLastFramesPerSec() {
+  return _lastFramesPerSec;
 }
 
 // ************************************************************
 // Process the options and create a new buffer
 // ************************************************************
-void LEDManager::processLedStatus() {
+void LEDManager::processLedStatus(unsigned long nowMillis) {
+  // At most one rebuild per frame, however many factors changed
+  if (_scaleTablesDirty) {
+    rebuildScaleTables();
+  }
+
   // -------------------------------- Backlights / Underlights -------------------------------
 
   if (_blanked) {
@@ -124,7 +193,7 @@ void LEDManager::processLedStatus() {
           break;
         }
       case BACKLIGHT_CYCLE: {
-          cycleColours3(colors);
+          cycleColours3(colors, nowMillis);
           setBacklightLEDs( getLEDAdjustedBL(colors[0]),
                             getLEDAdjustedBL(colors[1]),
                             getLEDAdjustedBL(colors[2]));
@@ -135,14 +204,21 @@ void LEDManager::processLedStatus() {
         }
       case BACKLIGHT_COLOUR_TIME: {
           if (!_syncColourTime) {
+            // Follow what the tubes are showing in this frame,
+            // blending the colours in step with any crossfade
             for (byte i = 0 ; i < DIGIT_COUNT ; i++) {
-              byte numVal = OutputManager::Instance().getNumberArrayIndexedValue(i);
-              ledRb[i] = getLEDAdjustedBL(colourTimeR[numVal]);
-              ledGb[i] = getLEDAdjustedBL(colourTimeG[numVal]);
-              ledBb[i] = getLEDAdjustedBL(colourTimeB[numVal]);
-              ledRu[i] = getLEDAdjustedUL(colourTimeR[numVal]);
-              ledGu[i] = getLEDAdjustedUL(colourTimeG[numVal]);
-              ledBu[i] = getLEDAdjustedUL(colourTimeB[numVal]);
+              byte fromVal = OutputManager::Instance().getFadeFromValue(i) % 10;
+              byte toVal = OutputManager::Instance().getFadeToValue(i) % 10;
+              byte progress = OutputManager::Instance().getFadeProgress(i);
+              byte red = blendChannel(colourTimeR, fromVal, toVal, progress);
+              byte grn = blendChannel(colourTimeG, fromVal, toVal, progress);
+              byte blu = blendChannel(colourTimeB, fromVal, toVal, progress);
+              ledRb[i] = getLEDAdjustedBL(red);
+              ledGb[i] = getLEDAdjustedBL(grn);
+              ledBb[i] = getLEDAdjustedBL(blu);
+              ledRu[i] = getLEDAdjustedUL(red);
+              ledGu[i] = getLEDAdjustedUL(grn);
+              ledBu[i] = getLEDAdjustedUL(blu);
             }
           }
           break;
@@ -156,112 +232,208 @@ void LEDManager::processLedStatus() {
                             getLEDAdjustedUL(dayOfWeekB[_dow]));
           break;
         }
+      case BACKLIGHT_EFFECT: {
+          renderLedEffect(cc->ledEffect, cc->ledPalette, nowMillis, cc->cycleSpeed * EFFECT_PERIOD_MS_PER_SPEED, _effectPixels);
+          setLEDsFromEffectPixels();
+          break;
+        }
+      case BACKLIGHT_CUSTOM: {
+          byte palette = (cc->ledPalette < LED_PALETTE_COUNT) ? cc->ledPalette : 0;
+          uint8_t phase;
+          uint32_t cycle;
+          effectPhase(nowMillis, cc->cycleSpeed * EFFECT_PERIOD_MS_PER_SPEED, phase, cycle);
+          _customEffect.render(phase, cycle, &LED_PALETTES[palette], _effectPixels);
+          setLEDsFromEffectPixels();
+          break;
+        }
     }
   }
+}
 
+// ************************************************************
+// Send the buffer prepared by processLedStatus()
+// ************************************************************
+void LEDManager::commitLEDs() {
   outputLEDBuffer();
 }
 
+// ************************************************************
+// Blend between the colour table entries for two digit values,
+// progress 0 = all "from", 255 = all "to"
+// ************************************************************
+byte LEDManager::blendChannel(const byte *table, byte from, byte to, byte progress) {
+  int fromVal = table[from];
+  int toVal = table[to];
+  return fromVal + ((toVal - fromVal) * progress) / 255;
+}
+
+// ************************************************************
+// Copy a frame from the effect engine into the led buffers, the
+// first half are the back lights, the second the under lights
+// ************************************************************
+void LEDManager::setLEDsFromEffectPixels() {
+  for (byte i = 0 ; i < DIGIT_COUNT ; i++) {
+    ledRb[i] = getLEDAdjustedBL(_effectPixels[i].r);
+    ledGb[i] = getLEDAdjustedBL(_effectPixels[i].g);
+    ledBb[i] = getLEDAdjustedBL(_effectPixels[i].b);
+    ledRu[i] = getLEDAdjustedUL(_effectPixels[i + DIGIT_COUNT].r);
+    ledGu[i] = getLEDAdjustedUL(_effectPixels[i + DIGIT_COUNT].g);
+    ledBu[i] = getLEDAdjustedUL(_effectPixels[i + DIGIT_COUNT].b);
+  }
+}
+
+// ************************************************************
+// Assemble and load an uploaded effect
+// ************************************************************
+boolean LEDManager::loadCustomEffect(String source, String &error) {
+  char errorBuffer[80];
+  if (_customEffect.assemble(source.c_str(), errorBuffer, sizeof(errorBuffer))) {
+    return true;
+  }
+  error = errorBuffer;
+  return false;
+}
+
+// ************************************************************
+// Access to the uploaded effect, for the stats
+// ************************************************************
+LedEffectVM& LEDManager::getCustomEffect() {
+  return _customEffect;
+}
+
 // ************************************************************
 // output a PWM LED channel, adjusting for dimming, PWM
 // and user back light brightness
 // ************************************************************
-byte LEDManager::getLEDAdjustedBL(byte rawValue) {
-  byte dimmedPWMVal;
-  if (cc->useBLDim) {
-    if (cc->useBLPulse) {
-      dimmedPWMVal = (byte)(rawValue * _pwmFactor * _backlightDim * _ldrDimFactor);
-    } else {
-      dimmedPWMVal = (byte)(rawValue * _backlightDim * _ldrDimFactor);
-    }
-  } else {
-    if (cc->useBLPulse) {
-      dimmedPWMVal = (byte)(rawValue * _pwmFactor * _backlightDim);
-    } else {
-      dimmedPWMVal = (byte)(rawValue * _backlightDim);
-    }
-  }
-  return dim_curve[dimmedPWMVal];
+uint16_t LEDManager::getLEDAdjustedBL(byte rawValue) {
+  return _blScaleTable[rawValue];
 }
 
 // ************************************************************
 // output a PWM LED channel, adjusting for dimming, PWM
 // and user under light brightness
 // ************************************************************
-byte LEDManager::getLEDAdjustedUL(byte rawValue) {
-  byte dimmedPWMVal;
+uint16_t LEDManager::getLEDAdjustedUL(byte rawValue) {
+  return _ulScaleTable[rawValue];
+}
+
+// ************************************************************
+// Work out the combined brightness factor for each zone and
+// fold it, together with the dim curve, into the output tables
+// ************************************************************
+void LEDManager::rebuildScaleTables() {
+  float commonFactor = 1.0;
   if (cc->useBLDim) {
-    if (cc->useBLPulse) {
-      dimmedPWMVal = (byte)(rawValue * _pwmFactor * _underlightDim * _ldrDimFactor);
-    } else {
-      dimmedPWMVal = (byte)(rawValue * _underlightDim * _ldrDimFactor);
-    }
-  } else {
-    if (cc->useBLPulse) {
-      dimmedPWMVal = (byte)(rawValue * _pwmFactor * _underlightDim);
-    } else {
-      dimmedPWMVal = (byte)(rawValue * _underlightDim);
-    }
+    commonFactor *= _ldrDimFactor;
+  }
+  if (cc->useBLPulse) {
+    commonFactor *= _pwmFactor;
   }
-  return dim_curve[dimmedPWMVal];
+
+  buildScaleTable(_blScaleTable, commonFactor * _backlightDim, _blScaleFactorFP);
+  buildScaleTable(_ulScaleTable, commonFactor * _underlightDim, _ulScaleFactorFP);
+  _scaleTablesDirty = false;
 }
 
 // ************************************************************
-// Colour cycling 3: one colour dominates
+// Fill a 256 entry table: raw channel value -> 8.8 fixed point
+// output value, interpolating the fine dim curve so that we keep
+// the fraction for dithering.
+// Skipped if the factor has not changed at table resolution.
 // ************************************************************
-void LEDManager::cycleColours3(int colors[3]) {
-  _cycleCount++;
-  if (_cycleCount > cc->cycleSpeed) {
-    _cycleCount = 0;
+void LEDManager::buildScaleTable(uint16_t *table, float factor, unsigned int &lastFactorFP) {
+  if (factor > 1.0) factor = 1.0;
+  if (factor < 0.0) factor = 0.0;
+
+  // Fixed point factor 0..256, so that the loop is integer only
+  unsigned int factorFP = (unsigned int) (factor * 256.0);
+  if (factorFP == lastFactorFP) {
+    return;
+  }
+  lastFactorFP = factorFP;
 
-    if (changeSteps == 0) {
-      changeSteps = random(256);
-      currentColour = random(3);
+  for (int rawValue = 0 ; rawValue < 256 ; rawValue++) {
+    unsigned int scaled = rawValue * factorFP;
+    byte idx = scaled >> 8;
+    byte frac = scaled & 0xff;
+    uint16_t value = dim_curve_fine[idx];
+    if (idx < 255) {
+      value += ((dim_curve_fine[idx + 1] - value) * frac) >> 8;
     }
+    table[rawValue] = value;
+  }
+}
 
-    changeSteps--;
+// ************************************************************
+// Colour cycling 3: one colour dominates. Steps are driven by
+// the clock, not by the loop rate, catching up on any steps we
+// missed if the loop was held up
+// ************************************************************
+void LEDManager::cycleColours3(int colors[3], unsigned long nowMillis) {
+  unsigned long stepMillis = (cc->cycleSpeed + 1) * CYCLE_STEP_MS_PER_SPEED;
 
-    switch (currentColour) {
-      case 0:
-        if (colors[0] < 255) {
-          colors[0]++;
-          if (colors[1] > 0) {
-            colors[1]--;
-          }
-          if (colors[2] > 0) {
-            colors[2]--;
-          }
-        } else {
-          changeSteps = 0;
+  // Don't try to catch up after a long stall, just carry on
+  if ((nowMillis - _lastCycleStepMillis) > (stepMillis * 16)) {
+    _lastCycleStepMillis = nowMillis - stepMillis;
+  }
+
+  while ((nowMillis - _lastCycleStepMillis) >= stepMillis) {
+    _lastCycleStepMillis += stepMillis;
+    cycleColours3Step(colors);
+  }
+}
+
+// ************************************************************
+// Take one step of colour cycling 3
+// ************************************************************
+void LEDManager::cycleColours3Step(int colors[3]) {
+  if (changeSteps == 0) {
+    changeSteps = random(256);
+    currentColour = random(3);
+  }
+
+  changeSteps--;
+
+  switch (currentColour) {
+    case 0:
+      if (colors[0] < 255) {
+        colors[0]++;
+        if (colors[1] > 0) {
+          colors[1]--;
         }
-        break;
-      case 1:
-        if (colors[1] < 255) {
-          colors[1]++;
-          if (colors[0] > 0) {
-            colors[0]--;
-          }
-          if (colors[2] > 0) {
-            colors[2]--;
-          }
-        } else {
-          changeSteps = 0;
+        if (colors[2] > 0) {
+          colors[2]--;
         }
-        break;
-      case 2:
-        if (colors[2] < 255) {
-          colors[2]++;
-          if (colors[0] > 0) {
-            colors[0]--;
-          }
-          if (colors[1] > 0) {
-            colors[1]--;
-          }
-        } else {
-          changeSteps = 0;
+      } else {
+        changeSteps = 0;
+      }
+      break;
+    case 1:
+      if (colors[1] < 255) {
+        colors[1]++;
+        if (colors[0] > 0) {
+          colors[0]--;
         }
-        break;
-    }
+        if (colors[2] > 0) {
+          colors[2]--;
+        }
+      } else {
+        changeSteps = 0;
+      }
+      break;
+    case 2:
+      if (colors[2] < 255) {
+        colors[2]++;
+        if (colors[0] > 0) {
+          colors[0]--;
+        }
+        if (colors[1] > 0) {
+          colors[1]--;
+        }
+      } else {
+        changeSteps = 0;
+      }
+      break;
   }
 }
 
@@ -277,38 +449,28 @@ void LEDManager::setSyncColourTime(boolean value) {
 void LEDManager::setDiagnosticLED(byte stepNumber, byte state) {
   for (int i = 0 ; i < DIGIT_COUNT ; i++) {
     if (i > stepNumber) {
-      ledRb[i] = ledGb[i] = ledBb[i] = ledRu[i] = ledGu[i] = ledBu[i] = 0x1f;
+      setDiagnosticPixel(i, 0x1f, 0x1f, 0x1f);
     } else if (i == stepNumber) {
       if (state == STATUS_RED) {
-        ledRb[i] = 0xff;
-        ledGb[i] = 0;
-        ledBb[i] = 0;
-        ledRu[i] = 0xff;
-        ledGu[i] = 0;
-        ledBu[i] = 0;
+        setDiagnosticPixel(i, 0xff, 0, 0);
       } else if (state == STATUS_YELLOW) {
-        ledRb[i] = 0xff;
-        ledGb[i] = 0x7f;
-        ledBb[i] = 0x0f;
-        ledRu[i] = 0xff;
-        ledGu[i] = 0x7f;
-        ledBu[i] = 0x0f;
+        setDiagnosticPixel(i, 0xff, 0x7f, 0x0f);
       } else if (state == STATUS_GREEN) {
-        ledRb[i] = 0;
-        ledGb[i] = 0xff;
-        ledBb[i] = 0;
-        ledRu[i] = 0;
-        ledGu[i] = 0xff;
-        ledBu[i] = 0;
+        setDiagnosticPixel(i, 0, 0xff, 0);
       } else if (state == STATUS_BLUE) {
-        ledRb[i] = 0;
-        ledGb[i] = 0;
-        ledBb[i] = 0xff;
-        ledRu[i] = 0;
-        ledGu[i] = 0;
-        ledBu[i] = 0xff;
+        setDiagnosticPixel(i, 0, 0, 0xff);
       }
     }
   }
   outputLEDBuffer();
 }
+
+// ************************************************************
+// Set the back light and under light of one digit to a raw
+// (undimmed) diagnostic colour
+// ************************************************************
+void LEDManager::setDiagnosticPixel(byte pixel, byte red, byte green, byte blue) {
+  ledRb[pixel] = ledRu[pixel] = red << 8;
+  ledGb[pixel] = ledGu[pixel] = green << 8;
+  ledBb[pixel] = ledBu[pixel] = blue << 8;
+}
@@ -5,6 +5,8 @@
 #include <NeoPixelBus.h>        // https://github.com/Makuna/NeoPixelBus (Makuna 2.3.4)
 #include "SPIFFS.h"
 #include "OutputManagerMicrochip6.h"
+#include "LEDEffects.h"
+#include "LEDEffectVM.h"
 
 // --------------------------- Strategy Backlights -------------------------------
 #define BACKLIGHT_MIN                   0
@@ -12,7 +14,9 @@
 #define BACKLIGHT_CYCLE                 1  // cycle through random colours, strategy 3
 #define BACKLIGHT_COLOUR_TIME           2  // use "ColourTime" - different colours for each digit value
 #define BACKLIGHT_DAY_OF_WEEK           3  // use "ColourTime" - different colours for each digit value
-#define BACKLIGHT_MAX                   3
+#define BACKLIGHT_EFFECT                4  // time based effect from the effect engine, using a palette
+#define BACKLIGHT_CUSTOM                5  // uploaded bytecode effect, using a palette
+#define BACKLIGHT_MAX                   5
 #define BACKLIGHT_DEFAULT               1
 
 // -------------------------------------------------------------------------------
@@ -20,6 +24,11 @@
 #define CYCLE_SPEED_MAX                 64
 #define CYCLE_SPEED_DEFAULT             10
 
+// Cycle speed -> time: one colour step every (cycleSpeed + 1) * 10mS
+// in cycle mode, one effect period every cycleSpeed * 500mS
+#define CYCLE_STEP_MS_PER_SPEED         10
+#define EFFECT_PERIOD_MS_PER_SPEED      500
+
 // -------------------------------------------------------------------------------
 #define COLOUR_CNL_MAX                  15
 #define COLOUR_RED_CNL_DEFAULT          15
@@ -62,8 +71,22 @@ class LEDManager
     // recalculate internal values based on the LDR reading
     void setDayOfWeek(byte dow);
 
-    // This processes the values and outputs the buffer
-    void processLedStatus();
+    // This processes the values and prepares the buffer
+    void processLedStatus(unsigned long nowMillis);
+
+    // Output the prepared buffer, called at the frame commit point
+    void commitLEDs();
+
+    // Assemble and load an uploaded effect, the old one is kept
+    // if there is an error
+    boolean loadCustomEffect(String source, String &error);
+    LedEffectVM& getCustomEffect();
+
+    // Roll the frame counter over, called once per second
+    void updateFrameStats();
+
+    // The number of LED frames actually sent in the last second
+    int getLastFramesPerSec();
 
   private:
     float _backlightDim = 1.0;
@@ -73,7 +96,7 @@ class LEDManager
     float _pwmFactor = 1.0;
     boolean _blanked = false;
     byte _ledMode = BACKLIGHT_DEFAULT;
-    byte _cycleCount = 0;
+    unsigned long _lastCycleStepMillis = 0;
     byte _cycleSpeed = CYCLE_SPEED_DEFAULT;
     boolean _syncColourTime = false;
     byte _dow = 0;
@@ -86,22 +109,50 @@ class LEDManager
     int colors[3];
     byte cycleCount = 0;
 
-    // Back lights
-    byte ledRb[DIGIT_COUNT];
-    byte ledGb[DIGIT_COUNT];
-    byte ledBb[DIGIT_COUNT];
-
-    // Under lights
-    byte ledRu[DIGIT_COUNT];
-    byte ledGu[DIGIT_COUNT];
-    byte ledBu[DIGIT_COUNT];
-
-    void setBacklightLEDs(byte red, byte green, byte blue);
-    void setUnderlightLEDs(byte red, byte green, byte blue);
+    // Back lights, 8.8 fixed point (value * 256)
+    uint16_t ledRb[DIGIT_COUNT];
+    uint16_t ledGb[DIGIT_COUNT];
+    uint16_t ledBb[DIGIT_COUNT];
+
+    // Under lights, 8.8 fixed point (value * 256)
+    uint16_t ledRu[DIGIT_COUNT];
+    uint16_t ledGu[DIGIT_COUNT];
+    uint16_t ledBu[DIGIT_COUNT];
+
+    // One frame from the effect engine or the uploaded effect
+    rgb_t _effectPixels[EFFECT_PIXEL_COUNT];
+    LedEffectVM _customEffect;
+
+    // Temporal dithering: the fraction we still owe each channel
+    byte _ditherError[DIGIT_COUNT * 2][3];
+
+    // Combined brightness output tables, rebuilt only when one of
+    // the factors changes
+    uint16_t _blScaleTable[256];
+    uint16_t _ulScaleTable[256];
+    unsigned int _blScaleFactorFP = 0xffff;
+    unsigned int _ulScaleFactorFP = 0xffff;
+    boolean _scaleTablesDirty = true;
+
+    // The last colours we pushed out, so that we only send changes
+    RgbColor _lastSent[DIGIT_COUNT * 2];
+    boolean _outputPending = true;
+    int _framesSent = 0;
+    int _lastFramesPerSec = 0;
+
+    void setBacklightLEDs(uint16_t red, uint16_t green, uint16_t blue);
+    void setUnderlightLEDs(uint16_t red, uint16_t green, uint16_t blue);
+    void setDiagnosticPixel(byte pixel, byte red, byte green, byte blue);
+    void setLEDsFromEffectPixels();
+    byte blendChannel(const byte *table, byte from, byte to, byte progress);
     void outputLEDBuffer();
-    byte getLEDAdjustedBL(byte rawValue);
-    byte getLEDAdjustedUL(byte rawValue);
-    void cycleColours3(int colors[3]);
+    byte ditherChannel(byte pixel, byte channel, uint16_t value);
+    uint16_t getLEDAdjustedBL(byte rawValue);
+    uint16_t getLEDAdjustedUL(byte rawValue);
+    void rebuildScaleTables();
+    void buildScaleTable(uint16_t *table, float factor, unsigned int &lastFactorFP);
+    void cycleColours3(int colors[3], unsigned long nowMillis);
+    void cycleColours3Step(int colors[3]);
 };
 
 // ************************************************************
@@ -126,6 +177,32 @@ const byte dim_curve[] = {
   193, 196, 200, 203, 207, 211, 214, 218, 222, 226, 230, 234, 238, 242, 248, 255,
 };
 
+// ************************************************************
+// The same curve with 8 bits of fraction (value * 256), used to
+// carry sub-LSB brightness into the temporal dithering. It is a
+// smoothed fit of the curve rather than dim_curve * 256: it is
+// always within 0.65 of dim_curve, but rounding it does not give
+// dim_curve back everywhere (e.g. index 3 is 1.375, not 2).
+// ************************************************************
+const uint16_t dim_curve_fine[] = {
+      0,   171,   288,   352,   416,   480,   525,   550,   576,   602,   627,   653,   678,   704,   730,   755,
+    778,   798,   817,   837,   857,   876,   896,   916,   935,   955,   975,   994,  1014,  1036,  1059,  1082,
+   1105,  1129,  1152,  1175,  1199,  1222,  1245,  1268,  1294,  1323,  1351,  1380,  1408,  1436,  1465,  1493,
+   1522,  1553,  1587,  1621,  1655,  1690,  1724,  1758,  1792,  1831,  1871,  1910,  1950,  1989,  2028,  2069,
+   2112,  2155,  2197,  2240,  2283,  2327,  2374,  2420,  2467,  2513,  2560,  2611,  2662,  2714,  2765,  2816,
+   2867,  2918,  2970,  3021,  3072,  3129,  3186,  3243,  3300,  3360,  3424,  3488,  3552,  3621,  3694,  3767,
+   3840,  3913,  3986,  4059,  4133,  4206,  4279,  4352,  4437,  4523,  4608,  4693,  4779,  4864,  4949,  5035,
+   5120,  5222,  5325,  5427,  5530,  5632,  5734,  5837,  5952,  6080,  6195,  6298,  6400,  6502,  6605,  6720,
+   6848,  6976,  7104,  7232,  7360,  7488,  7616,  7765,  7936,  8107,  8256,  8384,  8533,  8704,  8875,  9024,
+   9152,  9301,  9472,  9643,  9813,  9984, 10155, 10325, 10496, 10752, 10923, 11093, 11264, 11520, 11776, 12032,
+  12203, 12373, 12544, 12800, 13056, 13312, 13568, 13824, 14080, 14336, 14592, 14848, 15104, 15360, 15616, 15872,
+  16128, 16384, 16640, 16896, 17408, 17664, 17920, 18176, 18688, 18944, 19200, 19456, 19968, 20224, 20736, 20992,
+  21248, 21760, 22016, 22528, 23040, 23296, 23808, 24064, 24576, 25088, 25344, 25856, 26368, 26880, 27392, 27904,
+  28160, 28672, 29184, 29696, 30208, 30976, 31488, 32000, 32512, 33024, 33792, 34304, 34816, 35584, 36096, 36864,
+  37376, 38144, 38656, 39424, 40192, 40704, 41472, 42240, 43008, 43776, 44544, 45312, 46080, 46848, 47616, 48640,
+  49408, 50176, 51200, 51968, 52992, 54016, 54784, 55808, 56832, 57856, 58880, 59904, 60928, 61952, 63488, 65280,
+};
+
 const byte rgb_backlight_curve[] = {0, 16, 32, 48, 64, 80, 99, 112, 128, 144, 160, 176, 192, 216, 240, 255};
 
 // Used to define "colourTime" colours
@@ -0,0 +1,96 @@
+#include "LoopProfiler.h"
+
+static const char* const PROFILE_STAGE_NAMES[PROFILE_STAGE_COUNT] = {
+  "HTTP server",
+  "mDNS",
+  "Button",
+  "Modes",
+  "Display output",
+  "LED output",
+  "Frame commit",
+  "LDR"
+};
+
+// ************************************************************
+// Record one run of a stage, overwriting the oldest sample
+// ************************************************************
+void LoopProfiler::addSample(byte stage, uint32_t cycles) {
+  if (stage >= PROFILE_STAGE_COUNT) {
+    return;
+  }
+
+  _samples[stage][_nextSample[stage]] = cycles;
+  _nextSample[stage]++;
+  if (_nextSample[stage] >= PROFILER_WINDOW) {
+    _nextSample[stage] = 0;
+  }
+
+  if (_sampleCount[stage] < PROFILER_WINDOW) {
+    _sampleCount[stage]++;
+  }
+  _totalSamples[stage]++;
+}
+
+// ************************************************************
+// Work out the stats over the current window. Only done when
+// the report is asked for, so we can afford to sort a copy.
+// ************************************************************
+void LoopProfiler::getStats(byte stage, profile_stats_t *stats) {
+  stats->min = 0;
+  stats->avg = 0;
+  stats->max = 0;
+  stats->p99 = 0;
+  stats->samples = 0;
+
+  if ((stage >= PROFILE_STAGE_COUNT) || (_sampleCount[stage] == 0)) {
+    return;
+  }
+
+  uint16_t count = _sampleCount[stage];
+  uint32_t sorted[PROFILER_WINDOW];
+  uint64_t total = 0;
+
+  // insertion sort, the window is small
+  for (uint16_t i = 0 ; i < count ; i++) {
+    uint32_t value = _samples[stage][i];
+    total += value;
+
+    int j = i - 1;
+    while ((j >= 0) && (sorted[j] > value)) {
+      sorted[j + 1] = sorted[j];
+      j--;
+    }
+    sorted[j + 1] = value;
+  }
+
+  stats->min = sorted[0];
+  stats->avg = total / count;
+  stats->max = sorted[count - 1];
+  stats->p99 = sorted[((uint32_t) count * 99 + 99) / 100 - 1];
+  stats->samples = count;
+}
+
+const char* LoopProfiler::getStageName(byte stage) {
+  if (stage >= PROFILE_STAGE_COUNT) {
+    return "";
+  }
+  return PROFILE_STAGE_NAMES[stage];
+}
+
+unsigned long LoopProfiler::getTotalSamples(byte stage) {
+  if (stage >= PROFILE_STAGE_COUNT) {
+    return 0;
+  }
+  return _totalSamples[stage];
+}
+
+// ************************************************************
+// Throw away all of the samples
+// ************************************************************
+void LoopProfiler::reset() {
+  for (byte i = 0 ; i < PROFILE_STAGE_COUNT ; i++) {
+    _nextSample[i] = 0;
+    _sampleCount[i] = 0;
+    _totalSamples[i] = 0;
+  }
+}
@@ -0,0 +1,54 @@
+#ifndef loopprofiler_h
+#define loopprofiler_h
+
+#include "Arduino.h"
+
+// ************************************************************
+// Per stage timing of the main loop. Each stage keeps the CPU
+// cycle counts of its last PROFILER_WINDOW runs in a ring, and
+// reports min / avg / max / 99th percentile over that window.
+//
+// Only included when FEATURE_PROFILER is on, use the
+// PROFILE_START / PROFILE_END macros in the sketch.
+// ************************************************************
+
+#define PROFILER_WINDOW                 100
+
+// Loop stages we time
+#define PROFILE_HTTP                    0
+#define PROFILE_MDNS                    1
+#define PROFILE_BUTTON                  2
+#define PROFILE_MODES                   3
+#define PROFILE_DISPLAY                 4
+#define PROFILE_LEDS                    5
+#define PROFILE_COMMIT                  6
+#define PROFILE_LDR                     7
+#define PROFILE_STAGE_COUNT             8
+
+typedef struct {
+  uint32_t min;
+  uint32_t avg;
+  uint32_t max;
+  uint32_t p99;
+  uint16_t samples;
+} profile_stats_t;
+
+class LoopProfiler
+{
+  public:
+    void addSample(byte stage, uint32_t cycles);
+    void getStats(byte stage, profile_stats_t *stats);
+    const char* getStageName(byte stage);
+    unsigned long getTotalSamples(byte stage);
+    void reset();
+
+  private:
+    uint32_t _samples[PROFILE_STAGE_COUNT][PROFILER_WINDOW];
+    byte _nextSample[PROFILE_STAGE_COUNT];
+    uint16_t _sampleCount[PROFILE_STAGE_COUNT];
+    unsigned long _totalSamples[PROFILE_STAGE_COUNT];
+};
+
+static LoopProfiler profiler;
+
+#endif
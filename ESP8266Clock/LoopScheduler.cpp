@@ -0,0 +1,161 @@
+#include "LoopScheduler.h"
+#include <limits.h>
+
+// ************************************************************
+// Add a task. The first run is on the next pass.
+// ************************************************************
+int LoopScheduler::addTask(const char *name, SchedulerTask task, unsigned long periodMillis) {
+  if (_taskCount >= SCHEDULER_MAX_TASKS) {
+    return -1;
+  }
+
+  scheduler_task_t *t = &_tasks[_taskCount];
+  t->name = name;
+  t->task = task;
+  t->periodMillis = periodMillis;
+  t->nextRunMillis = millis();
+  t->runs = 0;
+  t->overruns = 0;
+  t->suspended = false;
+
+  return _taskCount++;
+}
+
+// ************************************************************
+// One pass of the main loop: run the due tasks, and if nothing
+// else is due straight away, give up a slice of idle time
+// ************************************************************
+void LoopScheduler::run() {
+  unsigned long startMicros = micros();
+  unsigned long waitMillis = runDueTasks(millis());
+  _busyMicros += micros() - startMicros;
+
+  if (waitMillis > 0) {
+    delay((waitMillis < _idleSliceMillis) ? waitMillis : _idleSliceMillis);
+  }
+}
+
+// ************************************************************
+// Run every task whose deadline has passed and work out how
+// long it is until the next deadline
+// ************************************************************
+unsigned long LoopScheduler::runDueTasks(unsigned long nowMillis) {
+  for (byte i = 0 ; i < _taskCount ; i++) {
+    scheduler_task_t *t = &_tasks[i];
+    if (t->suspended) {
+      continue;
+    }
+
+    if (t->periodMillis == 0) {
+      t->task(nowMillis);
+      t->runs++;
+    } else if ((long) (nowMillis - t->nextRunMillis) >= 0) {
+      t->task(nowMillis);
+      t->runs++;
+
+      t->nextRunMillis += t->periodMillis;
+      if ((long) (nowMillis - t->nextRunMillis) >= 0) {
+        // We missed at least one whole period, start again from now
+        t->overruns++;
+        t->nextRunMillis = nowMillis + t->periodMillis;
+      }
+    }
+  }
+
+  unsigned long afterMillis = millis();
+  unsigned long waitMillis = ULONG_MAX;
+  for (byte i = 0 ; i < _taskCount ; i++) {
+    scheduler_task_t *t = &_tasks[i];
+    if (t->suspended || (t->periodMillis == 0)) {
+      continue;
+    }
+
+    long untilDue = (long) (t->nextRunMillis - afterMillis);
+    if (untilDue <= 0) {
+      return 0;
+    }
+    if ((unsigned long) untilDue < waitMillis) {
+      waitMillis = untilDue;
+    }
+  }
+
+  return waitMillis;
+}
+
+// ************************************************************
+// Make the task due now
+// ************************************************************
+void LoopScheduler::trigger(int taskId) {
+  if ((taskId >= 0) && (taskId < _taskCount)) {
+    _tasks[taskId].nextRunMillis = millis();
+  }
+}
+
+void LoopScheduler::suspend(int taskId) {
+  if ((taskId >= 0) && (taskId < _taskCount)) {
+    _tasks[taskId].suspended = true;
+  }
+}
+
+void LoopScheduler::resume(int taskId) {
+  if ((taskId >= 0) && (taskId < _taskCount) && _tasks[taskId].suspended) {
+    _tasks[taskId].suspended = false;
+    _tasks[taskId].nextRunMillis = millis();
+  }
+}
+
+// ************************************************************
+// Change the period, the next run is one new period from now
+// ************************************************************
+void LoopScheduler::setPeriod(int taskId, unsigned long periodMillis) {
+  if ((taskId >= 0) && (taskId < _taskCount)) {
+    _tasks[taskId].periodMillis = periodMillis;
+    _tasks[taskId].nextRunMillis = millis() + periodMillis;
+  }
+}
+
+void LoopScheduler::setIdleSlice(unsigned long idleSliceMillis) {
+  _idleSliceMillis = (idleSliceMillis > 0) ? idleSliceMillis : 1;
+}
+
+// ************************************************************
+// Work out how busy we were since the last call
+// ************************************************************
+void LoopScheduler::updateStats() {
+  unsigned long nowMicros = micros();
+  unsigned long elapsedMicros = nowMicros - _statsStartMicros;
+  if (elapsedMicros > 0) {
+    unsigned long busyPercent = (unsigned long) (((unsigned long long) _busyMicros * 100) / elapsedMicros);
+    _lastBusyPercent = (busyPercent > 100) ? 100 : busyPercent;
+  }
+  _busyMicros = 0;
+  _statsStartMicros = nowMicros;
+}
+
+byte LoopScheduler::getTaskCount() {
+  return _taskCount;
+}
+
+const char* LoopScheduler::getTaskName(byte taskId) {
+  return _tasks[taskId].name;
+}
+
+unsigned long LoopScheduler::getTaskRuns(byte taskId) {
+  return _tasks[taskId].runs;
+}
+
+unsigned long LoopScheduler::getTaskOverruns(byte taskId) {
+  return _tasks[taskId].overruns;
+}
+
+unsigned long LoopScheduler::getTotalOverruns() {
+  unsigned long total = 0;
+  for (byte i = 0 ; i < _taskCount ; i++) {
+    total += _tasks[i].overruns;
+  }
+  return total;
+}
+
+byte LoopScheduler::getLastBusyPercent() {
+  return _lastBusyPercent;
+}
@@ -0,0 +1,82 @@
+#ifndef loopscheduler_h
+#define loopscheduler_h
+
+#include "Arduino.h"
+
+// ************************************************************
+// Cooperative fixed rate scheduler for the main loop. Each task
+// has its own period and deadline, and is run when the deadline
+// has passed. Tasks with period 0 run on every pass. When there
+// is nothing due we hand the idle time back to the system in
+// short slices (1mS by default) instead of sleeping for a fixed
+// time.
+//
+// A task which is so late that it has missed a whole period
+// counts an overrun, and is re-synchronised rather than run
+// several times to catch up.
+// ************************************************************
+
+#define SCHEDULER_MAX_TASKS             8
+#define SCHEDULER_IDLE_SLICE_MS         1
+
+typedef void (*SchedulerTask) (unsigned long nowMillis);
+
+typedef struct {
+  const char *name;
+  SchedulerTask task;
+  unsigned long periodMillis;
+  unsigned long nextRunMillis;
+  unsigned long runs;
+  unsigned long overruns;
+  boolean suspended;
+} scheduler_task_t;
+
+class LoopScheduler
+{
+  public:
+    // Add a task, returns the task id or -1 if there is no room
+    int addTask(const char *name, SchedulerTask task, unsigned long periodMillis);
+
+    // Run everything that is due, then yield until the next deadline
+    void run();
+
+    // Run a task on the next pass, whatever its deadline
+    void trigger(int taskId);
+
+    // Stop and restart a task. A resumed task runs straight away.
+    void suspend(int taskId);
+    void resume(int taskId);
+
+    // Change the period of a task, the new period starts from now
+    void setPeriod(int taskId, unsigned long periodMillis);
+
+    // The longest we give back to the system in one go when idle
+    void setIdleSlice(unsigned long idleSliceMillis);
+
+    // Roll the busy time measurement over, called once per second
+    void updateStats();
+
+    byte getTaskCount();
+    const char* getTaskName(byte taskId);
+    unsigned long getTaskRuns(byte taskId);
+    unsigned long getTaskOverruns(byte taskId);
+    unsigned long getTotalOverruns();
+
+    // Percentage of the last second spent running tasks
+    byte getLastBusyPercent();
+
+  private:
+    scheduler_task_t _tasks[SCHEDULER_MAX_TASKS];
+    byte _taskCount = 0;
+    unsigned long _idleSliceMillis = SCHEDULER_IDLE_SLICE_MS;
+
+    unsigned long _busyMicros = 0;
+    unsigned long _statsStartMicros = 0;
+    byte _lastBusyPercent = 0;
+
+    unsigned long runDueTasks(unsigned long nowMillis);
+};
+
+static LoopScheduler scheduler;
+
+#endif
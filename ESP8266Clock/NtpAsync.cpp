@@ -5,6 +5,9 @@
 // ************************************************************
 void NtpAsync::setUp() {
   debugMsg("Set up");
+
+  // Every clock polls on its own schedule
+  _poll.setSeed(ESP.getChipId() ^ RANDOM_REG32);
   resetDefaults();
 }
 
@@ -41,6 +44,7 @@ String NtpAsync::getTZS() {
 // ************************************************************
 void NtpAsync::setUpdateInterval(int updateInterval) {
   _ntpUpdateInterval = updateInterval;
+  _poll.setMaxInterval(updateInterval);
   
   // We changed the update interval, we need to force an update
   resetNextUpdate();
@@ -58,6 +62,7 @@ int NtpAsync::getUpdateInterval() {
 // ************************************************************
 void NtpAsync::setNtpPool(String ntpPool) {
   _ntpPool = ntpPool;
+  _resolver.setHost(ntpPool);
 }
 
 // ************************************************************
@@ -68,17 +73,12 @@ String NtpAsync::getNtpPool() {
 }
 
 // ************************************************************
-// get the number of millis until the next update is due in seconds
+// get the number of seconds until the next update is due,
+// negative when it is due
 // ************************************************************
 signed int NtpAsync::getNextUpdate(unsigned long nowMillis) {
   checkMillisOverflow(nowMillis);
-  
-  // deal with the startup case - we always want to update 
-  if (_lastUpdateFromServer == 0) {
-    return -1;
-  } else {
-    return (_lastUpdateFromServer/1000 + _ntpUpdateInterval) - nowMillis/1000;
-  }
+  return _poll.getSecsToNext(nowMillis);
 }
 
 // ************************************************************
@@ -94,13 +94,42 @@ unsigned long NtpAsync::getLastUpdate() {
 // ************************************************************
 void NtpAsync::resetNextUpdate() {
   _lastUpdateFromServer = 0;
+  _poll.reset(millis());
+}
+
+// ************************************************************
+// How far out the clock was at the last update (see
+// NtpPollPolicy), this sets the poll interval
+// ************************************************************
+void NtpAsync::reportCorrection(int64_t correctionUs, bool stepped) {
+  _poll.adjust(correctionUs, _filter.getJitterUs(), stepped);
+  debugMsg("Poll interval " + String(_poll.getIntervalSecs()) + " s");
+}
+
+unsigned long NtpAsync::getPollInterval() {
+  return _poll.getIntervalSecs();
+}
+
+unsigned long NtpAsync::getPollRetries() {
+  return _poll.getRetries();
 }
 
 // ************************************************************
-// get the last time we got back
+// get the last time we got back, only formatted when asked for
 // ************************************************************
 String NtpAsync::getLastTimeFromServer() {
-  return _lastTimeFromServer;
+  if (_lastTimeFromServer.utcSecs == 0) {
+    return "";
+  }
+
+  struct tm tmLocal;
+  localtime_r(&_lastTimeFromServer.utcSecs, &tmLocal);
+
+  char timeText[32];
+  snprintf(timeText, sizeof(timeText), "%04d-%02d-%02d %02d:%02d:%02d.%03u",
+           tmLocal.tm_year + 1900, tmLocal.tm_mon + 1, tmLocal.tm_mday,
+           tmLocal.tm_hour, tmLocal.tm_min, tmLocal.tm_sec, _lastTimeFromServer.utcMicros / 1000);
+  return String(timeText);
 }
 
 // ************************************************************
@@ -118,6 +147,32 @@ long NtpAsync::getLastUpdateTimeSecs(unsigned long nowMillis) {
   return (nowMillis - _lastUpdateFromServer)/1000;
 }
 
+// ************************************************************
+// the pool addresses we know, for display
+// ************************************************************
+String NtpAsync::getServerAddresses() {
+  String result = "";
+  IPAddress address;
+  for (byte i = 0 ; _resolver.getAddress(i, address) ; i++) {
+    if (i > 0) {
+      result += ", ";
+    }
+    result += address.toString();
+  }
+  if (_resolver.isLookupActive()) {
+    result += " (looking up)";
+  }
+  return result;
+}
+
+unsigned long NtpAsync::getDnsLookups() {
+  return _resolver.getLookups();
+}
+
+unsigned long NtpAsync::getDnsFailures() {
+  return _resolver.getFailures();
+}
+
 // ************************************************************
 // set the update interval
 // ************************************************************
@@ -126,105 +181,177 @@ void NtpAsync::setDebugOutput(bool newDebug) {
 }
 
 // ************************************************************
-// Asynchronous NTP query
+// Start a burst of NTP queries to the pool servers we know. The
+// requests go out and the replies come in from loop() and the
+// UDP callback, this never waits.
 // ************************************************************
 void NtpAsync::getTimeFromNTP() {
+  if (_burstActive) {
+    return;
+  }
+
   debugMsg("Async NTP in");
 
   if (WiFi.status() != WL_CONNECTED) {
     debugMsg("WiFi not connected. Abort.");
+    _poll.pollFailed(millis());
     return;
   }
 
-  IPAddress serverIP;
-  WiFi.hostByName(_ntpPool.c_str(), serverIP);
-  String str = "NTP IPAddr: ";
-  str += serverIP.toString();
-  debugMsg(str);
-
-  byte buffer[NTP_PACKET_SIZE];
-  memset(buffer, 0, NTP_PACKET_SIZE);
-  buffer[0] = 0b11100011;   // LI, Version, Mode
-  buffer[1] = 0;            // Stratum, or type of clock
-  buffer[2] = 9;            // Polling Interval (9 = 2^9 secs = ~9 mins, close to our 10 min default)
-  buffer[3] = 0xEC;         // Peer Clock Precision
-  // 8 bytes of zero for Root Delay & Root Dispersion
-  buffer[12]  = 'X';        // "kiss code", see RFC5905
-  buffer[13]  = 'W';        // (codes starting with 'X' are not interpreted)
-  buffer[14]  = 'N';
-  buffer[15]  = 'C';
+  // Never wait for the resolver: without an address yet just
+  // start the lookup, the next attempt will have one
+  _resolver.update(millis());
+  _burstServers = _resolver.getUsableAddresses(millis(), _burstIds, NTP_MAX_SERVERS);
+  if (_burstServers == 0) {
+    debugMsg("No address for " + _ntpPool + " yet");
+    _poll.pollFailed(millis());
+    return;
+  }
+  if (!_resolver.isFresh(millis())) {
+    debugMsg("Lookups failing, using the last good addresses");
+  }
 
+  // One socket for good, replies go straight into the filter
+  if (!_session.begin(&_filter)) {
+    debugMsg("Could not open the UDP socket");
+    _poll.pollFailed(millis());
+    return;
+  }
+
+  _filter.setServers(_burstIds, _burstServers);
+  _session.cancelAll();
+  for (byte i = 0 ; i < _burstServers ; i++) {
+    _roundsSent[i] = 0;
+  }
+  _burstActive = true;
   _ntpStarted = millis();
-  debugMsg("Connect to NTP");
-  _udp.connect(serverIP, 123); //NTP requests are to port 123
-  debugMsg("Write to NTP");
-  _udp.write(buffer, NTP_PACKET_SIZE);
-  debugMsg("NTP Packet sent at " + String(_ntpStarted));
-
-  _udp.onPacket([&](AsyncUDPPacket packet) {
-    String message = "NTP response UDP Packet Type: " + packet.isBroadcast() ? "Broadcast" : packet.isMulticast() ? "Multicast" : "Unicast";
-    message += " from " + packet.remoteIP().toString() + ":" + String(packet.remotePort());
-    message += " to " + packet.localIP().toString() + ":" + String(packet.localPort());
-    debugMsg(message);
-
-    if (packet.length() != 48) {
-      debugMsg("Received data, but got invalid length: " + String(packet.length()));
-    } else {
-      uint8_t buffer[NTP_PACKET_SIZE];
-      memcpy(&buffer, packet.data(), packet.length());
-      //prepare timestamps
-      uint32_t highWord, lowWord;
-      highWord = ( buffer[16] << 8 | buffer[17] ) & 0x0000FFFF;
-      lowWord = ( buffer[18] << 8 | buffer[19] ) & 0x0000FFFF;
-      uint32_t reftsSec = highWord << 16 | lowWord;       // reference timestamp seconds
-
-      highWord = ( buffer[32] << 8 | buffer[33] ) & 0x0000FFFF;
-      lowWord = ( buffer[34] << 8 | buffer[35] ) & 0x0000FFFF;
-      uint32_t rcvtsSec = highWord << 16 | lowWord;       // receive timestamp seconds
-
-      highWord = ( buffer[40] << 8 | buffer[41] ) & 0x0000FFFF;
-      lowWord = ( buffer[42] << 8 | buffer[43] ) & 0x0000FFFF;
-      uint32_t secsSince1900 = highWord << 16 | lowWord;      // transmit timestamp seconds
-
-      highWord = ( buffer[44] << 8 | buffer[45] ) & 0x0000FFFF;
-      lowWord = ( buffer[46] << 8 | buffer[47] ) & 0x0000FFFF;
-      uint32_t fraction = highWord << 16 | lowWord;       // transmit timestamp fractions
-
-      //check if received data makes sense
-      //buffer[1] = stratum - should be 1..15 for valid reply
-      //also checking that all timestamps are non-zero and receive timestamp seconds are <= transmit timestamp seconds
-      if ((buffer[1] < 1) or (buffer[1] > 15) or (reftsSec == 0) or (rcvtsSec == 0) or (rcvtsSec > secsSince1900)) {
-        // we got invalid packet
-        debugMsg("Got data, but got INVALID_DATA");
-        return;
+  _burstEndMillis = _ntpStarted + NTP_BURST_MAX_MS;
+  loop(_ntpStarted);
+
+  debugMsg("Burst started to " + String(_burstServers) + " servers");
+}
+
+// ************************************************************
+// Pace the requests of a burst: the next one goes to a server
+// once the last one is answered or given up on, and at least
+// NTP_BURST_SPACING_MS after it. The burst is finished when all
+// the servers have had their rounds, or it has taken too long.
+// ************************************************************
+void NtpAsync::loop(unsigned long nowMillis) {
+  if (!_burstActive) {
+    return;
+  }
+
+  _session.loop(nowMillis);
+
+  bool finished = true;
+  for (byte i = 0 ; i < _burstServers ; i++) {
+    if (_session.isPending(i)) {
+      finished = false;
+    } else if (_roundsSent[i] < NTP_BURST_ROUNDS) {
+      finished = false;
+      if ((_roundsSent[i] == 0) || ((nowMillis - _lastSentMillis[i]) >= NTP_BURST_SPACING_MS)) {
+        _session.send(i, _burstIds[i], nowMillis);
+        _roundsSent[i]++;
+        _lastSentMillis[i] = nowMillis;
       }
+    }
+  }
 
-      // Set the t and measured_at variables that were passed by reference
-      unsigned long done = millis();
-      debugMsg("success round trip " + String(done - _ntpStarted) + " ms");
-      unsigned long t = secsSince1900 - 2208988800UL;                     // Subtract 70 years to get seconds since 1970
-      uint16_t ms = fraction / 4294967UL;                                 // Turn 32 bit fraction into ms by dividing by 2^32 / 1000
-      unsigned long measured_at = done - ((done - _ntpStarted) / 2) - ms;  // Assume symmetric network latency and return when we think the whole second was.
+  if (finished || ((long) (nowMillis - _burstEndMillis) >= 0)) {
+    _session.cancelAll();
+    endBurst();
+  }
+}
 
-      _lastUpdateFromServer = done;
+bool NtpAsync::isBurstActive() {
+  return _burstActive;
+}
 
-      debugMsg("_lastUpdateFromServer: " + String(_lastUpdateFromServer));
-      
-      time_t ntpTime = t;
-      const tm* tm = localtime(&ntpTime);
+// ************************************************************
+// Filter and select, and if the servers agree set the time
+// ************************************************************
+void NtpAsync::endBurst() {
+  _burstActive = false;
 
-      String timeString = String(tm->tm_year + 1900) + "," + String(tm->tm_mon + 1) + "," + String(tm->tm_mday) + "," + String(tm->tm_hour) + "," + String(tm->tm_min) + "," + String(tm->tm_sec);
-      debugMsg("NTP Update time str: " + timeString);
-      _lastTimeFromServer = timeString;
+  unsigned long done = millis();
+  if (!_filter.endBurst(micros64())) {
+    _poll.pollFailed(done);
+    debugMsg("Burst gave no time: not enough servers replied or agreed, retry in " + String(_poll.getSecsToNext(done)) + " s");
+    return;
+  }
+  _poll.pollSucceeded(done);
+  _lastUpdateFromServer = done;
+
+  // The offset is UTC - micros64(). The time goes over as it is,
+  // nothing is formatted here.
+  _lastTimeFromServer.localUs = micros64();
+  int64_t utcUs = _lastTimeFromServer.localUs + _filter.getOffsetUs();
+  _lastTimeFromServer.utcSecs = utcUs / 1000000;
+  _lastTimeFromServer.utcMicros = utcUs % 1000000;
+
+  if (_debug) {
+    debugMsg("Burst done in " + String(done - _ntpStarted) + " ms, " + String(_filter.getSurvivors()) + " servers agree, jitter " + String((long) _filter.getJitterUs()) + " uS");
+  }
 
-      // Notify the outside world that we have updated
-      if (_ntcb != NULL) {
-        _ntcb();
-      }
-    }
-  });
+  // Notify the outside world that we have updated
+  if (_ntcb != NULL) {
+    _ntcb(&_lastTimeFromServer);
+  }
+}
+
+// ************************************************************
+// Clock filter results, for display
+// ************************************************************
+bool NtpAsync::getServerStats(byte index, ntp_server_stats_t *stats) {
+  return _filter.getServer(index, stats);
+}
+
+bool NtpAsync::isOffsetValid() {
+  return _filter.isValid();
+}
+
+int64_t NtpAsync::getOffsetUs() {
+  return _filter.getOffsetUs();
+}
+
+int64_t NtpAsync::getJitterUs() {
+  return _filter.getJitterUs();
+}
+
+int64_t NtpAsync::getDelayUs() {
+  return _filter.getDelayUs();
+}
+
+unsigned long NtpAsync::getBursts() {
+  return _filter.getBursts();
+}
+
+unsigned long NtpAsync::getFailedBursts() {
+  return _filter.getFailedBursts();
+}
+
+unsigned long NtpAsync::getOutliers() {
+  return _filter.getOutliers();
+}
+
+// ************************************************************
+// Session packet counts, for display
+// ************************************************************
+unsigned long NtpAsync::getPacketsSent() {
+  return _session.getSent();
+}
+
+unsigned long NtpAsync::getPacketsReceived() {
+  return _session.getReceived();
+}
+
+unsigned long NtpAsync::getPacketsRejected() {
+  return _session.getRejected();
+}
 
-  debugMsg("Async GET Time out");
+unsigned long NtpAsync::getPacketsTimedOut() {
+  return _session.getTimedOut();
 }
 
 // ************************************************************
@@ -7,18 +7,34 @@
 //#include <AsyncUDP.h>         
 #include <ESP8266WiFi.h>
 #include <DNSServer.h>          //https://github.com/esp8266/Arduino/tree/master/libraries/DNSServer
+#include "NtpResolver.h"
+#include "NtpPacket.h"
+#include "NtpClockFilter.h"
+#include "NtpPollPolicy.h"
+#include "NtpSession.h"
 
 // ------------------------ Types ------------------------
 
 typedef void (*DebugCallback) (String);
-typedef void (*NewTimeCallback) ();
+
+// The time from a burst: UTC (seconds and microseconds) at the
+// micros64() time it was worked out for
+typedef struct {
+  time_t utcSecs;
+  uint32_t utcMicros;
+  int64_t localUs;
+} ntp_time_t;
+
+typedef void (*NewTimeCallback) (const ntp_time_t *ntpTime);
 
 // ----------------------- Defines -----------------------
 
 #define NTP_POOL_DEFAULT "pool.ntp.org"
-#define NTP_PACKET_SIZE 48
+#define NTP_BURST_ROUNDS 3                // requests to each server in a burst
+#define NTP_BURST_SPACING_MS 500          // between the rounds to a server
+#define NTP_BURST_MAX_MS 8000             // give up on the servers that have not finished by then
 #define TIME_ZONE_STRING_DEFAULT "CET-1CEST,M3.5.0,M10.5.0/3"
-#define NTP_UPDATE_INTERVAL_DEFAULT 7261
+#define NTP_UPDATE_INTERVAL_DEFAULT 7261    // the longest the poll interval backs off to
 #define NTP_UPDATE_INTERVAL_MIN 60
 #define NTP_UPDATE_INTERVAL_MAX 86400
 
@@ -32,6 +48,8 @@ class NtpAsync
     void setUp();
     void setDebugOutput(bool newDebug);
     void getTimeFromNTP();
+    void loop(unsigned long nowMillis);
+    bool isBurstActive();
     bool getIsConnected();
     void resetDefaults();
     
@@ -47,13 +65,32 @@ class NtpAsync
     unsigned long getLastUpdate();
     signed int getNextUpdate(unsigned long nowMillis);
     void resetNextUpdate();
+    void reportCorrection(int64_t correctionUs, bool stepped);
+    unsigned long getPollInterval();
+    unsigned long getPollRetries();
     
-    String getLastTimeFromServer();
+    String getLastTimeFromServer();                       // local time, for display
     
     bool ntpTimeValid(unsigned long nowMillis);
     
     long getLastUpdateTimeSecs(unsigned long nowMillis);
 
+    String getServerAddresses();
+    bool getServerStats(byte index, ntp_server_stats_t *stats);
+    bool isOffsetValid();
+    int64_t getOffsetUs();
+    int64_t getJitterUs();
+    int64_t getDelayUs();
+    unsigned long getBursts();
+    unsigned long getFailedBursts();
+    unsigned long getOutliers();
+    unsigned long getDnsLookups();
+    unsigned long getDnsFailures();
+    unsigned long getPacketsSent();
+    unsigned long getPacketsReceived();
+    unsigned long getPacketsRejected();
+    unsigned long getPacketsTimedOut();
+
     // callbacks
     void setDebugCallback(DebugCallback dbcb);
     void setNewTimeCallback(NewTimeCallback ntcb);
@@ -61,15 +98,25 @@ class NtpAsync
     String _ntpPool = NTP_POOL_DEFAULT;                   // The pool name we are using
     String _tzs = TIME_ZONE_STRING_DEFAULT;               // The TZ value to use
     unsigned long _lastUpdateFromServer = 0;              // The last millis() we got an update at
-    String _lastTimeFromServer = "";                      // The last time we got
-    int _ntpUpdateInterval = NTP_UPDATE_INTERVAL_DEFAULT; // The interval between updates in SECONDS
+    ntp_time_t _lastTimeFromServer = {0, 0, 0};           // The last time we got
+    int _ntpUpdateInterval = NTP_UPDATE_INTERVAL_DEFAULT; // The longest interval between updates in SECONDS
+    NtpPollPolicy _poll;                                  // When the next update is due
     unsigned long _ntpStarted = 0;
     bool _debug = false;
-    AsyncUDP _udp;
+    NtpResolver _resolver;                                // Pool addresses, looked up without blocking
+    NtpClockFilter _filter;                               // Offset from the samples of a burst
+    NtpSession _session;                                  // The socket, requests and replies
+    bool _burstActive = false;
+    byte _burstServers = 0;
+    uint32_t _burstIds[NTP_MAX_SERVERS];                  // server addresses, slot = index
+    byte _roundsSent[NTP_MAX_SERVERS];
+    unsigned long _lastSentMillis[NTP_MAX_SERVERS];
+    unsigned long _burstEndMillis = 0;
     DebugCallback _dbcb;
     NewTimeCallback _ntcb;
 
     void debugMsg(String message);                        // print a debug message to the callback
+    void endBurst();
     void checkMillisOverflow(unsigned long nowMillis);    // handle millis overflow
 };
 
@@ -0,0 +1,300 @@
+#include "NtpClockFilter.h"
+#include <string.h>
+#include <math.h>
+
+void NtpClockFilter::reset() {
+  _serverCount = 0;
+  _valid = false;
+  _offsetUs = 0;
+  _jitterUs = 0;
+  _delayUs = 0;
+  _survivors = 0;
+}
+
+int8_t NtpClockFilter::findServer(uint32_t id) {
+  for (uint8_t i = 0 ; i < _serverCount ; i++) {
+    if (_servers[i].stats.id == id) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// ************************************************************
+// Keep the servers that are still in the list, in place
+// ************************************************************
+void NtpClockFilter::setServers(const uint32_t *ids, uint8_t count) {
+  uint8_t kept = 0;
+  for (uint8_t i = 0 ; i < _serverCount ; i++) {
+    bool wanted = false;
+    for (uint8_t j = 0 ; j < count ; j++) {
+      if (ids[j] == _servers[i].stats.id) {
+        wanted = true;
+      }
+    }
+    if (wanted) {
+      if (kept != i) {
+        _servers[kept] = _servers[i];
+      }
+      kept++;
+    }
+  }
+  _serverCount = kept;
+
+  for (uint8_t j = 0 ; (j < count) && (_serverCount < NTP_MAX_SERVERS) ; j++) {
+    if (findServer(ids[j]) < 0) {
+      ntp_server_t *server = &_servers[_serverCount++];
+      memset(server, 0, sizeof(ntp_server_t));
+      server->stats.id = ids[j];
+    }
+  }
+}
+
+bool NtpClockFilter::addSample(uint32_t id, int64_t t1Us, const ntp_reply_t *reply, int64_t t4Us) {
+  int8_t index = findServer(id);
+  if (index < 0) {
+    return false;
+  }
+  ntp_server_t *server = &_servers[index];
+
+  int64_t offsetUs = ((reply->receiveUs - t1Us) + (reply->transmitUs - t4Us)) / 2;
+  int64_t delayUs = (t4Us - t1Us) - (reply->transmitUs - reply->receiveUs);
+  // A negative delay can't happen for a real reply to this request
+  if ((delayUs < 0) || (delayUs > 2 * NTP_MAX_DISTANCE_US)) {
+    return false;
+  }
+
+  ntp_sample_t *sample = &server->filter[server->nextStage];
+  sample->offsetUs = offsetUs;
+  sample->delayUs = delayUs;
+  sample->t4Us = t4Us;
+  server->nextStage = (server->nextStage + 1) % NTP_FILTER_STAGES;
+  if (server->stats.sampleCount < NTP_FILTER_STAGES) {
+    server->stats.sampleCount++;
+  }
+
+  server->stats.stratum = reply->stratum;
+  server->stats.rootDelayUs = reply->rootDelayUs;
+  server->stats.rootDispersionUs = reply->rootDispersionUs;
+  server->stats.samples++;
+  server->repliedThisBurst = true;
+  return true;
+}
+
+// ************************************************************
+// Minimum delay sample of this burst, and the jitter of the
+// others around it. A server with no fresh sample gets a zero
+// root distance, which means "not usable".
+// ************************************************************
+void NtpClockFilter::filterServer(ntp_server_t *server, int64_t nowUs) {
+  server->stats.distanceUs = 0;
+
+  int8_t best = -1;
+  for (uint8_t i = 0 ; i < server->stats.sampleCount ; i++) {
+    if ((nowUs - server->filter[i].t4Us) > NTP_SAMPLE_MAX_AGE_US) {
+      continue;
+    }
+    if ((best < 0) || (server->filter[i].delayUs < server->filter[best].delayUs)) {
+      best = i;
+    }
+  }
+  if (best < 0) {
+    return;
+  }
+
+  int64_t bestOffsetUs = server->filter[best].offsetUs;
+  double sumSquares = 0;
+  uint8_t others = 0;
+  for (uint8_t i = 0 ; i < server->stats.sampleCount ; i++) {
+    if ((i == best) || ((nowUs - server->filter[i].t4Us) > NTP_SAMPLE_MAX_AGE_US)) {
+      continue;
+    }
+    double diff = (double) (server->filter[i].offsetUs - bestOffsetUs);
+    sumSquares += diff * diff;
+    others++;
+  }
+
+  server->stats.offsetUs = bestOffsetUs;
+  server->stats.delayUs = server->filter[best].delayUs;
+  server->stats.jitterUs = (others > 0) ? (int64_t) sqrt(sumSquares / others) : 0;
+
+  int64_t distanceUs = (server->stats.rootDelayUs + server->stats.delayUs) / 2 + server->stats.rootDispersionUs + server->stats.jitterUs;
+  if (distanceUs < NTP_MIN_DISTANCE_US) {
+    distanceUs = NTP_MIN_DISTANCE_US;
+  }
+  server->stats.distanceUs = distanceUs;
+}
+
+// ************************************************************
+// Marzullo: sweep the interval ends in order, the deepest
+// overlap is where most servers agree. Returns the number of
+// survivors, 0 if they are not a majority.
+// ************************************************************
+uint8_t NtpClockFilter::selectServers() {
+  int64_t ends[NTP_MAX_SERVERS * 2];
+  int8_t kinds[NTP_MAX_SERVERS * 2];           // +1 start, -1 end
+  uint8_t endCount = 0;
+  uint8_t candidates = 0;
+
+  for (uint8_t i = 0 ; i < _serverCount ; i++) {
+    ntp_server_stats_t *stats = &_servers[i].stats;
+    stats->selected = false;
+    if ((stats->distanceUs == 0) || (stats->distanceUs > NTP_MAX_DISTANCE_US)) {
+      continue;
+    }
+    candidates++;
+    ends[endCount] = stats->offsetUs - stats->distanceUs;
+    kinds[endCount++] = 1;
+    ends[endCount] = stats->offsetUs + stats->distanceUs;
+    kinds[endCount++] = -1;
+  }
+  if (candidates == 0) {
+    return 0;
+  }
+
+  // Insertion sort, starts before ends at the same point
+  for (uint8_t i = 1 ; i < endCount ; i++) {
+    int64_t value = ends[i];
+    int8_t kind = kinds[i];
+    int8_t j = i - 1;
+    while ((j >= 0) && ((ends[j] > value) || ((ends[j] == value) && (kinds[j] < kind)))) {
+      ends[j + 1] = ends[j];
+      kinds[j + 1] = kinds[j];
+      j--;
+    }
+    ends[j + 1] = value;
+    kinds[j + 1] = kind;
+  }
+
+  int8_t depth = 0;
+  int8_t bestDepth = 0;
+  int64_t bestPoint = 0;
+  for (uint8_t i = 0 ; i < endCount ; i++) {
+    depth += kinds[i];
+    if ((kinds[i] > 0) && (depth > bestDepth)) {
+      bestDepth = depth;
+      bestPoint = (ends[i] + ends[i + 1]) / 2;
+    }
+  }
+
+  if ((bestDepth * 2) <= candidates) {
+    return 0;
+  }
+
+  uint8_t survivors = 0;
+  for (uint8_t i = 0 ; i < _serverCount ; i++) {
+    ntp_server_stats_t *stats = &_servers[i].stats;
+    if ((stats->distanceUs == 0) || (stats->distanceUs > NTP_MAX_DISTANCE_US)) {
+      continue;
+    }
+    if ((bestPoint >= stats->offsetUs - stats->distanceUs) && (bestPoint <= stats->offsetUs + stats->distanceUs)) {
+      stats->selected = true;
+      survivors++;
+    } else {
+      _outliers++;
+    }
+  }
+  return survivors;
+}
+
+bool NtpClockFilter::endBurst(int64_t nowUs) {
+  _bursts++;
+
+  for (uint8_t i = 0 ; i < _serverCount ; i++) {
+    ntp_server_t *server = &_servers[i];
+    server->stats.reach = (server->stats.reach << 1) | (server->repliedThisBurst ? 1 : 0);
+    server->repliedThisBurst = false;
+    filterServer(server, nowUs);
+  }
+
+  _survivors = selectServers();
+  if (_survivors == 0) {
+    _failedBursts++;
+    return false;
+  }
+
+  int8_t best = -1;
+  for (uint8_t i = 0 ; i < _serverCount ; i++) {
+    ntp_server_stats_t *stats = &_servers[i].stats;
+    if (stats->selected && ((best < 0) || (stats->distanceUs < _servers[best].stats.distanceUs))) {
+      best = i;
+    }
+  }
+
+  // Combine, weighted by 1 / root distance. Summed relative to the
+  // best server: the offsets themselves can be too big for a
+  // double to keep to the microsecond.
+  int64_t bestOffsetUs = _servers[best].stats.offsetUs;
+  double weightSum = 0;
+  double offsetSum = 0;
+  for (uint8_t i = 0 ; i < _serverCount ; i++) {
+    ntp_server_stats_t *stats = &_servers[i].stats;
+    if (stats->selected) {
+      double weight = 1.0 / stats->distanceUs;
+      weightSum += weight;
+      offsetSum += weight * (double) (stats->offsetUs - bestOffsetUs);
+    }
+  }
+  int64_t offsetUs = bestOffsetUs + (int64_t) (offsetSum / weightSum);
+
+  // System jitter: the spread of the survivors around the result,
+  // and the jitter of the best server
+  double sumSquares = 0;
+  for (uint8_t i = 0 ; i < _serverCount ; i++) {
+    ntp_server_stats_t *stats = &_servers[i].stats;
+    if (stats->selected) {
+      double diff = (double) (stats->offsetUs - offsetUs);
+      sumSquares += diff * diff;
+    }
+  }
+  double peerJitter = (double) _servers[best].stats.jitterUs;
+  _jitterUs = (int64_t) sqrt(sumSquares / _survivors + peerJitter * peerJitter);
+  _offsetUs = offsetUs;
+  _delayUs = _servers[best].stats.delayUs;
+  _valid = true;
+  return true;
+}
+
+bool NtpClockFilter::isValid() {
+  return _valid;
+}
+
+int64_t NtpClockFilter::getOffsetUs() {
+  return _offsetUs;
+}
+
+int64_t NtpClockFilter::getJitterUs() {
+  return _jitterUs;
+}
+
+int64_t NtpClockFilter::getDelayUs() {
+  return _delayUs;
+}
+
+uint8_t NtpClockFilter::getSurvivors() {
+  return _survivors;
+}
+
+uint8_t NtpClockFilter::getServerCount() {
+  return _serverCount;
+}
+
+bool NtpClockFilter::getServer(uint8_t index, ntp_server_stats_t *stats) {
+  if (index >= _serverCount) {
+    return false;
+  }
+  *stats = _servers[index].stats;
+  return true;
+}
+
+uint32_t NtpClockFilter::getBursts() {
+  return _bursts;
+}
+
+uint32_t NtpClockFilter::getFailedBursts() {
+  return _failedBursts;
+}
+
+uint32_t NtpClockFilter::getOutliers() {
+  return _outliers;
+}
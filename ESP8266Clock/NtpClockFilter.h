@@ -0,0 +1,119 @@
+#ifndef ntpclockfilter_h
+#define ntpclockfilter_h
+
+#include <stdint.h>
+#include "NtpPacket.h"
+
+// ************************************************************
+// Clock filter and server selection for a burst of NTP samples
+// from a few servers, after RFC 5905 (simplified):
+//
+// - Each reply gives an offset and a round trip delay from all
+//   four timestamps:
+//     offset = ((T2 - T1) + (T3 - T4)) / 2
+//     delay  =  (T4 - T1) - (T3 - T2)
+//   T1 and T4 are on the caller's local timescale (microseconds,
+//   any origin), so the offset is UTC minus the local timescale.
+//
+// - Per server the last NTP_FILTER_STAGES samples are kept, and
+//   the one with the smallest delay is taken: it has the least
+//   room for queueing asymmetry. Only the samples of the current
+//   burst count, the local clock has drifted since the last one.
+//   The jitter is the RMS difference of the other samples'
+//   offsets from it.
+//
+// - Each server's offset +/- its root distance (half the total
+//   delay to the reference clock, plus the dispersion and jitter)
+//   is an interval that should hold the true time. The point
+//   most of the intervals agree on is found (Marzullo), and the
+//   servers that don't include it are rejected as outliers. It
+//   takes a majority: with 2 servers they both have to agree.
+//
+// - The survivors are averaged, weighted by 1 / root distance.
+//
+// Servers are known by an id (the IP address on the clock).
+// No Arduino dependencies.
+// ************************************************************
+
+#define NTP_MAX_SERVERS                 4
+#define NTP_FILTER_STAGES               8
+#define NTP_MIN_DISTANCE_US             1000      // floor for the root distance
+#define NTP_MAX_DISTANCE_US             1500000   // beyond this a server is no use
+#define NTP_SAMPLE_MAX_AGE_US           64000000  // older samples are from an earlier burst
+
+typedef struct {
+  int64_t offsetUs;
+  int64_t delayUs;
+  int64_t t4Us;                                   // local time of the sample
+} ntp_sample_t;
+
+typedef struct {
+  uint32_t id;
+  uint8_t stratum;
+  uint8_t reach;                                  // one bit per burst, 1 = replied
+  uint8_t sampleCount;
+  bool selected;                                  // survived the last selection
+  uint32_t samples;                               // in total
+  int64_t offsetUs;                               // minimum delay sample
+  int64_t delayUs;
+  int64_t jitterUs;
+  int64_t distanceUs;                             // root distance
+  int64_t rootDelayUs;
+  int64_t rootDispersionUs;
+} ntp_server_stats_t;
+
+class NtpClockFilter
+{
+  public:
+    void reset();
+
+    // Forget the servers whose ids are not in the list (the pool
+    // gave us new ones), keep the samples of the others
+    void setServers(const uint32_t *ids, uint8_t count);
+
+    // A reply to a request sent at local time t1Us, received at t4Us
+    bool addSample(uint32_t id, int64_t t1Us, const ntp_reply_t *reply, int64_t t4Us);
+
+    // End of a burst: update the reach, filter, select and combine.
+    // False if there is no majority of servers that agree.
+    bool endBurst(int64_t nowUs);
+
+    bool isValid();
+    int64_t getOffsetUs();                        // UTC - local
+    int64_t getJitterUs();                        // system jitter
+    int64_t getDelayUs();                         // of the best server
+    uint8_t getSurvivors();
+    uint8_t getServerCount();
+    bool getServer(uint8_t index, ntp_server_stats_t *stats);
+
+    uint32_t getBursts();
+    uint32_t getFailedBursts();
+    uint32_t getOutliers();                       // servers rejected by the selection
+
+  private:
+    typedef struct {
+      ntp_server_stats_t stats;
+      ntp_sample_t filter[NTP_FILTER_STAGES];
+      uint8_t nextStage;
+      bool repliedThisBurst;
+    } ntp_server_t;
+
+    ntp_server_t _servers[NTP_MAX_SERVERS];
+    uint8_t _serverCount = 0;
+
+    bool _valid = false;
+    int64_t _offsetUs = 0;
+    int64_t _jitterUs = 0;
+    int64_t _delayUs = 0;
+    uint8_t _survivors = 0;
+
+    uint32_t _bursts = 0;
+    uint32_t _failedBursts = 0;
+    uint32_t _outliers = 0;
+
+    int8_t findServer(uint32_t id);
+    void filterServer(ntp_server_t *server, int64_t nowUs);
+    uint8_t selectServers();
+};
+
+#endif
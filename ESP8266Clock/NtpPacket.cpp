@@ -0,0 +1,100 @@
+#include "NtpPacket.h"
+#include <string.h>
+
+static uint32_t readU32(const uint8_t *p) {
+  return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) | p[3];
+}
+
+static void writeU32(uint8_t *p, uint32_t value) {
+  p[0] = value >> 24;
+  p[1] = value >> 16;
+  p[2] = value >> 8;
+  p[3] = value;
+}
+
+// ************************************************************
+// 16.16 fixed point seconds (root delay, root dispersion)
+// ************************************************************
+static int64_t readShortUs(const uint8_t *p) {
+  return ((int64_t) readU32(p) * 1000000) >> 16;
+}
+
+int64_t ntpReadTimestamp(const uint8_t *packet, uint8_t offset) {
+  uint32_t secs = readU32(&packet[offset]);
+  uint32_t fraction = readU32(&packet[offset + 4]);
+  if ((secs == 0) && (fraction == 0)) {
+    return 0;
+  }
+
+  int64_t unixSecs = (int64_t) secs - NTP_UNIX_OFFSET_SECS;
+  if (secs < 0x80000000UL) {
+    // Era 1, after 7 Feb 2036
+    unixSecs += 0x100000000LL;
+  }
+  return unixSecs * 1000000 + (int64_t) (((uint64_t) fraction * 1000000) >> 32);
+}
+
+void ntpWriteTimestamp(uint8_t *packet, uint8_t offset, int64_t unixUs) {
+  if (unixUs == 0) {
+    memset(&packet[offset], 0, 8);
+    return;
+  }
+  int64_t unixSecs = unixUs / 1000000;
+  uint32_t micros = unixUs % 1000000;
+  writeU32(&packet[offset], (uint32_t) (unixSecs + NTP_UNIX_OFFSET_SECS));
+  // Rounded up, so that reading it back gives the same microsecond
+  writeU32(&packet[offset + 4], (uint32_t) (((((uint64_t) micros) << 32) + 999999) / 1000000));
+}
+
+void ntpBuildRequest(uint8_t *packet, int64_t transmitUs) {
+  memset(packet, 0, NTP_PACKET_SIZE);
+  packet[0] = 0b11100011;   // LI unknown, version 4, mode 3 (client)
+  packet[1] = 0;            // Stratum, or type of clock
+  packet[2] = 9;            // Polling Interval (9 = 2^9 secs = ~9 mins, close to our 10 min default)
+  packet[3] = 0xEC;         // Peer Clock Precision
+  // 8 bytes of zero for Root Delay & Root Dispersion
+  packet[12] = 'X';         // "kiss code", see RFC5905
+  packet[13] = 'W';         // (codes starting with 'X' are not interpreted)
+  packet[14] = 'N';
+  packet[15] = 'C';
+  ntpWriteTimestamp(packet, 40, transmitUs);
+}
+
+// ************************************************************
+// Only server replies from a synchronised server, stratum 1..15,
+// with all the timestamps we need, are any use. Stratum 0 is a
+// "kiss of death" (e.g. RATE), which we treat as no reply.
+// ************************************************************
+bool ntpParseReply(const uint8_t *packet, uint16_t length, ntp_reply_t *reply) {
+  if (length < NTP_PACKET_SIZE) {
+    return false;
+  }
+
+  reply->leap = packet[0] >> 6;
+  reply->version = (packet[0] >> 3) & 0x07;
+  reply->mode = packet[0] & 0x07;
+  reply->stratum = packet[1];
+  reply->poll = (int8_t) packet[2];
+  reply->precision = (int8_t) packet[3];
+  reply->rootDelayUs = readShortUs(&packet[4]);
+  reply->rootDispersionUs = readShortUs(&packet[8]);
+  reply->referenceId = readU32(&packet[12]);
+  reply->referenceUs = ntpReadTimestamp(packet, 16);
+  reply->originateUs = ntpReadTimestamp(packet, 24);
+  reply->receiveUs = ntpReadTimestamp(packet, 32);
+  reply->transmitUs = ntpReadTimestamp(packet, 40);
+
+  if ((reply->mode != 4) || (reply->leap == NTP_LEAP_NOT_SYNCHRONISED)) {
+    return false;
+  }
+  if ((reply->stratum < 1) || (reply->stratum > NTP_MAX_STRATUM)) {
+    return false;
+  }
+  if ((reply->referenceUs == 0) || (reply->receiveUs == 0) || (reply->transmitUs == 0)) {
+    return false;
+  }
+  if (reply->receiveUs > reply->transmitUs) {
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,46 @@
+#ifndef ntppacket_h
+#define ntppacket_h
+
+#include <stdint.h>
+
+// ************************************************************
+// NTP (RFC 5905) client packets: build a request, decode a
+// reply. Times are microseconds since 1970 (UTC) in an int64_t,
+// which keeps the NTP fraction and does not run out in 2036:
+// NTP seconds below 2^31 are taken to be in the next era.
+// No Arduino dependencies.
+// ************************************************************
+
+#define NTP_PACKET_SIZE                 48
+#define NTP_PORT                        123
+#define NTP_UNIX_OFFSET_SECS            2208988800LL    // 1900 to 1970
+#define NTP_MAX_STRATUM                 15
+#define NTP_LEAP_NOT_SYNCHRONISED       3
+
+typedef struct {
+  uint8_t leap;
+  uint8_t version;
+  uint8_t mode;
+  uint8_t stratum;
+  int8_t poll;
+  int8_t precision;
+  int64_t rootDelayUs;
+  int64_t rootDispersionUs;
+  uint32_t referenceId;
+  int64_t referenceUs;
+  int64_t originateUs;                          // our transmit time, echoed back
+  int64_t receiveUs;                            // T2: the server got the request
+  int64_t transmitUs;                           // T3: the server sent the reply
+} ntp_reply_t;
+
+// Client request, with transmitUs (0 = none) in the transmit timestamp
+void ntpBuildRequest(uint8_t *packet, int64_t transmitUs);
+
+// Decode and sanity check a server reply, false if it can't be used
+bool ntpParseReply(const uint8_t *packet, uint16_t length, ntp_reply_t *reply);
+
+// The 64 bit timestamp at packet[offset] to and from microseconds
+int64_t ntpReadTimestamp(const uint8_t *packet, uint8_t offset);
+void ntpWriteTimestamp(uint8_t *packet, uint8_t offset, int64_t unixUs);
+
+#endif
@@ -0,0 +1,144 @@
+#include "NtpPollPolicy.h"
+
+// ************************************************************
+// The configured update interval is the longest we back off to
+// ************************************************************
+void NtpPollPolicy::setMaxInterval(uint32_t maxSecs) {
+  _maxSecs = maxSecs;
+  _minSecs = (maxSecs < NTP_POLL_MIN_SECS) ? maxSecs : NTP_POLL_MIN_SECS;
+  if (_intervalSecs > _maxSecs) {
+    _intervalSecs = _maxSecs;
+  }
+  if (_intervalSecs < _minSecs) {
+    _intervalSecs = _minSecs;
+  }
+}
+
+void NtpPollPolicy::setSeed(uint32_t seed) {
+  _random = (seed == 0) ? 0x2545f491 : seed;
+}
+
+void NtpPollPolicy::reset(uint32_t nowMillis) {
+  _intervalSecs = _minSecs;
+  _stableCount = 0;
+  _failures = 0;
+  schedule(nowMillis, 0);
+}
+
+int32_t NtpPollPolicy::getSecsToNext(uint32_t nowMillis) {
+  int32_t remainingMillis = (int32_t) (_waitMillis - (nowMillis - _lastPollMillis));
+  if (remainingMillis <= 0) {
+    return remainingMillis / 1000 - 1;
+  }
+  return (remainingMillis + 999) / 1000;
+}
+
+// ************************************************************
+// Retry with an exponential back off, drawn at random from the
+// upper half of the wait
+// ************************************************************
+void NtpPollPolicy::pollFailed(uint32_t nowMillis) {
+  uint32_t waitSecs = NTP_RETRY_MIN_SECS;
+  for (uint32_t i = 0 ; (i < _failures) && (waitSecs < _intervalSecs) ; i++) {
+    waitSecs *= 2;
+  }
+  if (waitSecs > _intervalSecs) {
+    waitSecs = _intervalSecs;
+  }
+
+  _failures++;
+  _retries++;
+  uint32_t waitMillis = waitSecs * 500;
+  schedule(nowMillis, waitMillis + nextRandom() % (waitMillis + 1));
+}
+
+void NtpPollPolicy::pollSucceeded(uint32_t nowMillis) {
+  _failures = 0;
+  schedule(nowMillis, spread(_intervalSecs, NTP_POLL_SPREAD_PERCENT));
+}
+
+// ************************************************************
+// Back off while the clock keeps good time, tighten when it does
+// not. The next poll is moved to suit.
+// ************************************************************
+void NtpPollPolicy::adjust(int64_t correctionUs, int64_t jitterUs, bool stepped) {
+  uint32_t oldSecs = _intervalSecs;
+
+  if (jitterUs < NTP_POLL_MIN_JITTER_US) {
+    jitterUs = NTP_POLL_MIN_JITTER_US;
+  }
+  if (correctionUs < 0) {
+    correctionUs = -correctionUs;
+  }
+
+  if (stepped) {
+    _intervalSecs = _minSecs;
+    _stableCount = 0;
+  } else if (correctionUs > NTP_POLL_GATE * jitterUs) {
+    _intervalSecs /= 2;
+    _stableCount = 0;
+  } else if (++_stableCount >= NTP_POLL_STABLE_COUNT) {
+    _intervalSecs *= 2;
+    _stableCount = 0;
+  }
+
+  if (_intervalSecs > _maxSecs) {
+    _intervalSecs = _maxSecs;
+  }
+  if (_intervalSecs < _minSecs) {
+    _intervalSecs = _minSecs;
+  }
+
+  if (_intervalSecs > oldSecs) {
+    _backOffs++;
+  } else if (_intervalSecs < oldSecs) {
+    _tightens++;
+  }
+  if (_intervalSecs != oldSecs) {
+    _waitMillis = spread(_intervalSecs, NTP_POLL_SPREAD_PERCENT);
+  }
+}
+
+uint32_t NtpPollPolicy::getIntervalSecs() {
+  return _intervalSecs;
+}
+
+uint32_t NtpPollPolicy::getFailures() {
+  return _failures;
+}
+
+uint32_t NtpPollPolicy::getRetries() {
+  return _retries;
+}
+
+uint32_t NtpPollPolicy::getBackOffs() {
+  return _backOffs;
+}
+
+uint32_t NtpPollPolicy::getTightens() {
+  return _tightens;
+}
+
+// ************************************************************
+// xorshift32, plenty for spreading the polls
+// ************************************************************
+uint32_t NtpPollPolicy::nextRandom() {
+  _random ^= _random << 13;
+  _random ^= _random >> 17;
+  _random ^= _random << 5;
+  return _random;
+}
+
+// ************************************************************
+// secs in milliseconds, give or take percent
+// ************************************************************
+uint32_t NtpPollPolicy::spread(uint32_t secs, uint8_t percent) {
+  uint32_t millis = secs * 1000;
+  uint32_t range = millis / 100 * percent;
+  return millis - range + nextRandom() % (2 * range + 1);
+}
+
+void NtpPollPolicy::schedule(uint32_t nowMillis, uint32_t waitMillis) {
+  _lastPollMillis = nowMillis;
+  _waitMillis = waitMillis;
+}
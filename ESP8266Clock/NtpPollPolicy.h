@@ -0,0 +1,74 @@
+#ifndef ntppollpolicy_h
+#define ntppollpolicy_h
+
+#include <stdint.h>
+
+// ************************************************************
+// When to ask NTP for the time next.
+//
+// The poll interval starts short after a restart or a change of
+// settings and adapts to how well the clock keeps time: when the
+// corrections found at NTP_POLL_STABLE_COUNT syncs in a row are
+// inside NTP_POLL_GATE times the jitter, the interval doubles up
+// to the maximum. A correction outside the gate halves it, and a
+// step sends it back to the minimum.
+//
+// A failed poll is retried after NTP_RETRY_MIN_SECS, doubling with
+// each failure up to the poll interval. All the waits are spread
+// at random (the retries over the upper half of the wait, the
+// polls by NTP_POLL_SPREAD_PERCENT) so that clocks at one site
+// that restarted together do not keep polling together.
+//
+// No Arduino dependencies.
+// ************************************************************
+
+#define NTP_POLL_MIN_SECS               64        // the shortest the frequency can still be learnt from
+#define NTP_POLL_GATE                   4         // corrections inside this many jitters are stable
+#define NTP_POLL_MIN_JITTER_US          1000      // never gate tighter than this
+#define NTP_POLL_STABLE_COUNT           3         // stable syncs in a row before backing off
+#define NTP_POLL_SPREAD_PERCENT         10
+#define NTP_RETRY_MIN_SECS              16
+
+class NtpPollPolicy
+{
+  public:
+    void setMaxInterval(uint32_t maxSecs);
+    void setSeed(uint32_t seed);
+
+    // Back to the shortest interval, with a poll due now
+    void reset(uint32_t nowMillis);
+
+    // Seconds until the next poll is due, negative when overdue
+    int32_t getSecsToNext(uint32_t nowMillis);
+
+    void pollFailed(uint32_t nowMillis);
+    void pollSucceeded(uint32_t nowMillis);
+
+    // How far out the clock was found at the last good poll
+    void adjust(int64_t correctionUs, int64_t jitterUs, bool stepped);
+
+    uint32_t getIntervalSecs();
+    uint32_t getFailures();                       // in a row
+    uint32_t getRetries();
+    uint32_t getBackOffs();
+    uint32_t getTightens();
+
+  private:
+    uint32_t _minSecs = NTP_POLL_MIN_SECS;
+    uint32_t _maxSecs = NTP_POLL_MIN_SECS;
+    uint32_t _intervalSecs = NTP_POLL_MIN_SECS;
+    uint32_t _lastPollMillis = 0;
+    uint32_t _waitMillis = 0;
+    uint8_t _stableCount = 0;
+    uint32_t _failures = 0;
+    uint32_t _retries = 0;
+    uint32_t _backOffs = 0;
+    uint32_t _tightens = 0;
+    uint32_t _random = 0x2545f491;
+
+    uint32_t nextRandom();
+    uint32_t spread(uint32_t secs, uint8_t percent);
+    void schedule(uint32_t nowMillis, uint32_t waitMillis);
+};
+
+#endif
@@ -0,0 +1,155 @@
+#include "NtpResolver.h"
+
+// ************************************************************
+// A new name throws away the addresses of the old one
+// ************************************************************
+void NtpResolver::setHost(String host) {
+  if (host == _host) {
+    return;
+  }
+  _host = host;
+  _count = 0;
+  _lookupActive = false;
+  _everLookedUp = false;
+}
+
+// ************************************************************
+// Start a lookup when the set is empty or the newest address is
+// getting old. The answer comes back in dnsFoundCallback().
+// ************************************************************
+void NtpResolver::update(unsigned long nowMillis) {
+  if (_host.length() == 0) {
+    return;
+  }
+
+  if (_lookupActive) {
+    if ((nowMillis - _lookupStartedMillis) < NTP_DNS_TIMEOUT_MS) {
+      return;
+    }
+    // The callback never came, forget about it
+    _lookupActive = false;
+    _failures++;
+  }
+
+  if (_everLookedUp && ((nowMillis - _lastLookupMillis) < NTP_DNS_REFRESH_MS)) {
+    return;
+  }
+
+  _everLookedUp = true;
+  _lastLookupMillis = nowMillis;
+  _lookups++;
+
+  ip_addr_t resolved;
+  err_t err = dns_gethostbyname(_host.c_str(), &resolved, dnsFoundCallback, this);
+  if (err == ERR_OK) {
+    // From the lwIP cache (or the name was an IP address)
+    addAddress(ip_addr_get_ip4_u32(&resolved), nowMillis);
+  } else if (err == ERR_INPROGRESS) {
+    _lookupActive = true;
+    _lookupStartedMillis = nowMillis;
+  } else {
+    _failures++;
+  }
+}
+
+// ************************************************************
+// Called by lwIP, ipaddr is NULL when the lookup failed
+// ************************************************************
+void NtpResolver::dnsFoundCallback(const char *name, const ip_addr_t *ipaddr, void *callbackArg) {
+  NtpResolver *resolver = (NtpResolver *) callbackArg;
+
+  // Answer for a name we have moved on from, or a lookup we gave up on
+  if (!resolver->_lookupActive || (resolver->_host != name)) {
+    return;
+  }
+
+  resolver->lookupDone((ipaddr == NULL) ? 0 : ip_addr_get_ip4_u32(ipaddr));
+}
+
+void NtpResolver::lookupDone(uint32_t address) {
+  _lookupActive = false;
+  if (address == 0) {
+    _failures++;
+    return;
+  }
+  addAddress(address, millis());
+}
+
+// ************************************************************
+// Refresh an address we know, or take the place of the oldest
+// ************************************************************
+void NtpResolver::addAddress(uint32_t address, unsigned long nowMillis) {
+  byte slot = _count;
+  for (byte i = 0 ; i < _count ; i++) {
+    if (_entries[i].address == address) {
+      slot = i;
+      break;
+    }
+  }
+
+  if (slot == NTP_DNS_CACHE_SIZE) {
+    slot = 0;
+    for (byte i = 1 ; i < _count ; i++) {
+      if ((nowMillis - _entries[i].seenMillis) > (nowMillis - _entries[slot].seenMillis)) {
+        slot = i;
+      }
+    }
+  } else if (slot == _count) {
+    _count++;
+  }
+
+  _entries[slot].address = address;
+  _entries[slot].seenMillis = nowMillis;
+}
+
+// ************************************************************
+// Addresses older than NTP_DNS_MAX_AGE_MS are left out while
+// there are newer ones. When they are all old (the lookups are
+// failing) the old ones still do.
+// ************************************************************
+byte NtpResolver::getUsableAddresses(unsigned long nowMillis, uint32_t *addresses, byte maxCount) {
+  bool fresh = isFresh(nowMillis);
+  byte found = 0;
+  for (byte i = 0 ; (i < _count) && (found < maxCount) ; i++) {
+    if (!fresh || ((nowMillis - _entries[i].seenMillis) < NTP_DNS_MAX_AGE_MS)) {
+      addresses[found++] = _entries[i].address;
+    }
+  }
+  return found;
+}
+
+byte NtpResolver::getAddressCount() {
+  return _count;
+}
+
+bool NtpResolver::getAddress(byte index, IPAddress &address) {
+  if (index >= _count) {
+    return false;
+  }
+  address = IPAddress(_entries[index].address);
+  return true;
+}
+
+// ************************************************************
+// At least one address that the resolver gave us recently
+// ************************************************************
+bool NtpResolver::isFresh(unsigned long nowMillis) {
+  for (byte i = 0 ; i < _count ; i++) {
+    if ((nowMillis - _entries[i].seenMillis) < NTP_DNS_MAX_AGE_MS) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool NtpResolver::isLookupActive() {
+  return _lookupActive;
+}
+
+unsigned long NtpResolver::getLookups() {
+  return _lookups;
+}
+
+unsigned long NtpResolver::getFailures() {
+  return _failures;
+}
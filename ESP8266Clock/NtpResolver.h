@@ -0,0 +1,75 @@
+#ifndef NtpResolver_h
+#define NtpResolver_h
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+
+extern "C" {
+#include "lwip/dns.h"
+}
+
+// ----------------------- Defines -----------------------
+
+#define NTP_DNS_CACHE_SIZE 4            // addresses of the pool we keep
+#define NTP_DNS_REFRESH_MS 60000        // ask the resolver again at most this often
+#define NTP_DNS_MAX_AGE_MS 3600000      // older addresses are only used when lookups fail
+#define NTP_DNS_TIMEOUT_MS 15000        // give up on a lookup that never called back
+
+// ----------------------------------------------------------------------------------------------------
+// -------------------------------------- NTP pool name resolver --------------------------------------
+// ----------------------------------------------------------------------------------------------------
+//
+// Non blocking lookups of the NTP pool name through the lwIP
+// resolver: a lookup is started and the answer comes back in a
+// callback, the loop carries on in the meantime. lwIP answers
+// straight from its own cache while the record's TTL lasts, so
+// asking again every NTP_DNS_REFRESH_MS only goes to the network
+// when the TTL is up. The pool hands out a different server each
+// time, the last few are kept here so that there is always a set
+// to choose from, and when a lookup fails the last good set is
+// used as it is.
+
+typedef struct {
+  uint32_t address;
+  unsigned long seenMillis;
+} ntp_dns_entry_t;
+
+class NtpResolver
+{
+  public:
+    void setHost(String host);
+
+    // Start a lookup if the set needs one, never blocks
+    void update(unsigned long nowMillis);
+
+    // The addresses to use, up to maxCount: the ones the resolver
+    // gave us recently, or all of them when the lookups are failing
+    byte getUsableAddresses(unsigned long nowMillis, uint32_t *addresses, byte maxCount);
+
+    byte getAddressCount();
+    bool getAddress(byte index, IPAddress &address);
+    bool isFresh(unsigned long nowMillis);
+    bool isLookupActive();
+
+    unsigned long getLookups();
+    unsigned long getFailures();
+
+  private:
+    String _host = "";
+    ntp_dns_entry_t _entries[NTP_DNS_CACHE_SIZE];
+    byte _count = 0;
+
+    bool _lookupActive = false;
+    unsigned long _lookupStartedMillis = 0;
+    unsigned long _lastLookupMillis = 0;
+    bool _everLookedUp = false;
+
+    unsigned long _lookups = 0;
+    unsigned long _failures = 0;
+
+    static void dnsFoundCallback(const char *name, const ip_addr_t *ipaddr, void *callbackArg);
+    void lookupDone(uint32_t address);
+    void addAddress(uint32_t address, unsigned long nowMillis);
+};
+
+#endif
@@ -0,0 +1,133 @@
+#include "NtpSession.h"
+
+// ************************************************************
+// The socket stays open from the first burst on, and the reply
+// handler is only registered the once
+// ************************************************************
+bool NtpSession::begin(NtpClockFilter *filter) {
+  _filter = filter;
+  if (_open) {
+    return true;
+  }
+
+  for (byte i = 0 ; i < NTP_MAX_SERVERS ; i++) {
+    _requests[i].pending = false;
+  }
+
+  if (!_udp.listen(0)) {
+    return false;
+  }
+  _udp.onPacket([this](AsyncUDPPacket &packet) {
+    handlePacket(packet);
+  });
+  _open = true;
+  return true;
+}
+
+// ************************************************************
+// A new request in the slot, anything still out there from the
+// last one is no longer wanted
+// ************************************************************
+bool NtpSession::send(byte slot, uint32_t address, unsigned long nowMillis) {
+  if (!_open || (slot >= NTP_MAX_SERVERS)) {
+    return false;
+  }
+
+  ntp_request_t *request = &_requests[slot];
+  request->address = address;
+  request->retriesLeft = NTP_REQUEST_RETRIES;
+  return transmit(request, nowMillis);
+}
+
+bool NtpSession::isPending(byte slot) {
+  return (slot < NTP_MAX_SERVERS) && _requests[slot].pending;
+}
+
+void NtpSession::cancelAll() {
+  for (byte i = 0 ; i < NTP_MAX_SERVERS ; i++) {
+    _requests[i].pending = false;
+  }
+}
+
+// ************************************************************
+// The tag is our send time, made unique, so that every request
+// has its own even when two go in the same microsecond
+// ************************************************************
+bool NtpSession::transmit(ntp_request_t *request, unsigned long nowMillis) {
+  byte buffer[NTP_PACKET_SIZE];
+
+  request->t1Us = micros64();
+  request->tagUs = (request->t1Us > _lastTagUs) ? request->t1Us : _lastTagUs + 1;
+  _lastTagUs = request->tagUs;
+  ntpBuildRequest(buffer, request->tagUs);
+
+  request->sentMillis = nowMillis;
+  request->pending = true;
+  _sent++;
+  return _udp.writeTo(buffer, NTP_PACKET_SIZE, IPAddress(request->address), NTP_PORT) == NTP_PACKET_SIZE;
+}
+
+void NtpSession::loop(unsigned long nowMillis) {
+  for (byte i = 0 ; i < NTP_MAX_SERVERS ; i++) {
+    ntp_request_t *request = &_requests[i];
+    if (!request->pending || ((nowMillis - request->sentMillis) < NTP_REQUEST_TIMEOUT_MS)) {
+      continue;
+    }
+
+    _timedOut++;
+    request->pending = false;
+    if (request->retriesLeft > 0) {
+      request->retriesLeft--;
+      _retries++;
+      transmit(request, nowMillis);
+    }
+  }
+}
+
+// ************************************************************
+// UDP callback: time stamp the reply first, then see whose it is
+// ************************************************************
+void NtpSession::handlePacket(AsyncUDPPacket &packet) {
+  int64_t t4Us = micros64();
+
+  ntp_reply_t reply;
+  if (!ntpParseReply(packet.data(), packet.length(), &reply)) {
+    _rejected++;
+    return;
+  }
+
+  uint32_t from = (uint32_t) packet.remoteIP();
+  for (byte i = 0 ; i < NTP_MAX_SERVERS ; i++) {
+    ntp_request_t *request = &_requests[i];
+    if (request->pending && (request->address == from) && (request->tagUs == reply.originateUs)) {
+      request->pending = false;
+      _received++;
+      if (_filter != NULL) {
+        _filter->addSample(from, request->t1Us, &reply, t4Us);
+      }
+      return;
+    }
+  }
+
+  _rejected++;
+}
+
+unsigned long NtpSession::getSent() {
+  return _sent;
+}
+
+unsigned long NtpSession::getReceived() {
+  return _received;
+}
+
+unsigned long NtpSession::getRejected() {
+  return _rejected;
+}
+
+unsigned long NtpSession::getTimedOut() {
+  return _timedOut;
+}
+
+unsigned long NtpSession::getRetries() {
+  return _retries;
+}
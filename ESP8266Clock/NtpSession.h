@@ -0,0 +1,76 @@
+#ifndef NtpSession_h
+#define NtpSession_h
+
+#include <Arduino.h>
+#include <ESPAsyncUDP.h>        // https://github.com/me-no-dev/ESPAsyncUDP (master HEAD)
+#include "NtpPacket.h"
+#include "NtpClockFilter.h"
+
+// ----------------------- Defines -----------------------
+
+#define NTP_REQUEST_TIMEOUT_MS 1000       // a reply later than this is no use to the filter
+#define NTP_REQUEST_RETRIES 1             // times a request that timed out is sent again
+
+// ----------------------------------------------------------------------------------------------------
+// ------------------------------------------- NTP session --------------------------------------------
+// ----------------------------------------------------------------------------------------------------
+//
+// The one UDP socket the clock talks NTP over, opened once and
+// kept for good, with its reply handler registered once. There
+// is one request slot per server of a burst. Each request goes
+// out with its own tag in the transmit timestamp, which the
+// server echoes back as the originate timestamp: a reply is only
+// taken if it comes from the server of a slot that is waiting,
+// with that slot's tag. Late, duplicated and stray replies are
+// rejected. A request that is not answered in time is sent again
+// (with a new tag) up to NTP_REQUEST_RETRIES times.
+//
+// Replies that are taken go straight into the clock filter.
+
+typedef struct {
+  uint32_t address;
+  bool pending;
+  byte retriesLeft;
+  int64_t t1Us;                           // micros64() the request went at
+  int64_t tagUs;                          // what we put in the transmit timestamp
+  unsigned long sentMillis;
+} ntp_request_t;
+
+class NtpSession
+{
+  public:
+    // Open the socket if it is not already, true when it is open
+    bool begin(NtpClockFilter *filter);
+
+    // A request to address, in slot (one per server)
+    bool send(byte slot, uint32_t address, unsigned long nowMillis);
+    bool isPending(byte slot);
+    void cancelAll();
+
+    // Time out and retry the requests that are not answered
+    void loop(unsigned long nowMillis);
+
+    unsigned long getSent();
+    unsigned long getReceived();
+    unsigned long getRejected();
+    unsigned long getTimedOut();
+    unsigned long getRetries();
+
+  private:
+    AsyncUDP _udp;
+    bool _open = false;
+    NtpClockFilter *_filter = NULL;
+    ntp_request_t _requests[NTP_MAX_SERVERS];
+    int64_t _lastTagUs = 0;
+
+    unsigned long _sent = 0;
+    unsigned long _received = 0;
+    unsigned long _rejected = 0;
+    unsigned long _timedOut = 0;
+    unsigned long _retries = 0;
+
+    bool transmit(ntp_request_t *request, unsigned long nowMillis);
+    void handlePacket(AsyncUDPPacket &packet);
+};
+
+#endif
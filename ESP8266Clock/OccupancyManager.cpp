@@ -0,0 +1,126 @@
+#include "OccupancyManager.h"
+#include <string.h>
+
+OccupancyManager::OccupancyManager() {
+  reset();
+}
+
+void OccupancyManager::reset() {
+  memset(&_data, 0, sizeof(_data));
+  _data.magic = OCCUPANCY_MAGIC;
+  _data.version = OCCUPANCY_VERSION;
+  _slot = OCCUPANCY_NO_SLOT;
+  _minutes = 0;
+  _motionMinutes = 0;
+}
+
+uint8_t OccupancyManager::getSlot(uint8_t weekday, uint8_t hour) {
+  if ((weekday < 1) || (weekday > 7) || (hour > 23)) {
+    return OCCUPANCY_NO_SLOT;
+  }
+  return (weekday - 1) * 24 + hour;
+}
+
+// ************************************************************
+// One minute. When the hour changes, learn from the last one.
+// ************************************************************
+void OccupancyManager::addMinute(bool motion, uint8_t weekday, uint8_t hour) {
+  uint8_t slot = getSlot(weekday, hour);
+  if (slot != _slot) {
+    learnSlot();
+    _slot = slot;
+    _minutes = 0;
+    _motionMinutes = 0;
+  }
+
+  if (_minutes < 60) {
+    _minutes++;
+    if (motion) {
+      _motionMinutes++;
+    }
+  }
+}
+
+// ************************************************************
+// An hour we only saw part of (start up, time set) tells us
+// too little, leave the slot alone
+// ************************************************************
+void OccupancyManager::learnSlot() {
+  if ((_slot == OCCUPANCY_NO_SLOT) || (_minutes < OCCUPANCY_MIN_COVERAGE)) {
+    return;
+  }
+
+  int16_t target = (_motionMinutes >= OCCUPANCY_MOTION_MINUTES) ? 255 : 0;
+  int16_t value = _data.slots[_slot];
+  int16_t step = (target - value) / OCCUPANCY_SMOOTH;
+  if (step == 0) {
+    step = (target > value) ? 1 : ((target < value) ? -1 : 0);
+  }
+  _data.slots[_slot] = value + step;
+  _data.hours++;
+}
+
+bool OccupancyManager::isLearnt() {
+  return _data.hours >= OCCUPANCY_MIN_HOURS;
+}
+
+uint8_t OccupancyManager::getPercent(uint8_t weekday, uint8_t hour) {
+  uint8_t slot = getSlot(weekday, hour);
+  if (slot == OCCUPANCY_NO_SLOT) {
+    return 0;
+  }
+  return (uint16_t) _data.slots[slot] * 100 / 255;
+}
+
+bool OccupancyManager::isLikelyOccupied(uint8_t slot) {
+  return ((uint16_t) _data.slots[slot] * 100 / 255) >= OCCUPANCY_WAKE_PERCENT;
+}
+
+// ************************************************************
+// The last few minutes before the hour, and the first few
+// minutes of it. If the room stays empty the normal PIR timeout
+// blanks the display again afterwards.
+// ************************************************************
+bool OccupancyManager::isPreWake(uint8_t weekday, uint8_t hour, uint8_t minute) {
+  uint8_t slot = getSlot(weekday, hour);
+  if (!isLearnt() || (slot == OCCUPANCY_NO_SLOT)) {
+    return false;
+  }
+  uint8_t nextSlot = (slot + 1) % OCCUPANCY_SLOTS;
+  uint8_t lastSlot = (slot + OCCUPANCY_SLOTS - 1) % OCCUPANCY_SLOTS;
+
+  if ((minute >= 60 - OCCUPANCY_PREWAKE_MINS) && isLikelyOccupied(nextSlot) && !isLikelyOccupied(slot)) {
+    return true;
+  }
+  if ((minute < OCCUPANCY_PREWAKE_MINS) && isLikelyOccupied(slot) && !isLikelyOccupied(lastSlot)) {
+    return true;
+  }
+  return false;
+}
+
+bool OccupancyManager::isPredictedEmpty(uint8_t weekday, uint8_t hour) {
+  uint8_t slot = getSlot(weekday, hour);
+  if (!isLearnt() || (slot == OCCUPANCY_NO_SLOT)) {
+    return false;
+  }
+  return ((uint16_t) _data.slots[slot] * 100 / 255) < OCCUPANCY_EMPTY_PERCENT;
+}
+
+uint32_t OccupancyManager::getHours() {
+  return _data.hours;
+}
+
+const occupancy_data_t* OccupancyManager::getData() {
+  return &_data;
+}
+
+// ************************************************************
+// Take saved data, if it is from this version
+// ************************************************************
+bool OccupancyManager::setData(const occupancy_data_t *data) {
+  if ((data->magic != OCCUPANCY_MAGIC) || (data->version != OCCUPANCY_VERSION)) {
+    return false;
+  }
+  memcpy(&_data, data, sizeof(_data));
+  return true;
+}
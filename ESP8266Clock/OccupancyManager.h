@@ -0,0 +1,87 @@
+#ifndef occupancymanager_h
+#define occupancymanager_h
+
+#include <stdint.h>
+
+// ************************************************************
+// Learns when the room is normally occupied, from the PIR, for
+// each of the 168 hours of the week.
+//
+// Once a minute we are told if there was motion. At the end of
+// each hour, the hour counts as occupied if there was motion in
+// at least OCCUPANCY_MOTION_MINUTES minutes of it, and the slot
+// for that hour of the week moves towards 0 or 255 by
+// 1/OCCUPANCY_SMOOTH, so it follows the last few weeks.
+//
+// Once there are OCCUPANCY_MIN_HOURS of data, the clock uses the
+// slots to wake the display a few minutes before a normally
+// occupied hour, and to blank sooner in normally empty hours.
+//
+// The pre-wake only lifts the PIR blanking: the display comes
+// back as it does for motion. The HV supply is not started
+// early and there is no fade in, the display just takes its
+// normal blanking path out.
+//
+// The slots are a fixed size struct, saved as it is.
+// No Arduino dependencies.
+// ************************************************************
+
+#define OCCUPANCY_MAGIC                 0x4f43   // "CO"
+#define OCCUPANCY_VERSION               1
+#define OCCUPANCY_SLOTS                 168      // 7 days * 24 hours
+#define OCCUPANCY_SMOOTH                4        // weeks
+#define OCCUPANCY_MOTION_MINUTES        2
+#define OCCUPANCY_MIN_COVERAGE          30       // minutes of an hour we must have seen to learn from it
+#define OCCUPANCY_MIN_HOURS             336      // two weeks
+#define OCCUPANCY_WAKE_PERCENT          50
+#define OCCUPANCY_EMPTY_PERCENT         10
+#define OCCUPANCY_PREWAKE_MINS          10
+#define OCCUPANCY_NO_SLOT               0xff
+
+typedef struct {
+  uint16_t magic;
+  uint8_t version;
+  uint8_t reserved;
+  uint32_t hours;                                // learnt in total
+  uint8_t slots[OCCUPANCY_SLOTS];                // 0 = never occupied, 255 = always
+} occupancy_data_t;
+
+class OccupancyManager
+{
+  public:
+    OccupancyManager();
+
+    // weekday 1 = Sunday, as TimeLib
+    void addMinute(bool motion, uint8_t weekday, uint8_t hour);
+    void reset();
+
+    bool isLearnt();
+    uint8_t getPercent(uint8_t weekday, uint8_t hour);
+
+    // Around the start of a normally occupied hour that follows
+    // an unoccupied one
+    bool isPreWake(uint8_t weekday, uint8_t hour, uint8_t minute);
+    bool isPredictedEmpty(uint8_t weekday, uint8_t hour);
+
+    uint32_t getHours();
+
+    // For saving and loading
+    const occupancy_data_t* getData();
+    bool setData(const occupancy_data_t *data);
+
+  private:
+    occupancy_data_t _data;
+    uint8_t _slot = OCCUPANCY_NO_SLOT;           // the hour being collected
+    uint8_t _minutes = 0;
+    uint8_t _motionMinutes = 0;
+
+    uint8_t getSlot(uint8_t weekday, uint8_t hour);
+    bool isLikelyOccupied(uint8_t slot);
+    void learnSlot();
+};
+
+// ----------------- Exported Variables ------------------
+
+static OccupancyManager occupancyManager;
+
+#endif
@@ -123,47 +123,157 @@ void OutputManager::outputDisplay() {
     switch (tmpDispType) {
       case BLANKED:
         {
-          setDigitBuffers(i, _digit_buffer.numberArray[i], _digit_buffer.currentNumberArray[i], COUNTS_PER_DIGIT, 0, true);
+          setPendingOutput(i, _digit_buffer.numberArray[i], _digit_buffer.currentNumberArray[i], COUNTS_PER_DIGIT, 0, true);
           break;
         }
       case DIMMED:
         {
-          setDigitBuffers(i, _digit_buffer.numberArray[i], _digit_buffer.currentNumberArray[i], COUNTS_PER_DIGIT_DIM, 0, false);
+          setPendingOutput(i, _digit_buffer.numberArray[i], _digit_buffer.currentNumberArray[i], COUNTS_PER_DIGIT_DIM, 0, false);
           break;
         }
       case BRIGHT:
         {
-          setDigitBuffers(i, _digit_buffer.numberArray[i], _digit_buffer.currentNumberArray[i], COUNTS_PER_DIGIT, 0, false);
+          setPendingOutput(i, _digit_buffer.numberArray[i], _digit_buffer.currentNumberArray[i], COUNTS_PER_DIGIT, 0, false);
           break;
         }
       case NORMAL:
         {
-          setDigitBuffers(i, _digit_buffer.numberArray[i], _digit_buffer.currentNumberArray[i], _ldrValue, 0, false);
+          setPendingOutput(i, _digit_buffer.numberArray[i], _digit_buffer.currentNumberArray[i], _ldrValue, 0, false);
           break;
         }
       case FADE:
         {
           byte switchTime = getSwitchTime(_ldrValue, _digit_buffer.fadeState[i], cc->fadeSteps);
-          setDigitBuffers(i, _digit_buffer.numberArray[i], _digit_buffer.currentNumberArray[i], _ldrValue, switchTime, false);
+          setPendingOutput(i, _digit_buffer.numberArray[i], _digit_buffer.currentNumberArray[i], _ldrValue, switchTime, false);
           break;
         }
       case SCROLL:
         {
           // Set the Switch state to 1 to show the previous digit
-          setDigitBuffers(i, _digit_buffer.numberArray[i], _digit_buffer.currentNumberArray[i], _ldrValue, 1, false);
+          setPendingOutput(i, _digit_buffer.numberArray[i], _digit_buffer.currentNumberArray[i], _ldrValue, 1, false);
           break;
         }
       case BLINK:
         {
           if (_blinkState) {
-            setDigitBuffers(i, _digit_buffer.numberArray[i], _digit_buffer.currentNumberArray[i], _ldrValue, 0, false);
+            setPendingOutput(i, _digit_buffer.numberArray[i], _digit_buffer.currentNumberArray[i], _ldrValue, 0, false);
           } else {
-            setDigitBuffers(i, _digit_buffer.numberArray[i], _digit_buffer.currentNumberArray[i], COUNTS_PER_DIGIT, 0, true);
+            setPendingOutput(i, _digit_buffer.numberArray[i], _digit_buffer.currentNumberArray[i], COUNTS_PER_DIGIT, 0, true);
           }
           break;
         }
     }
+
+    setFadeStatus(i, tmpDispType);
   }
+
+  outputPendingDigits();
+}
+
+// ************************************************************
+// Note what a digit should show in this frame
+// ************************************************************
+void OutputManager::setPendingOutput(byte digit, byte value, byte currValue, byte dimFactor, byte switchTime, bool blanked) {
+  _pendingOutput[digit].value = value % 10;
+  _pendingOutput[digit].prevValue = currValue % 10;
+  _pendingOutput[digit].dimFactor = dimFactor;
+  _pendingOutput[digit].switchTime = switchTime;
+  _pendingOutput[digit].blanked = blanked;
+}
+
+// ************************************************************
+// Build the frame buffers, but only if something is different
+// from the last frame. Between changes (no fade, no blink, no
+// new digits) this does nothing, and there is nothing to commit.
+// ************************************************************
+void OutputManager::outputPendingDigits() {
+  boolean changed = !_lastOutputValid ||
+                    (led1State != _lastLed1State) ||
+                    (led2State != _lastLed2State) ||
+                    (cc->separatorDimFactor != _lastSeparatorDim) ||
+                    (memcmp(_pendingOutput, _lastOutput, sizeof(_lastOutput)) != 0);
+  if (!changed) {
+    return;
+  }
+
+  // All digits, the separator LEDs are merged in across them
+  for (int i = 0 ; i < DIGIT_COUNT ; i++) {
+    digit_output_t *out = &_pendingOutput[i];
+    setDigitBuffers(i, out->value, out->prevValue, out->dimFactor, out->switchTime, out->blanked);
+  }
+
+  memcpy(_lastOutput, _pendingOutput, sizeof(_lastOutput));
+  _lastLed1State = led1State;
+  _lastLed2State = led2State;
+  _lastSeparatorDim = cc->separatorDimFactor;
+  _lastOutputValid = true;
+}
+
+// ************************************************************
+// Record what the digit is showing in this frame, so that the
+// back lights can follow the tube crossfade
+// ************************************************************
+void OutputManager::setFadeStatus(byte digit, byte dispType) {
+  if ((dispType == FADE) && (_digit_buffer.fadeState[digit] > 0)) {
+    _fadeFromValue[digit] = _digit_buffer.currentNumberArray[digit];
+    _fadeToValue[digit] = _digit_buffer.numberArray[digit];
+    _fadeProgress[digit] = (cc->fadeSteps - _digit_buffer.fadeState[digit]) * 255 / cc->fadeSteps;
+  } else if (dispType == SCROLL) {
+    // Scrolling shows the previous value until each step is done
+    _fadeFromValue[digit] = _digit_buffer.currentNumberArray[digit];
+    _fadeToValue[digit] = _digit_buffer.currentNumberArray[digit];
+    _fadeProgress[digit] = 255;
+  } else {
+    _fadeFromValue[digit] = _digit_buffer.numberArray[digit];
+    _fadeToValue[digit] = _digit_buffer.numberArray[digit];
+    _fadeProgress[digit] = 255;
+  }
+}
+
+// ************************************************************
+// Publish the prepared frame to the display interrupt. The copy
+// is done with interrupts off so that the interrupt never shows
+// a mix of two frames.
+//
+// An armed frame (and any frame after it until then) is held
+// back for the interrupt to put up at the armed time. If that
+// time has already gone (e.g. the interrupt was stopped), it
+// goes up straight away.
+// ************************************************************
+void OutputManager::commitDisplayBuffers() {
+  if (!_frameChanged) {
+    _armCommit = false;
+    return;
+  }
+  _frameChanged = false;
+
+  noInterrupts();
+  if (_armCommit) {
+    frameArmedMicros = _armMicros;
+    frameArmed = true;
+  }
+  if (frameArmed && ((long) (micros() - frameArmedMicros) < 0)) {
+    for (int idx = 0 ; idx < COUNTS_PER_DIGIT ; idx++) {
+      valueBufferNext1[idx] = _nextBuffer1[idx];
+      valueBufferNext2[idx] = _nextBuffer2[idx];
+    }
+  } else {
+    frameArmed = false;
+    for (int idx = 0 ; idx < COUNTS_PER_DIGIT ; idx++) {
+      valueBufferCurr1[idx] = _nextBuffer1[idx];
+      valueBufferCurr2[idx] = _nextBuffer2[idx];
+    }
+  }
+  interrupts();
+  _armCommit = false;
+}
+
+// ************************************************************
+// Hold the next commit back until atMicros (micros())
+// ************************************************************
+void OutputManager::armNextCommit(uint32_t atMicros) {
+  _armCommit = true;
+  _armMicros = atMicros;
 }
 
 // ************************************************************
@@ -211,6 +321,8 @@ void OutputManager::setDigitBuffers(byte digit, byte value, byte prevValue, byte
     }
   }
 
+  _frameChanged = true;
+
   // calculate the new column
   uint32_t newVals[COUNTS_PER_DIGIT];
   uint32_t currColVal = 0;
@@ -231,27 +343,27 @@ void OutputManager::setDigitBuffers(byte digit, byte value, byte prevValue, byte
   for (int idx = 0 ; idx < COUNTS_PER_DIGIT ; idx++) {
     switch (digit) {
       case 3: {
-          valueBufferCurr1[idx] = valueBufferCurr1[idx] & 0x3ffffc00 | newVals[idx];
+          _nextBuffer1[idx] = _nextBuffer1[idx] & 0x3ffffc00 | newVals[idx];
           break;
       }
       case 4: {
-          valueBufferCurr1[idx] = valueBufferCurr1[idx] & 0x3ff003ff | newVals[idx] << 10;
+          _nextBuffer1[idx] = _nextBuffer1[idx] & 0x3ff003ff | newVals[idx] << 10;
           break;
       }
       case 5: {
-          valueBufferCurr1[idx] = valueBufferCurr1[idx] & 0xc00fffff | newVals[idx] << 20;
+          _nextBuffer1[idx] = _nextBuffer1[idx] & 0xc00fffff | newVals[idx] << 20;
           break;
       }
       case 0: {
-          valueBufferCurr2[idx] = valueBufferCurr2[idx] & 0x3ffffc00 | newVals[idx];
+          _nextBuffer2[idx] = _nextBuffer2[idx] & 0x3ffffc00 | newVals[idx];
           break;
       }
       case 1: {
-          valueBufferCurr2[idx] = valueBufferCurr2[idx] & 0x3ff003ff | newVals[idx] << 10;
+          _nextBuffer2[idx] = _nextBuffer2[idx] & 0x3ff003ff | newVals[idx] << 10;
           break;
       }
       case 2: {
-          valueBufferCurr2[idx] = valueBufferCurr2[idx] & 0xc00fffff | newVals[idx] << 20;
+          _nextBuffer2[idx] = _nextBuffer2[idx] & 0xc00fffff | newVals[idx] << 20;
           break;
       }
     }
@@ -259,13 +371,13 @@ void OutputManager::setDigitBuffers(byte digit, byte value, byte prevValue, byte
     // merge in the LEDs
     if (cc->separatorDimFactor == 2) {
       if (idx < dimFactor/4) {
-        valueBufferCurr1[idx] |= DECODE_LED[led1State];
-        valueBufferCurr2[idx] |= DECODE_LED[led2State];
+        _nextBuffer1[idx] |= DECODE_LED[led1State];
+        _nextBuffer2[idx] |= DECODE_LED[led2State];
       }
     } else {
       if (idx < dimFactor) {
-        valueBufferCurr1[idx] |= DECODE_LED[led1State];
-        valueBufferCurr2[idx] |= DECODE_LED[led2State];
+        _nextBuffer1[idx] |= DECODE_LED[led1State];
+        _nextBuffer2[idx] |= DECODE_LED[led2State];
       }
     }
   }
@@ -279,8 +391,9 @@ void OutputManager::setDigitBuffers(byte digit, byte value, byte prevValue, byte
 // ************************************************************
 void OutputManager::outputDisplayDiags() {
   // No need to do anything special for this display type
-  // Just do the usual thing
+  // Just do the usual thing, and show it straight away
   outputDisplay();
+  commitDisplayBuffers();
 }
 
 // ************************************************************
@@ -320,26 +433,18 @@ void OutputManager::setBlankingPin() {
 //**********************************************************************************
 
 // ************************************************************
-// Break the time into displayable digits
+// Load the time digits precomputed in the calendar snapshot
 // ************************************************************
-void OutputManager::loadNumberArrayTime() {
-  _digit_buffer.numberArray[5] = second() % 10;
-  _digit_buffer.numberArray[4] = second() / 10;
-  _digit_buffer.numberArray[3] = minute() % 10;
-  _digit_buffer.numberArray[2] = minute() / 10;
-  if (cc->hourMode) {
-    _digit_buffer.numberArray[1] = hourFormat12() % 10;
-    _digit_buffer.numberArray[0] = hourFormat12() / 10;
-  } else {
-    _digit_buffer.numberArray[1] = hour() % 10;
-    _digit_buffer.numberArray[0] = hour() / 10;
-  }
+void OutputManager::loadNumberArrayTime(const calendar_t &cal) {
+  invalidateSource();
+  memcpy(_digit_buffer.numberArray, cal.timeDigits[cc->hourMode ? CALENDAR_HOURS_12 : CALENDAR_HOURS_24], DIGIT_COUNT);
 }
 
 // ************************************************************
 // Break the time into displayable digits
 // ************************************************************
 void OutputManager::loadNumberArraySameValue(byte val) {
+  invalidateSource();
   _digit_buffer.numberArray[5] = val;
   _digit_buffer.numberArray[4] = val;
   _digit_buffer.numberArray[3] = val;
@@ -355,6 +460,7 @@ void OutputManager::loadNumberArrayPOSTMessage(int postValue) {
   loadNumberArrayConfIntWide(postValue);
 
   // Load manually into the display buffer - the display loop is not working yet
+  _lastOutputValid = false;
   for (int i = 0 ; i < DIGIT_COUNT ; i++) {
     setDigitBuffers(i, _digit_buffer.numberArray[i], _digit_buffer.currentNumberArray[i], COUNTS_PER_DIGIT, 0, false);
   }
@@ -363,32 +469,10 @@ void OutputManager::loadNumberArrayPOSTMessage(int postValue) {
 // ************************************************************
 // Break the time into displayable digits
 // ************************************************************
-void OutputManager::loadNumberArrayDate() {
-  switch (cc->dateFormat) {
-    case DATE_FORMAT_YYMMDD:
-      _digit_buffer.numberArray[5] = day() % 10;
-      _digit_buffer.numberArray[4] = day() / 10;
-      _digit_buffer.numberArray[3] = month() % 10;
-      _digit_buffer.numberArray[2] = month() / 10;
-      _digit_buffer.numberArray[1] = (year() - 2000) % 10;
-      _digit_buffer.numberArray[0] = (year() - 2000) / 10;
-      break;
-    case DATE_FORMAT_MMDDYY:
-      _digit_buffer.numberArray[5] = (year() - 2000) % 10;
-      _digit_buffer.numberArray[4] = (year() - 2000) / 10;
-      _digit_buffer.numberArray[3] = day() % 10;
-      _digit_buffer.numberArray[2] = day() / 10;
-      _digit_buffer.numberArray[1] = month() % 10;
-      _digit_buffer.numberArray[0] = month() / 10;
-      break;
-    case DATE_FORMAT_DDMMYY:
-      _digit_buffer.numberArray[5] = (year() - 2000) % 10;
-      _digit_buffer.numberArray[4] = (year() - 2000) / 10;
-      _digit_buffer.numberArray[3] = month() % 10;
-      _digit_buffer.numberArray[2] = month() / 10;
-      _digit_buffer.numberArray[1] = day() % 10;
-      _digit_buffer.numberArray[0] = day() / 10;
-      break;
+void OutputManager::loadNumberArrayDate(const calendar_t &cal) {
+  invalidateSource();
+  if (cc->dateFormat <= DATE_FORMAT_MAX) {
+    memcpy(_digit_buffer.numberArray, cal.dateDigits[cc->dateFormat], DIGIT_COUNT);
   }
 }
 
@@ -396,6 +480,7 @@ void OutputManager::loadNumberArrayDate() {
 // Break the LDR reading into displayable digits
 // ************************************************************
 void OutputManager::loadNumberArrayLDR() {
+  invalidateSource();
   _digit_buffer.numberArray[5] = 0;
   _digit_buffer.numberArray[4] = 0;
 
@@ -410,19 +495,21 @@ void OutputManager::loadNumberArrayLDR() {
 // ************************************************************
 // Test digits
 // ************************************************************
-void OutputManager::loadNumberArrayTestDigits() {
-  _digit_buffer.numberArray[5] =  second() % 10;
-  _digit_buffer.numberArray[4] = (second() + 1) % 10;
-  _digit_buffer.numberArray[3] = (second() + 2) % 10;
-  _digit_buffer.numberArray[2] = (second() + 3) % 10;
-  _digit_buffer.numberArray[1] = (second() + 4) % 10;
-  _digit_buffer.numberArray[0] = (second() + 5) % 10;
+void OutputManager::loadNumberArrayTestDigits(const calendar_t &cal) {
+  invalidateSource();
+  _digit_buffer.numberArray[5] =  cal.second % 10;
+  _digit_buffer.numberArray[4] = (cal.second + 1) % 10;
+  _digit_buffer.numberArray[3] = (cal.second + 2) % 10;
+  _digit_buffer.numberArray[2] = (cal.second + 3) % 10;
+  _digit_buffer.numberArray[1] = (cal.second + 4) % 10;
+  _digit_buffer.numberArray[0] = (cal.second + 5) % 10;
 }
 
 // ************************************************************
 // Show an integer configuration value
 // ************************************************************
 void OutputManager::loadNumberArrayConfInt(int confValue, int confNum) {
+  invalidateSource();
   _digit_buffer.numberArray[5] = (confNum) % 10;
   _digit_buffer.numberArray[4] = (confNum / 10) % 10;
   _digit_buffer.numberArray[3] = (confValue / 1) % 10;
@@ -435,6 +522,7 @@ void OutputManager::loadNumberArrayConfInt(int confValue, int confNum) {
 // Show an integer configuration value
 // ************************************************************
 void OutputManager::loadNumberArrayConfIntWide(int confValue) {
+  invalidateSource();
   _digit_buffer.numberArray[5] = (confValue / 1) % 10;
   _digit_buffer.numberArray[4] = (confValue / 10) % 10;
   _digit_buffer.numberArray[3] = (confValue / 100) % 10;
@@ -447,6 +535,7 @@ void OutputManager::loadNumberArrayConfIntWide(int confValue) {
 // Show a boolean configuration value
 // ************************************************************
 void OutputManager::loadNumberArrayConfBool(boolean confValue, int confNum) {
+  invalidateSource();
   int boolInt;
   if (confValue) {
     boolInt = 1;
@@ -465,6 +554,7 @@ void OutputManager::loadNumberArrayConfBool(boolean confValue, int confNum) {
 // Show an integer configuration value
 // ************************************************************
 void OutputManager::loadNumberArrayIP(byte byte1, byte byte2) {
+  invalidateSource();
   _digit_buffer.numberArray[5] = (byte2) % 10;
   _digit_buffer.numberArray[4] = (byte2 / 10) % 10;
   _digit_buffer.numberArray[3] = (byte2 / 100) % 10;
@@ -477,6 +567,7 @@ void OutputManager::loadNumberArrayIP(byte byte1, byte byte2) {
 // Show an integer configuration value
 // ************************************************************
 void OutputManager::loadNumberArrayESPID(String ID) {
+  invalidateSource();
   byte byteArray[5];
   hexCharacterStringToBytes(byteArray, ID.c_str());
   _digit_buffer.numberArray[5] = byteArray[5];
@@ -490,13 +581,31 @@ void OutputManager::loadNumberArrayESPID(String ID) {
 // ************************************************************
 // Show an integer configuration value
 // ************************************************************
-void OutputManager::loadNumberArrayValueToShow() {
-  _digit_buffer.numberArray[5] = (_value_buffer.valueToShow / 1) % 10;
-  _digit_buffer.numberArray[4] = (_value_buffer.valueToShow / 10) % 10;
-  _digit_buffer.numberArray[3] = (_value_buffer.valueToShow / 100) % 10;
-  _digit_buffer.numberArray[2] = (_value_buffer.valueToShow / 1000) % 10;
-  _digit_buffer.numberArray[1] = (_value_buffer.valueToShow / 10000) % 10;
-  _digit_buffer.numberArray[0] = (_value_buffer.valueToShow / 100000) % 10;
+boolean OutputManager::loadNumberArrayValueToShow() {
+  return loadFromSource(&_valueSource);
+}
+
+// ************************************************************
+// Load the digits from a display source, unless we already
+// have this version of them
+// ************************************************************
+boolean OutputManager::loadFromSource(DisplaySource *source) {
+  if ((source == _loadedSource) && (source->getVersion() == _loadedVersion)) {
+    return false;
+  }
+
+  memcpy(_digit_buffer.numberArray, source->getDigits(), DIGIT_COUNT);
+  _loadedSource = source;
+  _loadedVersion = source->getVersion();
+  return true;
+}
+
+// ************************************************************
+// The digits have been changed behind the back of the source,
+// make sure the next load from a source happens
+// ************************************************************
+void OutputManager::invalidateSource() {
+  _loadedSource = NULL;
 }
 
 // ************************************************************
@@ -669,6 +778,9 @@ void OutputManager::setValueFormat(int newValueFormat) {
     _value_buffer.valueDisplayType[DIGIT_COUNT - idx - 1] = digitFormat;
     newValueFormat = newValueFormat / 10;
   }
+
+  // Make sure the new format gets applied
+  invalidateSource();
 }
 
 // ************************************************************
@@ -691,6 +803,7 @@ void OutputManager::decValueDisplayTime() {
 void OutputManager::setValueToShow(int newValue) {
   int maskVal = 10^DIGIT_COUNT;
   _value_buffer.valueToShow = newValue % maskVal;
+  _valueSource.update(_value_buffer.valueToShow);
 }
 
 // ************************************************************
@@ -700,11 +813,27 @@ byte OutputManager::getNumberArrayIndexedValue(byte idx) {
   return _digit_buffer.numberArray[idx];
 }
 
+// ************************************************************
+// Get the fade status of the digit at index idx
+// ************************************************************
+byte OutputManager::getFadeFromValue(byte idx) {
+  return _fadeFromValue[idx];
+}
+
+byte OutputManager::getFadeToValue(byte idx) {
+  return _fadeToValue[idx];
+}
+
+byte OutputManager::getFadeProgress(byte idx) {
+  return _fadeProgress[idx];
+}
+
 // ************************************************************
 // Set the digit at index idx
 // ************************************************************
 void OutputManager::setNumberArrayIndexedValue(byte idx, byte value) {
   _digit_buffer.numberArray[idx] = value;
+  invalidateSource();
 }
 
 // ************************************************************
@@ -719,4 +848,5 @@ byte OutputManager::getDisplayTypeIndexedValue(byte idx) {
 // ************************************************************
 void OutputManager::setDisplayTypeIndexedValue(byte idx, byte value) {
   _digit_buffer.displayType[idx] = value;
+  invalidateSource();
 }
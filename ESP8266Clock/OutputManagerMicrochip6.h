@@ -5,6 +5,8 @@
 #include "DisplayDefs.h"
 #include "SPIFFS.h"
 #include "LEDManager.h"
+#include "Calendar.h"
+#include "DisplaySources.h"
 
 #define DIGIT_COUNT            6
 
@@ -18,6 +20,10 @@ extern boolean ledRState;
 extern boolean blankTubes;
 extern volatile uint32_t valueBufferCurr1[COUNTS_PER_DIGIT];
 extern volatile uint32_t valueBufferCurr2[COUNTS_PER_DIGIT];
+extern volatile uint32_t valueBufferNext1[COUNTS_PER_DIGIT];
+extern volatile uint32_t valueBufferNext2[COUNTS_PER_DIGIT];
+extern volatile boolean frameArmed;
+extern volatile uint32_t frameArmedMicros;
 
 #define DIM_VALUE             DIGIT_DISPLAY_COUNT / 5;
 
@@ -84,6 +90,16 @@ typedef struct {
     boolean digitBlanked[DIGIT_COUNT];
 } digit_buffer_t;
 
+// Arguments for setDigitBuffers, kept so that we can tell if a
+// frame is the same as the last one
+typedef struct {
+  byte value;
+  byte prevValue;
+  byte dimFactor;
+  byte switchTime;
+  boolean blanked;
+} digit_output_t;
+
 typedef struct {
   int valueToShow;
   byte valueDisplayTime;
@@ -100,20 +116,26 @@ class OutputManager {
     void setConfigObject(spiffs_config_t* ccPtr);
     void outputDisplay();
     void outputDisplayDiags();
+    void commitDisplayBuffers();
+    void armNextCommit(uint32_t atMicros);
     void setLDRValue(unsigned int newBrightness);
 
-    void loadNumberArrayTime();
-    void loadNumberArrayDate();
+    void loadNumberArrayTime(const calendar_t &cal);
+    void loadNumberArrayDate(const calendar_t &cal);
     void loadNumberArraySameValue(byte val);
     void loadNumberArrayPOSTMessage(int val);
-    void loadNumberArrayTestDigits();
+    void loadNumberArrayTestDigits(const calendar_t &cal);
     void loadNumberArrayConfInt(int confValue, int confNum);
     void loadNumberArrayConfIntWide(int confValue);
     void loadNumberArrayConfBool(boolean confValue, int confNum);
     void loadNumberArrayIP(byte byte1, byte byte2);
     void loadNumberArrayLDR();
     void loadNumberArrayESPID(String ID);
-    void loadNumberArrayValueToShow();
+    boolean loadNumberArrayValueToShow();
+
+    // Load the digits from a source if they have changed since the
+    // last load, returns true if they were loaded
+    boolean loadFromSource(DisplaySource *source);
     void loadDisplaySetValueType();
 
     void allNormal(bool leadingBlank);
@@ -133,6 +155,12 @@ class OutputManager {
     void setValueToShow(int newValue);
     void setValueFormat(int newValueFormat);
 
+    // What each digit is showing in the frame being prepared: fading
+    // from one value to another, progress 0..255 (255 = "to" only)
+    byte getFadeFromValue(byte idx);
+    byte getFadeToValue(byte idx);
+    byte getFadeProgress(byte idx);
+
     // used for transition stunts
     byte getNumberArrayIndexedValue(byte idx);
     void setNumberArrayIndexedValue(byte idx, byte value);
@@ -151,16 +179,45 @@ class OutputManager {
 
     float _fadeStep = 0;
 
+    // The frame being prepared, copied to the ISR buffers on commit
+    uint32_t _nextBuffer1[COUNTS_PER_DIGIT];
+    uint32_t _nextBuffer2[COUNTS_PER_DIGIT];
+    bool _armCommit = false;
+    uint32_t _armMicros = 0;
+
+    byte _fadeFromValue[DIGIT_COUNT];
+    byte _fadeToValue[DIGIT_COUNT];
+    byte _fadeProgress[DIGIT_COUNT];
+
     spiffs_config_t *cc;
 
+    // Which source the digits were loaded from, NULL if they were
+    // loaded directly
+    DisplaySource *_loadedSource = NULL;
+    uint32_t _loadedVersion = 0;
+    NumberSource _valueSource;
+
+    // Frame change detection
+    digit_output_t _pendingOutput[DIGIT_COUNT];
+    digit_output_t _lastOutput[DIGIT_COUNT];
+    boolean _lastOutputValid = false;
+    boolean _lastLed1State = false;
+    boolean _lastLed2State = false;
+    byte _lastSeparatorDim = 0;
+    boolean _frameChanged = false;
+
     digit_buffer_t _digit_buffer = {{0,0,0,0,0,0}, {0,0,0,0,0,0}, {NORMAL,NORMAL,NORMAL,NORMAL,NORMAL,NORMAL}, {0,0,0,0,0,0},{false, false, false, false, false, false} };
     value_buffer_t _value_buffer = {0,10,{NORMAL,NORMAL,NORMAL,NORMAL,NORMAL,NORMAL}};
     void setDigitBuffers(byte digit, byte value, byte currValue, byte dimFactor, byte switchTime, bool blanked);
+    void setPendingOutput(byte digit, byte value, byte currValue, byte dimFactor, byte switchTime, bool blanked);
+    void outputPendingDigits();
+    void invalidateSource();
     void blankDigits(byte *digits, byte *prevNums, bool *smoothRun);
     void smoothDigits(byte *digits, byte *prevNums, bool *smoothRun);
     void setBlankingPin();
     void applyBlanking();
     int getSwitchTime(byte offCount, byte fadeState, byte fadeSteps);
+    void setFadeStatus(byte digit, byte dispType);
 };
 
 #endif
@@ -0,0 +1,130 @@
+#include "PIRMonitor.h"
+
+PIRMonitor *PIRMonitor::_instance = NULL;
+
+// ************************************************************
+// Start watching the pin. The pin mode (pullup or not) is set
+// by the caller.
+// ************************************************************
+void PIRMonitor::begin(byte pin, unsigned long nowMillis) {
+  _pin = pin;
+  _instance = this;
+
+  _level = (digitalRead(_pin) == HIGH);
+  _candidateLevel = _level;
+  _candidateMillis = nowMillis;
+  _lastMotionMillis = nowMillis;
+  if (!_level) {
+    _installed = true;
+  }
+
+  attachInterrupt(digitalPinToInterrupt(_pin), edgeISR, CHANGE);
+}
+
+// ************************************************************
+// Edge interrupt: just the time and the level. When the ring is
+// full the edge is counted and dropped, the next one still gives
+// the right level.
+// ************************************************************
+ICACHE_RAM_ATTR void PIRMonitor::edgeISR() {
+  PIRMonitor *monitor = _instance;
+  byte head = monitor->_ringHead;
+  byte next = (head + 1) & (PIR_EDGE_RING_SIZE - 1);
+  if (next == monitor->_ringTail) {
+    monitor->_droppedEdges++;
+    return;
+  }
+  monitor->_ring[head].millis = millis();
+  monitor->_ring[head].level = digitalRead(monitor->_pin);
+  monitor->_ringHead = next;
+}
+
+void PIRMonitor::process(unsigned long nowMillis, void (*edgeCallback)(unsigned long edgeMillis, boolean level)) {
+  while (_ringTail != _ringHead) {
+    unsigned long edgeMillis = _ring[_ringTail].millis;
+    boolean level = (_ring[_ringTail].level == HIGH);
+    _ringTail = (_ringTail + 1) & (PIR_EDGE_RING_SIZE - 1);
+
+    _edgeCount++;
+    if (edgeCallback != NULL) {
+      edgeCallback(edgeMillis, level);
+    }
+
+    if (level) {
+      _rawRise = true;
+    }
+
+    if (level != _candidateLevel) {
+      _candidateLevel = level;
+      _candidateMillis = edgeMillis;
+    }
+  }
+
+  // Debounce: take the new level once it has been held long enough,
+  // from the time it actually changed
+  // (the edge can be a little newer than nowMillis)
+  if ((_candidateLevel != _level) && ((long) (nowMillis - _candidateMillis) >= PIR_DEBOUNCE_MS)) {
+    setLevel(_candidateLevel, _candidateMillis);
+  }
+}
+
+void PIRMonitor::setLevel(boolean level, unsigned long atMillis) {
+  _level = level;
+
+  if (level) {
+    _motionCount++;
+    _intervalPos = (_intervalPos + 1) % PIR_INTERVAL_HISTORY;
+    _intervals[_intervalPos].startMillis = atMillis;
+    _intervals[_intervalPos].endMillis = 0;
+    if (_intervalCount < PIR_INTERVAL_HISTORY) {
+      _intervalCount++;
+    }
+  } else {
+    _installed = true;
+    if (_intervalCount > 0) {
+      _intervals[_intervalPos].endMillis = atMillis;
+    }
+    _lastMotionMillis = atMillis;
+  }
+}
+
+boolean PIRMonitor::isInstalled() {
+  return _installed;
+}
+
+boolean PIRMonitor::isMotion() {
+  return _level;
+}
+
+boolean PIRMonitor::takeRawRise() {
+  boolean rise = _rawRise;
+  _rawRise = false;
+  return rise;
+}
+
+// ************************************************************
+// Now while there is motion, otherwise when it stopped
+// ************************************************************
+unsigned long PIRMonitor::getLastMotionMillis(unsigned long nowMillis) {
+  return _level ? nowMillis : _lastMotionMillis;
+}
+
+boolean PIRMonitor::getInterval(byte index, pir_interval_t *interval) {
+  if (index >= _intervalCount) {
+    return false;
+  }
+  *interval = _intervals[(_intervalPos + PIR_INTERVAL_HISTORY - index) % PIR_INTERVAL_HISTORY];
+  return true;
+}
+
+unsigned long PIRMonitor::getEdgeCount() {
+  return _edgeCount;
+}
+
+unsigned long PIRMonitor::getMotionCount() {
+  return _motionCount;
+}
+
+unsigned long PIRMonitor::getDroppedEdges() {
+  return _droppedEdges;
+}
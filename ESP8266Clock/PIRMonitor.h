@@ -0,0 +1,91 @@
+#ifndef pirmonitor_h
+#define pirmonitor_h
+
+#include "Arduino.h"
+
+// ************************************************************
+// PIR motion detector on a GPIO edge interrupt.
+//
+// The interrupt only puts the pin level and the time of each
+// edge into a small single producer, single consumer ring. The
+// PIR task drains the ring with process(), debounces the edges
+// (a level has to be held for PIR_DEBOUNCE_MS to count) and
+// keeps the last few motion intervals. Nothing depends on how
+// often the loop runs, and a long web request only delays the
+// processing, the edge times are not lost.
+//
+// The PIR is taken as installed the first time the debounced
+// level goes low: without a PIR the pullup holds the pin high.
+// ************************************************************
+
+#define PIR_EDGE_RING_SIZE              16      // power of 2
+#define PIR_DEBOUNCE_MS                 200
+#define PIR_INTERVAL_HISTORY            8
+
+typedef struct {
+  unsigned long millis;
+  byte level;
+} pir_edge_t;
+
+typedef struct {
+  unsigned long startMillis;
+  unsigned long endMillis;                      // 0 while the motion is still going on
+} pir_interval_t;
+
+class PIRMonitor
+{
+  public:
+    void begin(byte pin, unsigned long nowMillis);
+
+    // Drain the edges from the interrupt, calls back with the time
+    // and level of each raw edge (for the input recorder)
+    void process(unsigned long nowMillis, void (*edgeCallback)(unsigned long edgeMillis, boolean level) = NULL);
+
+    boolean isInstalled();
+    boolean isMotion();
+
+    // True once after a raw (not debounced) high edge, for waking
+    // up without waiting for the debounce
+    boolean takeRawRise();
+    unsigned long getLastMotionMillis(unsigned long nowMillis);
+
+    // Most recent first, false if there is no such interval
+    boolean getInterval(byte index, pir_interval_t *interval);
+
+    unsigned long getEdgeCount();
+    unsigned long getMotionCount();
+    unsigned long getDroppedEdges();
+
+  private:
+    static void edgeISR();
+
+    static PIRMonitor *_instance;
+
+    byte _pin = 0;
+    volatile pir_edge_t _ring[PIR_EDGE_RING_SIZE];
+    volatile byte _ringHead = 0;                // written by the interrupt only
+    volatile byte _ringTail = 0;                // written by process() only
+    volatile unsigned long _droppedEdges = 0;
+
+    boolean _candidateLevel = true;
+    unsigned long _candidateMillis = 0;
+    boolean _level = true;
+    boolean _installed = false;
+    boolean _rawRise = false;
+    unsigned long _lastMotionMillis = 0;
+
+    pir_interval_t _intervals[PIR_INTERVAL_HISTORY];
+    byte _intervalPos = 0;
+    byte _intervalCount = 0;
+
+    unsigned long _edgeCount = 0;
+    unsigned long _motionCount = 0;
+
+    void setLevel(boolean level, unsigned long atMillis);
+};
+
+// ----------------- Exported Variables ------------------
+
+static PIRMonitor pirMonitor;
+
+#endif
@@ -0,0 +1,131 @@
+#include "PowerManager.h"
+
+extern "C" {
+#include "user_interface.h"
+}
+
+static const char* const WAKE_REASON_NAMES[WAKE_REASON_COUNT] = {
+  "None",
+  "Blanking ended",
+  "Button",
+  "PIR",
+  "Web"
+};
+
+// ************************************************************
+// Drop the CPU clock and let the modem sleep
+// ************************************************************
+boolean PowerManager::enterLowPower(unsigned long nowMillis) {
+  if (_lowPower) {
+    return true;
+  }
+
+  if (_holdOffActive && ((long) (nowMillis - _holdOffUntilMillis) < 0)) {
+    return false;
+  }
+  _holdOffActive = false;
+
+  system_update_cpu_freq(LOW_POWER_CPU_MHZ);
+  _savedSleepMode = WiFi.getSleepMode();
+  WiFi.setSleepMode(WIFI_MODEM_SLEEP);
+
+  _lowPower = true;
+  _entries++;
+  return true;
+}
+
+// ************************************************************
+// Back to full speed, and the WiFi sleep mode we had before
+// ************************************************************
+void PowerManager::exitLowPower(unsigned long nowMillis, byte wakeReason) {
+  if (!_lowPower) {
+    return;
+  }
+
+  WiFi.setSleepMode(_savedSleepMode);
+  system_update_cpu_freq(NORMAL_CPU_MHZ);
+
+  _lowPower = false;
+  if (wakeReason < WAKE_REASON_COUNT) {
+    _wakeCounts[wakeReason]++;
+    _lastWakeReason = wakeReason;
+  }
+
+  // Blanking ending by itself needs no hold off
+  if (wakeReason != WAKE_SCHEDULE) {
+    _holdOffUntilMillis = nowMillis + LOW_POWER_WAKE_HOLD_MS;
+    _holdOffActive = true;
+  }
+}
+
+boolean PowerManager::isLowPower() {
+  return _lowPower;
+}
+
+// ************************************************************
+// Account the last second to the state we are in now
+// ************************************************************
+void PowerManager::updateStats(byte busyPercent) {
+  if (_lowPower) {
+    _lowPowerSecs++;
+    _lowPowerBusyTotal += busyPercent;
+  } else {
+    _normalSecs++;
+    _normalBusyTotal += busyPercent;
+  }
+}
+
+unsigned long PowerManager::getLowPowerSecs() {
+  return _lowPowerSecs;
+}
+
+unsigned long PowerManager::getNormalSecs() {
+  return _normalSecs;
+}
+
+byte PowerManager::getLowPowerTimePercent() {
+  unsigned long totalSecs = _lowPowerSecs + _normalSecs;
+  if (totalSecs == 0) {
+    return 0;
+  }
+  return (unsigned long long) _lowPowerSecs * 100 / totalSecs;
+}
+
+// ************************************************************
+// Average loop duty cycle while in each state
+// ************************************************************
+byte PowerManager::getLowPowerBusyPercent() {
+  if (_lowPowerSecs == 0) {
+    return 0;
+  }
+  return _lowPowerBusyTotal / _lowPowerSecs;
+}
+
+byte PowerManager::getNormalBusyPercent() {
+  if (_normalSecs == 0) {
+    return 0;
+  }
+  return _normalBusyTotal / _normalSecs;
+}
+
+unsigned long PowerManager::getEntries() {
+  return _entries;
+}
+
+unsigned long PowerManager::getWakeCount(byte wakeReason) {
+  if (wakeReason >= WAKE_REASON_COUNT) {
+    return 0;
+  }
+  return _wakeCounts[wakeReason];
+}
+
+byte PowerManager::getLastWakeReason() {
+  return _lastWakeReason;
+}
+
+const char* PowerManager::getWakeReasonName(byte wakeReason) {
+  if (wakeReason >= WAKE_REASON_COUNT) {
+    return "";
+  }
+  return WAKE_REASON_NAMES[wakeReason];
+}
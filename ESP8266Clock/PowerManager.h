@@ -0,0 +1,69 @@
+#ifndef powermanager_h
+#define powermanager_h
+
+#include "Arduino.h"
+#include <ESP8266WiFi.h>
+
+// ************************************************************
+// Low power state for when the tubes and LEDs are both blanked.
+// Takes the CPU down to 80MHz and lets the WiFi modem sleep
+// between beacons, and keeps the statistics for the duty cycle
+// report. Stopping the display interrupt and slowing the loop
+// is done by the caller.
+//
+// After a wake we hold off going back into low power for a
+// while, so that a button press or a page view has time to
+// take effect before the next blanking check.
+// ************************************************************
+
+#define LOW_POWER_CPU_MHZ               80
+#define NORMAL_CPU_MHZ                  160
+#define LOW_POWER_WAKE_HOLD_MS          5000
+
+// Why we left low power
+#define WAKE_NONE                       0
+#define WAKE_SCHEDULE                   1   // blanking ended by itself
+#define WAKE_BUTTON                     2
+#define WAKE_PIR                        3
+#define WAKE_WEB                        4
+#define WAKE_REASON_COUNT               5
+
+class PowerManager
+{
+  public:
+    // Returns false if we are in the hold off after a wake
+    boolean enterLowPower(unsigned long nowMillis);
+    void exitLowPower(unsigned long nowMillis, byte wakeReason);
+    boolean isLowPower();
+
+    // Once per second: account the last second to the current state
+    void updateStats(byte busyPercent);
+
+    unsigned long getLowPowerSecs();
+    unsigned long getNormalSecs();
+    byte getLowPowerTimePercent();
+    byte getLowPowerBusyPercent();
+    byte getNormalBusyPercent();
+    unsigned long getEntries();
+    unsigned long getWakeCount(byte wakeReason);
+    byte getLastWakeReason();
+    const char* getWakeReasonName(byte wakeReason);
+
+  private:
+    boolean _lowPower = false;
+    unsigned long _holdOffUntilMillis = 0;
+    boolean _holdOffActive = false;
+    WiFiSleepType_t _savedSleepMode = WIFI_NONE_SLEEP;
+
+    unsigned long _lowPowerSecs = 0;
+    unsigned long _normalSecs = 0;
+    unsigned long _lowPowerBusyTotal = 0;
+    unsigned long _normalBusyTotal = 0;
+    unsigned long _entries = 0;
+    unsigned long _wakeCounts[WAKE_REASON_COUNT];
+    byte _lastWakeReason = WAKE_NONE;
+};
+
+static PowerManager powerManager;
+
+#endif
@@ -171,6 +171,25 @@ boolean SPIFFS_CLOCK::getConfigFromSpiffs(spiffs_config_t* spiffs_config) {
           spiffs_config->antiGhost = json["antiGhost"];
           debugMsg("Loaded antiGhost: " + String(spiffs_config->antiGhost));
 
+          // Added later: a config saved before then has no such keys
+          spiffs_config->ledEffect = json.containsKey("ledEffect") ? json["ledEffect"].as<int>() : LED_EFFECT_DEFAULT;
+          debugMsg("Loaded ledEffect: " + String(spiffs_config->ledEffect));
+
+          spiffs_config->ledPalette = json.containsKey("ledPalette") ? json["ledPalette"].as<int>() : LED_PALETTE_DEFAULT;
+          debugMsg("Loaded ledPalette: " + String(spiffs_config->ledPalette));
+
+          spiffs_config->ldrHysteresis = json.containsKey("ldrHysteresis") ? json["ldrHysteresis"].as<int>() : LDR_HYSTERESIS_DEFAULT;
+          debugMsg("Loaded ldrHysteresis: " + String(spiffs_config->ldrHysteresis));
+
+          spiffs_config->ldrSlewMs = json.containsKey("ldrSlewMs") ? json["ldrSlewMs"].as<int>() : LDR_SLEW_MS_DEFAULT;
+          debugMsg("Loaded ldrSlewMs: " + String(spiffs_config->ldrSlewMs));
+
+          spiffs_config->ldrAutoCalibrate = json.containsKey("ldrAutoCalibrate") ? json["ldrAutoCalibrate"].as<bool>() : LDR_AUTO_CALIBRATE_DEFAULT;
+          debugMsg("Loaded ldrAutoCalibrate: " + String(spiffs_config->ldrAutoCalibrate));
+
+          spiffs_config->useOccupancy = json.containsKey("useOccupancy") ? json["useOccupancy"].as<bool>() : USE_OCCUPANCY_DEFAULT;
+          debugMsg("Loaded useOccupancy: " + String(spiffs_config->useOccupancy));
+
           loaded = true;
         } else {
           debugMsg("failed to load json config");
@@ -239,6 +258,12 @@ void SPIFFS_CLOCK::saveConfigToSpiffs(spiffs_config_t* spiffs_config) {
     json["separatorDimFactor"] = spiffs_config->separatorDimFactor;
     json["doNotDimIndLEDs"] = spiffs_config->doNotDimIndLEDs;
     json["antiGhost"] = spiffs_config->antiGhost;
+    json["ledEffect"] = spiffs_config->ledEffect;
+    json["ledPalette"] = spiffs_config->ledPalette;
+    json["ldrHysteresis"] = spiffs_config->ldrHysteresis;
+    json["ldrSlewMs"] = spiffs_config->ldrSlewMs;
+    json["ldrAutoCalibrate"] = spiffs_config->ldrAutoCalibrate;
+    json["useOccupancy"] = spiffs_config->useOccupancy;
 
     File configFile = SPIFFS.open("/config.json", "w");
     if (!configFile) {
@@ -341,6 +366,158 @@ void SPIFFS_CLOCK::saveStatsToSpiffs(spiffs_stats_t* spiffs_stats) {
   SPIFFS.end();
 }
 
+// ************************************************************
+// Get the uploaded LED effect source from the SPIFFS
+// ************************************************************
+boolean SPIFFS_CLOCK::getLedEffectFromSpiffs(String &source) {
+  boolean loaded = false;
+  if (SPIFFS.begin()) {
+    debugMsg("mounted file system");
+    if (SPIFFS.exists("/ledeffect.asm")) {
+      debugMsg("reading LED effect file");
+      File effectFile = SPIFFS.open("/ledeffect.asm", "r");
+      if (effectFile) {
+        source = effectFile.readString();
+        debugMsg("Loaded LED effect: " + String(source.length()) + " bytes");
+        loaded = true;
+        effectFile.close();
+      }
+    }
+  } else {
+    debugMsg("failed to mount FS");
+  }
+
+  SPIFFS.end();
+  return loaded;
+}
+
+// ************************************************************
+// Save the uploaded LED effect source to the SPIFFS
+// ************************************************************
+void SPIFFS_CLOCK::saveLedEffectToSpiffs(String source) {
+  if (SPIFFS.begin()) {
+    debugMsg("mounted file system");
+    debugMsg("saving LED effect");
+
+    File effectFile = SPIFFS.open("/ledeffect.asm", "w");
+    if (!effectFile) {
+      debugMsg("failed to open LED effect file for writing");
+      effectFile.close();
+      return;
+    }
+
+    effectFile.print(source);
+    effectFile.close();
+    debugMsg("Saved LED effect");
+  } else {
+    debugMsg("failed to mount FS");
+  }
+  SPIFFS.end();
+}
+
+// ************************************************************
+// Append recorded input events to the log, returns the new size
+// of the log
+// ************************************************************
+size_t SPIFFS_CLOCK::appendRecorderLog(const uint8_t *data, size_t length) {
+  size_t size = 0;
+  if (SPIFFS.begin()) {
+    File logFile = SPIFFS.open(RECORDER_LOG_FILE, "a");
+    if (logFile) {
+      logFile.write(data, length);
+      size = logFile.size();
+      logFile.close();
+    } else {
+      debugMsg("failed to open recorder log for writing");
+    }
+  } else {
+    debugMsg("failed to mount FS");
+  }
+  SPIFFS.end();
+  return size;
+}
+
+// ************************************************************
+// Size of the recorder log, 0 if there is none
+// ************************************************************
+size_t SPIFFS_CLOCK::getRecorderLogSize() {
+  size_t size = 0;
+  if (SPIFFS.begin()) {
+    if (SPIFFS.exists(RECORDER_LOG_FILE)) {
+      File logFile = SPIFFS.open(RECORDER_LOG_FILE, "r");
+      if (logFile) {
+        size = logFile.size();
+        logFile.close();
+      }
+    }
+  } else {
+    debugMsg("failed to mount FS");
+  }
+  SPIFFS.end();
+  return size;
+}
+
+// ************************************************************
+// Throw the recorder log away
+// ************************************************************
+void SPIFFS_CLOCK::clearRecorderLog() {
+  if (SPIFFS.begin()) {
+    if (SPIFFS.exists(RECORDER_LOG_FILE)) {
+      SPIFFS.remove(RECORDER_LOG_FILE);
+      debugMsg("Removed recorder log");
+    }
+  } else {
+    debugMsg("failed to mount FS");
+  }
+  SPIFFS.end();
+}
+
+// ************************************************************
+// Get learnt data (LDR light levels, occupancy). Only loaded if
+// the file is exactly the size we expect, the caller checks the
+// contents.
+// ************************************************************
+boolean SPIFFS_CLOCK::getLearntDataFromSpiffs(const char *fileName, uint8_t *data, size_t length) {
+  boolean loaded = false;
+  if (SPIFFS.begin()) {
+    if (SPIFFS.exists(fileName)) {
+      File dataFile = SPIFFS.open(fileName, "r");
+      if (dataFile) {
+        if (dataFile.size() == length) {
+          loaded = (dataFile.read(data, length) == length);
+          debugMsg("Loaded " + String(fileName));
+        } else {
+          debugMsg(String(fileName) + " has the wrong size");
+        }
+        dataFile.close();
+      }
+    }
+  } else {
+    debugMsg("failed to mount FS");
+  }
+  SPIFFS.end();
+  return loaded;
+}
+
+// ************************************************************
+// Save learnt data
+// ************************************************************
+void SPIFFS_CLOCK::saveLearntDataToSpiffs(const char *fileName, const uint8_t *data, size_t length) {
+  if (SPIFFS.begin()) {
+    File dataFile = SPIFFS.open(fileName, "w");
+    if (dataFile) {
+      dataFile.write(data, length);
+      dataFile.close();
+      debugMsg("Saved " + String(fileName));
+    } else {
+      debugMsg("failed to open " + String(fileName) + " for writing");
+    }
+  } else {
+    debugMsg("failed to mount FS");
+  }
+  SPIFFS.end();
+}
+
 // ************************************************************
 // Output a logging message to the debug output, if set
 // ************************************************************
@@ -6,6 +6,11 @@
 
 #include "ClockDefs.h"
 
+#define RECORDER_LOG_FILE "/inputs.rec"
+#define LDR_CAL_FILE "/ldrcal.bin"
+#define OCCUPANCY_FILE "/occupancy.bin"
+#define CLOCK_FREQ_FILE "/clockfreq.bin"
+
 // ------------------------ Types ------------------------
 
 typedef void (*DebugCallback) (String);
@@ -54,6 +59,12 @@ typedef struct {
   byte separatorDimFactor;
   boolean doNotDimIndLEDs;
   byte antiGhost;
+  byte ledEffect;
+  byte ledPalette;
+  int ldrHysteresis;
+  int ldrSlewMs;
+  boolean ldrAutoCalibrate;
+  boolean useOccupancy;
 } spiffs_config_t;
 
 typedef struct {
@@ -78,6 +89,16 @@ class SPIFFS_CLOCK
     boolean getStatsFromSpiffs(spiffs_stats_t* spiffs_stats);
     void    saveStatsToSpiffs(spiffs_stats_t* spiffs_stats);
 
+    boolean getLedEffectFromSpiffs(String &source);
+    void    saveLedEffectToSpiffs(String source);
+
+    size_t  appendRecorderLog(const uint8_t *data, size_t length);
+    size_t  getRecorderLogSize();
+    void    clearRecorderLog();
+
+    boolean getLearntDataFromSpiffs(const char *fileName, uint8_t *data, size_t length);
+    void    saveLearntDataToSpiffs(const char *fileName, const uint8_t *data, size_t length);
+
     // callbacks
     void setDebugCallback(DebugCallback dbcb);
   private:
@@ -0,0 +1,31 @@
+// ************************************************************
+// Just enough of Arduino.h to build the portable clock classes
+// on the host. The pins read as "not pressed", the replay feeds
+// the recorded levels in instead.
+// ************************************************************
+
+#ifndef host_arduino_h
+#define host_arduino_h
+
+#include <stdint.h>
+#include <string.h>
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define INPUT           0
+#define OUTPUT          1
+#define INPUT_PULLUP    2
+#define LOW             0
+#define HIGH            1
+#define CHANGE          3
+
+#define ICACHE_RAM_ATTR
+
+inline void pinMode(int pin, int mode) { (void) pin; (void) mode; }
+inline int digitalRead(int pin) { (void) pin; return HIGH; }
+inline unsigned long millis() { return 0; }
+inline int digitalPinToInterrupt(int pin) { return pin; }
+inline void attachInterrupt(int interrupt, void (*isr)(), int mode) { (void) interrupt; (void) isr; (void) mode; }
+
+#endif
@@ -0,0 +1,257 @@
+// ************************************************************
+// Host side replay of an input recorder log from the clock
+// (download it from http://<clock>/inputs.rec).
+//
+// Build:
+//   cd tools/inputreplay
+//   g++ -O2 -Ihost -I../../ESP8266Clock -o inputreplay inputreplay.cpp ../../ESP8266Clock/InputRecorder.cpp ../../ESP8266Clock/ClockButton.cpp ../../ESP8266Clock/LDRManager.cpp
+//
+// Usage:
+//   inputreplay [-d] [-b] inputs.rec
+//
+//   Replays the log in time order, running the button through the
+//   same ClockButton debounce and gesture events as the clock
+//   (each recorded level change is an edge), the LDR readings through
+//   the same filter with the default settings, and prints the button
+//   gestures, PIR activity, dimming changes, time jumps and web
+//   requests as they happen. With -d every decoded event is printed as well. With -b
+//   it also times the decode and replay on this host.
+// ************************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <chrono>
+
+#include "InputRecorder.h"
+#include "ClockButton.h"
+#include "LDRManager.h"
+
+// Same as TASK_PERIOD_BUTTON_MS in ClockDefs.h
+#define BUTTON_PERIOD_MS 10
+
+// Same as TASK_PERIOD_LDR_MS and the LDR defaults in ClockDefs.h
+#define LDR_PERIOD_MS 50
+#define LDR_THRESHOLD 50
+#define LDR_SENSITIVITY 300
+#define LDR_SMOOTH_READINGS 100
+#define LDR_MIN_DIM 4
+#define LDR_MAX_DIM 20
+#define LDR_HYSTERESIS 20
+#define LDR_SLEW_MS 500
+
+typedef struct {
+  unsigned long events;
+  unsigned long gestures;
+  unsigned long pirEdges;
+  unsigned long pirHighMillis;
+  unsigned long durationMillis;
+  unsigned long dimmingChanges;
+} replay_stats_t;
+
+static uint8_t *readFile(const char *fileName, uint32_t *length) {
+  FILE *f = fopen(fileName, "rb");
+  if (f == NULL) {
+    return NULL;
+  }
+  fseek(f, 0, SEEK_END);
+  long size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  uint8_t *data = (uint8_t *) malloc(size > 0 ? size : 1);
+  *length = fread(data, 1, size, f);
+  fclose(f);
+  return data;
+}
+
+// ************************************************************
+// Run the button task up to (but not including) untilMillis
+// ************************************************************
+static void runButtonUntil(ClockButton &button, bool pressed, uint32_t &buttonMillis, uint32_t untilMillis, bool print, replay_stats_t &stats) {
+  while (buttonMillis < untilMillis) {
+    button.checkButton(buttonMillis, pressed);
+
+    button_event_t event;
+    while (button.getEvent(&event)) {
+      if (event.type == BUTTON_EVENT_PRESS) {
+        continue;
+      }
+      stats.gestures++;
+      if (print) {
+        printf("%10lu mS  button %s\n", event.millis, getButtonEventName(event.type));
+      }
+    }
+    buttonMillis += BUTTON_PERIOD_MS;
+  }
+}
+
+// ************************************************************
+// Run the LDR task up to (but not including) untilMillis, with
+// the last recorded reading (only changes are recorded)
+// ************************************************************
+static void runLDRUntil(LDRManager &ldr, int raw, uint32_t &ldrMillis, uint32_t untilMillis, bool print, replay_stats_t &stats) {
+  while (ldrMillis < untilMillis) {
+    if (raw >= 0) {
+      ldr.addSample(raw);
+      if (ldr.updateDimming(ldrMillis) && (ldr.getDimmingChanges() > 1)) {
+        stats.dimmingChanges++;
+        if (print) {
+          printf("%10u mS  LDR dimming %u (reading %u)\n", ldrMillis, ldr.getDimming(), ldr.getReading());
+        }
+      }
+    }
+    ldrMillis += LDR_PERIOD_MS;
+  }
+}
+
+// ************************************************************
+// One pass over the whole log
+// ************************************************************
+static bool replay(const uint8_t *log, uint32_t length, bool dump, bool print, replay_stats_t &stats) {
+  InputLogReader reader(log, length);
+  ClockButton button(0, CLOCK_BUTTON_ACTIVE_LO);
+  LDRManager ldr;
+  rec_event_t event;
+
+  bool pressed = false;
+  bool pirLevel = false;
+  uint32_t pirHighStart = 0;
+  uint32_t buttonMillis = 0;
+  uint32_t sectionMillis = 0;
+  int ldrRaw = -1;
+  uint32_t ldrMillis = 0;
+
+  stats = replay_stats_t();
+  ldr.setConfig(true, LDR_THRESHOLD, LDR_SENSITIVITY, LDR_SMOOTH_READINGS, LDR_MIN_DIM, LDR_MAX_DIM);
+  ldr.setStepLimits(LDR_HYSTERESIS, LDR_SLEW_MS);
+
+  while (reader.next(&event)) {
+    stats.events++;
+
+    if (event.type == REC_START) {
+      // A new section: finish the last one where it ended (the clock
+      // restarted there) and start the clocks again
+      runButtonUntil(button, pressed, buttonMillis, sectionMillis, print, stats);
+      if (pirLevel) {
+        stats.pirHighMillis += sectionMillis - pirHighStart;
+      }
+      stats.durationMillis += sectionMillis;
+      button.reset();
+      ldr.reset();
+      pressed = false;
+      pirLevel = false;
+      ldrRaw = -1;
+      buttonMillis = 0;
+      sectionMillis = 0;
+      ldrMillis = 0;
+      if (print) {
+        printf("---------- start of recording ----------\n");
+      }
+      continue;
+    }
+
+    runButtonUntil(button, pressed, buttonMillis, event.millis, print, stats);
+    runLDRUntil(ldr, ldrRaw, ldrMillis, event.millis, print, stats);
+    sectionMillis = event.millis;
+
+    if (dump) {
+      printf("%10u mS  %-6s %u %s\n", event.millis, getRecEventName(event.type), event.value, event.text);
+    }
+
+    switch (event.type) {
+      case REC_BUTTON:
+        pressed = (event.value != 0);
+        break;
+      case REC_PIR:
+        if ((event.value != 0) != pirLevel) {
+          pirLevel = (event.value != 0);
+          stats.pirEdges++;
+          if (pirLevel) {
+            pirHighStart = event.millis;
+          } else {
+            stats.pirHighMillis += event.millis - pirHighStart;
+          }
+          if (print) {
+            printf("%10u mS  PIR %s\n", event.millis, pirLevel ? "motion" : "quiet");
+          }
+        }
+        break;
+      case REC_LDR:
+        ldrRaw = event.value;
+        break;
+      case REC_TIME:
+        if (print) {
+          time_t t = event.value;
+          char timeText[32];
+          strftime(timeText, sizeof(timeText), "%Y-%m-%d %H:%M:%S", gmtime(&t));
+          printf("%10u mS  time set to %s (local)\n", event.millis, timeText);
+        }
+        break;
+      case REC_HTTP:
+        if (print) {
+          printf("%10u mS  web request %s\n", event.millis, event.text);
+        }
+        break;
+    }
+  }
+
+  runButtonUntil(button, pressed, buttonMillis, buttonMillis + 1000, print, stats);
+  if (pirLevel) {
+    stats.pirHighMillis += sectionMillis - pirHighStart;
+  }
+  stats.durationMillis += sectionMillis;
+
+  return !reader.isDamaged();
+}
+
+int main(int argc, char **argv) {
+  bool dump = false;
+  bool bench = false;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "db")) != -1) {
+    switch (opt) {
+      case 'd': dump = true; break;
+      case 'b': bench = true; break;
+      default:
+        fprintf(stderr, "usage: %s [-d] [-b] inputs.rec\n", argv[0]);
+        return 2;
+    }
+  }
+  if (optind >= argc) {
+    fprintf(stderr, "usage: %s [-d] [-b] inputs.rec\n", argv[0]);
+    return 2;
+  }
+
+  uint32_t length;
+  uint8_t *log = readFile(argv[optind], &length);
+  if (log == NULL) {
+    fprintf(stderr, "can't read %s\n", argv[optind]);
+    return 2;
+  }
+
+  replay_stats_t stats;
+  bool ok = replay(log, length, dump, true, stats);
+
+  printf("\n%u bytes, %lu events over %.1f s, %lu button gestures, %lu PIR edges (motion %.1f%% of the time), %lu dimming changes\n",
+         length, stats.events, stats.durationMillis / 1000.0, stats.gestures, stats.pirEdges,
+         stats.durationMillis ? (100.0 * stats.pirHighMillis / stats.durationMillis) : 0.0, stats.dimmingChanges);
+  if (!ok) {
+    printf("log is damaged after the last event shown\n");
+  }
+
+  if (bench) {
+    const int passes = 100;
+    auto start = std::chrono::steady_clock::now();
+    for (int pass = 0 ; pass < passes ; pass++) {
+      replay(log, length, false, false, stats);
+    }
+    auto end = std::chrono::steady_clock::now();
+    double nsPerPass = std::chrono::duration<double, std::nano>(end - start).count() / passes;
+    printf("replay %.0f uS per pass, %.0f nS per event, %.1f nS per button task run on this host\n",
+           nsPerPass / 1000.0, stats.events ? nsPerPass / stats.events : 0.0,
+           stats.durationMillis ? nsPerPass / (stats.durationMillis / BUTTON_PERIOD_MS) : 0.0);
+  }
+
+  free(log);
+  return ok ? 0 : 1;
+}
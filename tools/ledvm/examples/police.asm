@@ -0,0 +1,26 @@
+; Alternate red and blue halves, flashing twice per period.
+; The under lights are always the opposite colour.
+
+    TIME
+    64
+    AND         ; 0 or 64: which half of the flash cycle
+    DIGIT
+    3
+    LT          ; 1 for the left three digits
+    ZONE
+    XOR
+    64
+    MUL
+    EQ
+    JZ blue
+    255
+    0
+    0
+    RGB
+    END
+blue:
+    0
+    0
+    255
+    RGB
+    END
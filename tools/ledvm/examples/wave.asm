@@ -0,0 +1,11 @@
+; A sine wave of brightness running across the digits, coloured
+; from the palette. The under lights follow half a turn behind.
+
+    TIME
+    OFFSET
+    ADD         ; position in the wave for this pixel
+    DUP         ; palette position
+    SWAP
+    SIN         ; brightness
+    PALV
+    END
@@ -0,0 +1,163 @@
+// ************************************************************
+// Host side assembler / simulator for the LED effect bytecode.
+// Uses the same LEDEffectVM and LEDEffects code as the clock, so
+// what you see here is what the clock will do.
+//
+// Build:
+//   cd tools/ledvm
+//   g++ -O2 -I../../ESP8266Clock -o ledvm ledvm.cpp ../../ESP8266Clock/LEDEffectVM.cpp ../../ESP8266Clock/LEDEffects.cpp
+//
+// Usage:
+//   ledvm [-p palette] [-s cycleSpeed] [-f frames] [-b] effect.asm
+//   ledvm [-p palette] [-s cycleSpeed] -B
+//
+//   Assembles the effect, prints the bytecode, then prints the
+//   colours of each pixel for a number of frames spread over one
+//   effect period. With -b it also times the interpreter and
+//   reports the instruction counts against the frame budget.
+//   With -B it times the built in effects (LED_EFFECTS) instead.
+//
+// Upload the .asm file to the clock with
+//   curl -u admin:setup --data-binary @effect.asm http://<clock>/ledeffect
+// ************************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <chrono>
+
+#include "LEDEffectVM.h"
+
+// Same as EFFECT_PERIOD_MS_PER_SPEED in LEDManager.h
+#define PERIOD_MS_PER_SPEED 500
+
+// ************************************************************
+// Time each of the built in effects, the same way as -b times
+// the uploaded one
+// ************************************************************
+static void benchBuiltinEffects(int palette, uint32_t period) {
+  const int benchFrames = 100000;
+  rgb_t pixels[EFFECT_PIXEL_COUNT];
+
+  printf("palette %s, period %u mS\n", LED_PALETTES[palette].name, period);
+  for (uint8_t effect = 0 ; effect < LED_EFFECT_COUNT ; effect++) {
+    uint32_t check = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int frame = 0 ; frame < benchFrames ; frame++) {
+      renderLedEffect(effect, palette, frame * 10, period, pixels);
+      check += pixels[frame % EFFECT_PIXEL_COUNT].r;
+    }
+    auto end = std::chrono::steady_clock::now();
+    double nsPerFrame = std::chrono::duration<double, std::nano>(end - start).count() / benchFrames;
+
+    printf("%-16s %.0f nS per frame on this host (check %u)\n", LED_EFFECTS[effect].name, nsPerFrame, check);
+  }
+}
+
+static char *readFile(const char *fileName) {
+  FILE *f = fopen(fileName, "rb");
+  if (f == NULL) {
+    return NULL;
+  }
+  fseek(f, 0, SEEK_END);
+  long size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  char *text = (char *) malloc(size + 1);
+  size_t got = fread(text, 1, size, f);
+  text[got] = 0;
+  fclose(f);
+  return text;
+}
+
+int main(int argc, char **argv) {
+  int palette = 0;
+  int cycleSpeed = 10;
+  int frames = 16;
+  bool bench = false;
+  bool benchBuiltin = false;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "p:s:f:bB")) != -1) {
+    switch (opt) {
+      case 'p': palette = atoi(optarg); break;
+      case 's': cycleSpeed = atoi(optarg); break;
+      case 'f': frames = atoi(optarg); break;
+      case 'b': bench = true; break;
+      case 'B': benchBuiltin = true; break;
+      default:
+        fprintf(stderr, "usage: %s [-p palette] [-s cycleSpeed] [-f frames] [-b] effect.asm | -B\n", argv[0]);
+        return 2;
+    }
+  }
+  if ((palette < 0) || (palette >= LED_PALETTE_COUNT) || (frames < 1)) {
+    fprintf(stderr, "usage: %s [-p palette] [-s cycleSpeed] [-f frames] [-b] effect.asm | -B\n", argv[0]);
+    return 2;
+  }
+
+  if (benchBuiltin) {
+    benchBuiltinEffects(palette, cycleSpeed * PERIOD_MS_PER_SPEED);
+    return 0;
+  }
+
+  if (optind >= argc) {
+    fprintf(stderr, "usage: %s [-p palette] [-s cycleSpeed] [-f frames] [-b] effect.asm | -B\n", argv[0]);
+    return 2;
+  }
+
+  char *source = readFile(argv[optind]);
+  if (source == NULL) {
+    fprintf(stderr, "can't read %s\n", argv[optind]);
+    return 2;
+  }
+
+  static LedEffectVM vm;
+  char error[80];
+  if (!vm.assemble(source, error, sizeof(error))) {
+    fprintf(stderr, "%s: %s\n", argv[optind], error);
+    return 1;
+  }
+
+  printf("%u bytes:", vm.getCodeLength());
+  for (uint16_t i = 0 ; i < vm.getCodeLength() ; i++) {
+    printf("%s%02x", (i % 16) ? " " : "\n  ", vm.getCode()[i]);
+  }
+  printf("\n\npalette %s, period %d mS\n", LED_PALETTES[palette].name, cycleSpeed * PERIOD_MS_PER_SPEED);
+
+  uint32_t period = cycleSpeed * PERIOD_MS_PER_SPEED;
+  rgb_t pixels[EFFECT_PIXEL_COUNT];
+  for (int frame = 0 ; frame < frames ; frame++) {
+    uint32_t nowMillis = (uint64_t) period * frame / frames;
+    uint8_t phase;
+    uint32_t cycle;
+    effectPhase(nowMillis, period, phase, cycle);
+    vm.render(phase, cycle, &LED_PALETTES[palette], pixels);
+
+    printf("%6u mS |", nowMillis);
+    for (uint8_t i = 0 ; i < EFFECT_PIXEL_COUNT ; i++) {
+      printf(" %02x%02x%02x%s", pixels[i].r, pixels[i].g, pixels[i].b, (i == EFFECT_DIGIT_COUNT - 1) ? " |" : "");
+    }
+    printf(" | %u instr\n", vm.getLastFrameInstructions());
+  }
+
+  if (bench) {
+    const int benchFrames = 100000;
+    vm.resetStats();
+    auto start = std::chrono::steady_clock::now();
+    for (int frame = 0 ; frame < benchFrames ; frame++) {
+      uint8_t phase;
+      uint32_t cycle;
+      effectPhase(frame * 10, period, phase, cycle);
+      vm.render(phase, cycle, &LED_PALETTES[palette], pixels);
+    }
+    auto end = std::chrono::steady_clock::now();
+    double nsPerFrame = std::chrono::duration<double, std::nano>(end - start).count() / benchFrames;
+
+    printf("\nmax %u of %u instructions per frame, %.0f nS per frame on this host\n",
+           vm.getMaxFrameInstructions(), LEDVM_FRAME_BUDGET, nsPerFrame);
+  }
+
+  printf("overruns %u, faults %u\n", vm.getOverruns(), vm.getFaults());
+  free(source);
+  return (vm.getOverruns() || vm.getFaults()) ? 1 : 0;
+}
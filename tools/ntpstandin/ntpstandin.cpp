@@ -0,0 +1,365 @@
+// ************************************************************
+// Host side NTP stand-in servers with injectable latency, and a
+// client that runs the clock's NTP burst, clock filter and server
+// selection against them (or against real servers).
+//
+// Build:
+//   cd tools/ntpstandin
+//   g++ -O2 -I../../ESP8266Clock -o ntpstandin ntpstandin.cpp ../../ESP8266Clock/NtpPacket.cpp ../../ESP8266Clock/NtpClockFilter.cpp
+//
+// Usage:
+//   ntpstandin -S port[:offset[:requestDelay[:replyDelay[:jitter[:loss]]]]] ...
+//
+//   Runs one stand-in server per -S, all times in mS. The server
+//   time is this host's clock plus offset. requestDelay holds the
+//   request back before it is time stamped (a slow path to the
+//   server), replyDelay holds the reply back after it is stamped
+//   (a slow path back), each plus a random 0..jitter. loss is the
+//   percentage of requests that get no reply. Point the clock's
+//   NTP pool at this host to test it with a stand-in on port 123.
+//
+//   ntpstandin -c [-n bursts] [-k samples] host:port ...
+//
+//   Client: each burst sends samples requests to every server,
+//   then prints each server's filtered offset, delay, jitter and
+//   reach, and the selected system offset and jitter. The local
+//   timescale is this host's clock, so the offset is how far the
+//   servers are from it.
+//
+// Example, three honest servers and one 300 mS out:
+//   ntpstandin -S 12301:0:5:5:20 -S 12302:0:2:30:10 -S 12303:0:1:1:5 -S 12304:300:2:2:5 &
+//   ntpstandin -c -n 3 127.0.0.1:12301 127.0.0.1:12302 127.0.0.1:12303 127.0.0.1:12304
+// ************************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "NtpPacket.h"
+#include "NtpClockFilter.h"
+
+#define MAX_STANDINS 8
+#define MAX_PENDING 64
+#define CLIENT_WAIT_MS 1000
+#define CLIENT_SPACING_MS 200
+
+typedef struct {
+  int fd;
+  int port;
+  int64_t offsetUs;
+  int requestDelayMs;
+  int replyDelayMs;
+  int jitterMs;
+  int lossPercent;
+} standin_t;
+
+typedef struct {
+  bool used;
+  standin_t *standin;
+  sockaddr_in client;
+  uint8_t request[NTP_PACKET_SIZE];
+  int64_t receiveDueUs;                         // time stamp the request then
+  int64_t receiveUs;
+  int64_t sendDueUs;                            // 0 until stamped
+} pending_t;
+
+static int64_t nowUs() {
+  timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (int64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int randomMs(int maxMs) {
+  return (maxMs > 0) ? (rand() % (maxMs + 1)) : 0;
+}
+
+static int openSocket(int port) {
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+  if (bind(fd, (sockaddr *) &addr, sizeof(addr)) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// ************************************************************
+// Server reply: mode 4, stratum 2, the request's transmit time
+// as our originate time
+// ************************************************************
+static void buildReply(const pending_t *p, uint8_t *reply, int64_t transmitUs) {
+  memset(reply, 0, NTP_PACKET_SIZE);
+  reply[0] = (0 << 6) | (4 << 3) | 4;
+  reply[1] = 2;
+  reply[2] = p->request[2];
+  reply[3] = (uint8_t) -20;
+  reply[6] = 0x01;                              // root delay ~4 mS
+  reply[10] = 0x01;                             // root dispersion ~4 mS
+  memcpy(&reply[12], "LOCL", 4);
+  ntpWriteTimestamp(reply, 16, transmitUs - 16000000);
+  memcpy(&reply[24], &p->request[40], 8);
+  ntpWriteTimestamp(reply, 32, p->receiveUs);
+  ntpWriteTimestamp(reply, 40, transmitUs);
+}
+
+static int runServers(standin_t *standins, int count) {
+  pending_t pending[MAX_PENDING];
+  memset(pending, 0, sizeof(pending));
+  pollfd fds[MAX_STANDINS];
+  for (int i = 0 ; i < count ; i++) {
+    fds[i].fd = standins[i].fd;
+    fds[i].events = POLLIN;
+    printf("stand-in on port %d: offset %lld mS, delay %d + %d mS, jitter %d mS, loss %d%%\n",
+           standins[i].port, (long long) (standins[i].offsetUs / 1000), standins[i].requestDelayMs,
+           standins[i].replyDelayMs, standins[i].jitterMs, standins[i].lossPercent);
+  }
+  fflush(stdout);
+
+  while (true) {
+    // Sleep until the next thing to do, or a request
+    int64_t now = nowUs();
+    int64_t nextUs = now + 1000000;
+    for (int i = 0 ; i < MAX_PENDING ; i++) {
+      if (pending[i].used) {
+        int64_t due = (pending[i].sendDueUs == 0) ? pending[i].receiveDueUs : pending[i].sendDueUs;
+        if (due < nextUs) {
+          nextUs = due;
+        }
+      }
+    }
+    int timeoutMs = (nextUs > now) ? (int) ((nextUs - now + 999) / 1000) : 0;
+    poll(fds, count, timeoutMs);
+
+    for (int i = 0 ; i < count ; i++) {
+      if (!(fds[i].revents & POLLIN)) {
+        continue;
+      }
+      uint8_t buffer[512];
+      sockaddr_in client;
+      socklen_t clientLength = sizeof(client);
+      ssize_t length = recvfrom(fds[i].fd, buffer, sizeof(buffer), 0, (sockaddr *) &client, &clientLength);
+      if ((length < NTP_PACKET_SIZE) || ((buffer[0] & 0x07) != 3)) {
+        continue;
+      }
+      if ((rand() % 100) < standins[i].lossPercent) {
+        continue;
+      }
+      for (int j = 0 ; j < MAX_PENDING ; j++) {
+        if (!pending[j].used) {
+          pending[j].used = true;
+          pending[j].standin = &standins[i];
+          pending[j].client = client;
+          memcpy(pending[j].request, buffer, NTP_PACKET_SIZE);
+          pending[j].receiveDueUs = nowUs() + (int64_t) (standins[i].requestDelayMs + randomMs(standins[i].jitterMs)) * 1000;
+          pending[j].sendDueUs = 0;
+          break;
+        }
+      }
+    }
+
+    now = nowUs();
+    for (int j = 0 ; j < MAX_PENDING ; j++) {
+      pending_t *p = &pending[j];
+      if (!p->used) {
+        continue;
+      }
+      if ((p->sendDueUs == 0) && (now >= p->receiveDueUs)) {
+        p->receiveUs = now + p->standin->offsetUs;
+        p->sendDueUs = now + (int64_t) (p->standin->replyDelayMs + randomMs(p->standin->jitterMs)) * 1000;
+      }
+      if ((p->sendDueUs != 0) && (now >= p->sendDueUs)) {
+        // Stamped as sent when the slow path back started
+        uint8_t reply[NTP_PACKET_SIZE];
+        buildReply(p, reply, p->receiveUs + 50);
+        sendto(p->standin->fd, reply, NTP_PACKET_SIZE, 0, (sockaddr *) &p->client, sizeof(p->client));
+        p->used = false;
+      }
+    }
+  }
+  return 0;
+}
+
+// ************************************************************
+// Client: bursts through the clock's filter
+// ************************************************************
+static bool parseHostPort(const char *text, sockaddr_in *addr) {
+  char host[64];
+  int port = NTP_PORT;
+  const char *colon = strrchr(text, ':');
+  size_t hostLength = colon ? (size_t) (colon - text) : strlen(text);
+  if (hostLength >= sizeof(host)) {
+    return false;
+  }
+  memcpy(host, text, hostLength);
+  host[hostLength] = 0;
+  if (colon) {
+    port = atoi(colon + 1);
+  }
+  memset(addr, 0, sizeof(*addr));
+  addr->sin_family = AF_INET;
+  addr->sin_port = htons(port);
+  return inet_pton(AF_INET, host, &addr->sin_addr) == 1;
+}
+
+static int runClient(sockaddr_in *servers, int count, int bursts, int samples) {
+  int fd = openSocket(0);
+  if (fd < 0) {
+    fprintf(stderr, "can't open a socket\n");
+    return 2;
+  }
+
+  NtpClockFilter filter;
+  filter.reset();
+  uint32_t ids[NTP_MAX_SERVERS];
+  for (int i = 0 ; i < count ; i++) {
+    ids[i] = i;
+  }
+  filter.setServers(ids, count);
+
+  for (int burst = 0 ; burst < bursts ; burst++) {
+    for (int sample = 0 ; sample < samples ; sample++) {
+      int64_t t1[NTP_MAX_SERVERS];
+      bool waiting[NTP_MAX_SERVERS];
+      for (int i = 0 ; i < count ; i++) {
+        uint8_t request[NTP_PACKET_SIZE];
+        t1[i] = nowUs();
+        ntpBuildRequest(request, t1[i]);
+        sendto(fd, request, NTP_PACKET_SIZE, 0, (sockaddr *) &servers[i], sizeof(servers[i]));
+        waiting[i] = true;
+      }
+
+      int64_t endUs = nowUs() + CLIENT_WAIT_MS * 1000;
+      int outstanding = count;
+      while ((outstanding > 0) && (nowUs() < endUs)) {
+        pollfd pfd = { fd, POLLIN, 0 };
+        if (poll(&pfd, 1, (int) ((endUs - nowUs()) / 1000) + 1) <= 0) {
+          continue;
+        }
+        uint8_t buffer[512];
+        sockaddr_in from;
+        socklen_t fromLength = sizeof(from);
+        ssize_t length = recvfrom(fd, buffer, sizeof(buffer), 0, (sockaddr *) &from, &fromLength);
+        int64_t t4 = nowUs();
+
+        ntp_reply_t reply;
+        if ((length < 0) || !ntpParseReply(buffer, length, &reply)) {
+          continue;
+        }
+        for (int i = 0 ; i < count ; i++) {
+          if (waiting[i] && (from.sin_port == servers[i].sin_port) && (from.sin_addr.s_addr == servers[i].sin_addr.s_addr)
+              && (reply.originateUs == t1[i])) {
+            filter.addSample(i, t1[i], &reply, t4);
+            waiting[i] = false;
+            outstanding--;
+          }
+        }
+      }
+      usleep(CLIENT_SPACING_MS * 1000);
+    }
+
+    bool ok = filter.endBurst(nowUs());
+    printf("burst %d\n", burst + 1);
+    for (int i = 0 ; i < count ; i++) {
+      ntp_server_stats_t stats;
+      filter.getServer(i, &stats);
+      char name[32];
+      snprintf(name, sizeof(name), "%s:%d", inet_ntoa(servers[i].sin_addr), ntohs(servers[i].sin_port));
+      printf("  %-22s offset %9.3f mS  delay %8.3f mS  jitter %8.3f mS  reach %02x  %s\n", name,
+             stats.offsetUs / 1000.0, stats.delayUs / 1000.0, stats.jitterUs / 1000.0, stats.reach,
+             stats.selected ? "selected" : (stats.distanceUs == 0 ? "no reply" : "rejected"));
+    }
+    if (ok) {
+      printf("  system offset %.3f mS, jitter %.3f mS, delay %.3f mS, %u of %u servers\n",
+             filter.getOffsetUs() / 1000.0, filter.getJitterUs() / 1000.0, filter.getDelayUs() / 1000.0,
+             filter.getSurvivors(), filter.getServerCount());
+    } else {
+      printf("  no majority of servers agree\n");
+    }
+  }
+
+  printf("\n%u bursts, %u without a result, %u outliers rejected\n", filter.getBursts(), filter.getFailedBursts(), filter.getOutliers());
+  close(fd);
+  return filter.isValid() ? 0 : 1;
+}
+
+static void usage(const char *name) {
+  fprintf(stderr, "usage: %s -S port[:offset[:requestDelay[:replyDelay[:jitter[:loss]]]]] ...\n", name);
+  fprintf(stderr, "       %s -c [-n bursts] [-k samples] host:port ...\n", name);
+}
+
+int main(int argc, char **argv) {
+  standin_t standins[MAX_STANDINS];
+  int standinCount = 0;
+  bool client = false;
+  int bursts = 1;
+  int samples = 4;
+
+  srand(time(NULL));
+
+  int opt;
+  while ((opt = getopt(argc, argv, "S:cn:k:")) != -1) {
+    switch (opt) {
+      case 'S': {
+          if (standinCount >= MAX_STANDINS) {
+            usage(argv[0]);
+            return 2;
+          }
+          standin_t *s = &standins[standinCount++];
+          memset(s, 0, sizeof(*s));
+          long long offsetMs = 0;
+          sscanf(optarg, "%d:%lld:%d:%d:%d:%d", &s->port, &offsetMs, &s->requestDelayMs, &s->replyDelayMs, &s->jitterMs, &s->lossPercent);
+          s->offsetUs = offsetMs * 1000;
+          break;
+        }
+      case 'c': client = true; break;
+      case 'n': bursts = atoi(optarg); break;
+      case 'k': samples = atoi(optarg); break;
+      default:
+        usage(argv[0]);
+        return 2;
+    }
+  }
+
+  if (client) {
+    sockaddr_in servers[NTP_MAX_SERVERS];
+    int count = 0;
+    for (int i = optind ; i < argc ; i++) {
+      if ((count >= NTP_MAX_SERVERS) || !parseHostPort(argv[i], &servers[count])) {
+        usage(argv[0]);
+        return 2;
+      }
+      count++;
+    }
+    if (count == 0) {
+      usage(argv[0]);
+      return 2;
+    }
+    return runClient(servers, count, bursts, samples);
+  }
+
+  if (standinCount == 0) {
+    usage(argv[0]);
+    return 2;
+  }
+  for (int i = 0 ; i < standinCount ; i++) {
+    standins[i].fd = openSocket(standins[i].port);
+    if (standins[i].fd < 0) {
+      fprintf(stderr, "can't listen on port %d\n", standins[i].port);
+      return 2;
+    }
+  }
+  return runServers(standins, standinCount);
+}